@@ -0,0 +1,263 @@
+#ifndef ANTIALIASING_H
+#define ANTIALIASING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/logging.h"
+#include "../Headers/shader.h"
+#include "../Headers/profiler.h"
+
+#include <string>
+#include <algorithm>
+
+namespace antialiasing {
+	enum AntiAliasingMode {
+		AA_OFF,
+		AA_MSAA_2X,
+		AA_MSAA_4X,
+		AA_MSAA_8X,
+		AA_FXAA,
+	};
+
+	const int MODE_COUNT = 5;
+	const char* const MODE_NAMES[MODE_COUNT] = { "Off", "MSAA 2x", "MSAA 4x", "MSAA 8x", "FXAA" };
+
+	const float MIN_SCALE = 0.25f;
+	const float MAX_SCALE = 2.0f;
+	const int VIEW_COUNT = 4;
+
+	// Window rectangle of one view and the part of the render target it is drawn into.
+	struct ViewRegion {
+		bool used;
+		int x, y, width, height;
+		int renderX, renderY, renderWidth, renderHeight;
+	};
+
+	// Offscreen target the scene is rendered into at (window size * scale),
+	// then resolved / filtered and stretched onto the default framebuffer.
+	// Each view may only use a fraction (ViewScale) of its area, e.g. for dynamic resolution.
+	class RenderTarget {
+	public:
+		int Mode;
+		float Scale;
+		bool IsFloatDepth;	// 32-bit float depth, for reversed depth
+		float ViewScale[VIEW_COUNT];
+		int Width;
+		int Height;
+		int WindowWidth;
+		int WindowHeight;
+
+		RenderTarget() : Mode(AA_OFF), Scale(1.0f), IsFloatDepth(false), Width(0), Height(0), WindowWidth(0), WindowHeight(0), maxSamples(0),
+			sceneFBO(0), colorBuffer(0), depthBuffer(0), resolveFBO(0), colorTexture(0), emptyVAO(0), fxaaShader(NULL) {
+			for (int i = 0; i < VIEW_COUNT; i++) {
+				ViewScale[i] = 1.0f;
+				regions[i].used = false;
+			}
+		}
+
+		void init(int windowWidth, int windowHeight) {
+			glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+			glGenVertexArrays(1, &emptyVAO);
+			fxaaShader = new Shader("Shaders/screen.vs", "Shaders/fxaa.fs");
+			fxaaShader->use();
+			fxaaShader->setInt("screenTexture", 0);
+			resize(windowWidth, windowHeight);
+		}
+
+		void resize(int windowWidth, int windowHeight) {
+			WindowWidth = windowWidth;
+			WindowHeight = windowHeight;
+			create();
+		}
+
+		void setMode(int mode) {
+			if (mode != Mode) {
+				Mode = mode;
+				create();
+			}
+		}
+
+		void setScale(float scale) {
+			scale = glm::clamp(scale, MIN_SCALE, MAX_SCALE);
+			if (scale != Scale) {
+				Scale = scale;
+				create();
+			}
+		}
+
+		void setFloatDepth(bool isFloatDepth) {
+			if (isFloatDepth != IsFloatDepth) {
+				IsFloatDepth = isFloatDepth;
+				create();
+			}
+		}
+
+		// Samples actually used by the current mode, clamped to what the driver supports.
+		int getSamples() const {
+			int samples = 0;
+			switch (Mode) {
+				case AA_MSAA_2X:
+					samples = 2;
+					break;
+				case AA_MSAA_4X:
+					samples = 4;
+					break;
+				case AA_MSAA_8X:
+					samples = 8;
+					break;
+			}
+			return std::min(samples, maxSamples);
+		}
+
+		int getMaxSamples() const {
+			return maxSamples;
+		}
+
+		// Bind the offscreen target and clear it.
+		void begin() {
+			glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+			glViewport(0, 0, Width, Height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (int i = 0; i < VIEW_COUNT; i++) {
+				regions[i].used = false;
+			}
+		}
+
+		// Set the GL viewport for a view covering the given window rectangle (in window pixels).
+		void setViewport(int view, int x, int y, int width, int height) {
+			ViewRegion& region = regions[view];
+			region.used = true;
+			region.x = x;
+			region.y = y;
+			region.width = width;
+			region.height = height;
+			region.renderX = (int)(x * Scale);
+			region.renderY = (int)(y * Scale);
+			region.renderWidth = std::max(1, (int)(width * Scale * ViewScale[view]));
+			region.renderHeight = std::max(1, (int)(height * Scale * ViewScale[view]));
+			glViewport(region.renderX, region.renderY, region.renderWidth, region.renderHeight);
+		}
+
+		const ViewRegion& getRegion(int view) const {
+			return regions[view];
+		}
+
+		// Resolve the offscreen target and stretch it onto the default framebuffer.
+		void end() {
+			if (getSamples() > 0) {
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO);
+				glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			if (Mode == AA_FXAA) {
+				glDisable(GL_DEPTH_TEST);
+				fxaaShader->use();
+				fxaaShader->setVec2("texelSize", glm::vec2(1.0f / Width, 1.0f / Height));
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, colorTexture);
+				glBindVertexArray(emptyVAO);
+				for (int i = 0; i < VIEW_COUNT; i++) {
+					const ViewRegion& region = regions[i];
+					if (!region.used) {
+						continue;
+					}
+					glViewport(region.x, region.y, region.width, region.height);
+					fxaaShader->setVec2("uvOffset", glm::vec2((float)region.renderX / Width, (float)region.renderY / Height));
+					fxaaShader->setVec2("uvScale", glm::vec2((float)region.renderWidth / Width, (float)region.renderHeight / Height));
+					profiler::countDrawCall(1);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+				}
+				glEnable(GL_DEPTH_TEST);
+			} else {
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, (getSamples() > 0) ? resolveFBO : sceneFBO);
+				for (int i = 0; i < VIEW_COUNT; i++) {
+					const ViewRegion& region = regions[i];
+					if (!region.used) {
+						continue;
+					}
+					bool isSameSize = region.renderWidth == region.width && region.renderHeight == region.height;
+					glBlitFramebuffer(region.renderX, region.renderY, region.renderX + region.renderWidth, region.renderY + region.renderHeight,
+						region.x, region.y, region.x + region.width, region.y + region.height, GL_COLOR_BUFFER_BIT, isSameSize ? GL_NEAREST : GL_LINEAR);
+				}
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			}
+			glViewport(0, 0, WindowWidth, WindowHeight);
+		}
+
+		void release() {
+			destroy();
+			glDeleteVertexArrays(1, &emptyVAO);
+			delete fxaaShader;
+			fxaaShader = NULL;
+		}
+
+	private:
+		int maxSamples;
+		ViewRegion regions[VIEW_COUNT];
+		unsigned int sceneFBO, colorBuffer, depthBuffer;
+		unsigned int resolveFBO, colorTexture;
+		unsigned int emptyVAO;
+		Shader* fxaaShader;
+
+		void create() {
+			destroy();
+			Width = std::max(1, (int)(WindowWidth * Scale));
+			Height = std::max(1, (int)(WindowHeight * Scale));
+			int samples = getSamples();
+
+			// Single-sampled color texture: the render target itself, or the MSAA resolve target.
+			glGenTextures(1, &colorTexture);
+			glBindTexture(GL_TEXTURE_2D, colorTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+			glGenRenderbuffers(1, &depthBuffer);
+			glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, IsFloatDepth ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8, Width, Height);
+
+			glGenFramebuffers(1, &sceneFBO);
+			glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+			if (samples > 0) {
+				glGenRenderbuffers(1, &colorBuffer);
+				glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, Width, Height);
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+			} else {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+			}
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+			checkStatus("Scene");
+
+			if (samples > 0) {
+				glGenFramebuffers(1, &resolveFBO);
+				glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+				checkStatus("Resolve");
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		void destroy() {
+			glDeleteFramebuffers(1, &sceneFBO);
+			glDeleteFramebuffers(1, &resolveFBO);
+			glDeleteRenderbuffers(1, &colorBuffer);
+			glDeleteRenderbuffers(1, &depthBuffer);
+			glDeleteTextures(1, &colorTexture);
+			sceneFBO = resolveFBO = colorBuffer = depthBuffer = colorTexture = 0;
+		}
+
+		void checkStatus(std::string name) {
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				logging::loggingMessage(logging::LogType::ERROR, name + " framebuffer is not complete.");
+			}
+		}
+	};
+}
+
+#endif // !ANTIALIASING_H
@@ -0,0 +1,303 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <glad/glad.h>
+
+#include "../Headers/logging.h"
+#include "../Headers/mesh.h"
+#include "../Headers/shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Textures, shaders and meshes keyed by a hash of their content, so the same file under two paths (or the same mesh
+// from two scenes) is loaded once. Every acquire takes a reference and release() gives it back. Resources nobody
+// references stay resident until the cache grows past Budget, then the least recently used ones are deleted.
+// Meshes live in the MeshRegistry arena, which cannot free, so they are shared but never evicted.
+namespace assets {
+	typedef uint64_t Hash;
+	const Hash HASH_SEED = 14695981039346656037ULL;
+	const uint64_t DEFAULT_BUDGET = 256ULL << 20;
+
+	enum Kind {
+		KIND_TEXTURE,
+		KIND_MESH,
+		KIND_SHADER,
+		KIND_COUNT,
+	};
+	const char* const KIND_NAMES[KIND_COUNT] = { "Texture", "Mesh", "Shader" };
+
+	typedef unsigned int (*TextureLoader)(char const* path);
+	typedef unsigned int (*CubemapLoader)(std::vector<std::string> faces);
+
+	// FNV-1a
+	Hash hashBytes(const void* data, size_t size, Hash hash = HASH_SEED) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	// Forward slashes work everywhere and make "a\\b.png" and "a/b.png" the same key.
+	std::string normalizePath(const std::string& path) {
+		std::string result = path;
+		std::replace(result.begin(), result.end(), '\\', '/');
+		return result;
+	}
+
+	struct Entry {
+		Kind kind;
+		Hash hash;
+		std::string name;
+		unsigned int handle;	// texture name, MeshRegistry id or program
+		uint64_t bytes;
+		int refs;
+		uint64_t lastUse;
+		Shader* shader;
+	};
+
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint64_t residentBytes;
+		unsigned int counts[KIND_COUNT];
+	};
+
+	class Cache {
+	public:
+		uint64_t Budget;
+
+		Cache(TextureLoader loadTexture, CubemapLoader loadCubemap) : Budget(DEFAULT_BUDGET), loadTexture(loadTexture), loadCubemap(loadCubemap), tick(0) {
+			stats = Stats();
+		}
+
+		unsigned int acquireTexture(const std::string& path) {
+			std::vector<std::string> paths(1, normalizePath(path));
+			Hash hash = hashFiles(KIND_TEXTURE, paths);
+			if (Entry* entry = find(hash)) {
+				return entry->handle;
+			}
+			unsigned int texture = loadTexture(paths[0].c_str());
+			insert(KIND_TEXTURE, hash, paths[0], texture, getTextureBytes(GL_TEXTURE_2D, texture), NULL);
+			return texture;
+		}
+
+		unsigned int acquireCubemap(const std::vector<std::string>& faces) {
+			std::vector<std::string> paths;
+			for (const std::string& face : faces) {
+				paths.push_back(normalizePath(face));
+			}
+			Hash hash = hashFiles(KIND_TEXTURE, paths);
+			if (Entry* entry = find(hash)) {
+				return entry->handle;
+			}
+			unsigned int texture = loadCubemap(paths);
+			insert(KIND_TEXTURE, hash, paths[0] + " (cube map)", texture, getTextureBytes(GL_TEXTURE_CUBE_MAP, texture), NULL);
+			return texture;
+		}
+
+		// The cache owns the shader, it stays valid until its last release() and eviction.
+		Shader* acquireShader(const std::string& vertexPath, const std::string& fragmentPath) {
+			std::vector<std::string> paths;
+			paths.push_back(normalizePath(vertexPath));
+			paths.push_back(normalizePath(fragmentPath));
+			Hash hash = hashFiles(KIND_SHADER, paths);
+			if (Entry* entry = find(hash)) {
+				return entry->shader;
+			}
+			Shader* shader = new Shader(paths[0].c_str(), paths[1].c_str());
+			// GL 3.3 cannot tell the size of a program
+			insert(KIND_SHADER, hash, paths[0] + " + " + paths[1], shader->ID, 0, shader);
+			return shader;
+		}
+
+		// Interleaved vertices (3 position, 3 normal, 2 texture coords) like MeshRegistry::add().
+		unsigned int acquireMesh(MeshRegistry& registry, const std::string& name, const std::vector<float>& vertices, const std::vector<unsigned int>& indices) {
+			std::vector<PackedVertex> packed = MeshRegistry::packVertices(vertices);
+			if (packed.size() <= 0xFFFF) {
+				std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+				return acquireMesh(registry, name, packed.data(), packed.size(), shortIndices.data(), GL_UNSIGNED_SHORT, shortIndices.size());
+			}
+			return acquireMesh(registry, name, packed.data(), packed.size(), indices.data(), GL_UNSIGNED_INT, indices.size());
+		}
+
+		// Same layout as MeshRegistry::addPacked(), the hash covers exactly what goes to the GPU.
+		unsigned int acquireMesh(MeshRegistry& registry, const std::string& name, const PackedVertex* vertices, GLsizei vertexCount, const void* indices, GLenum indexType, GLsizei indexCount) {
+			Hash hash = hashBytes(KIND_NAMES[KIND_MESH], strlen(KIND_NAMES[KIND_MESH]));
+			hash = hashBytes(&indexType, sizeof(indexType), hash);
+			hash = hashBytes(vertices, vertexCount * sizeof(PackedVertex), hash);
+			hash = hashBytes(indices, indexCount * ((indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint)), hash);
+			if (Entry* entry = find(hash)) {
+				return entry->handle;
+			}
+			unsigned int mesh = registry.addPacked(name, vertices, vertexCount, indices, indexType, indexCount);
+			if (mesh != MeshRegistry::INVALID_MESH) {
+				insert(KIND_MESH, hash, name, mesh, registry.get(mesh).vertexBytes + registry.get(mesh).indexBytes, NULL);
+			}
+			return mesh;
+		}
+
+		void release(Kind kind, unsigned int handle) {
+			std::map<std::pair<int, unsigned int>, Hash>::iterator found = handles.find(std::make_pair((int)kind, handle));
+			if (found == handles.end()) {
+				logging::loggingMessage(logging::LogType::WARNING, std::string("Released an unknown ") + KIND_NAMES[kind] + ": " + std::to_string(handle));
+				return;
+			}
+			Entry& entry = entries[found->second];
+			if (entry.refs > 0) {
+				entry.refs--;
+			}
+			trim();
+		}
+
+		// Delete everything, references or not (shutdown).
+		void releaseAll() {
+			for (std::pair<const Hash, Entry>& entry : entries) {
+				destroy(entry.second);
+			}
+			entries.clear();
+			handles.clear();
+			pathHashes.clear();
+			stats.residentBytes = 0;
+			for (int i = 0; i < KIND_COUNT; i++) {
+				stats.counts[i] = 0;
+			}
+		}
+
+		// Evict idle resources, least recently used first, until the cache fits Budget again.
+		// Entries that count no bytes (shaders) free nothing, so they are never picked.
+		void trim() {
+			while (stats.residentBytes > Budget) {
+				Entry* oldest = NULL;
+				for (std::pair<const Hash, Entry>& entry : entries) {
+					if (entry.second.refs == 0 && entry.second.kind != KIND_MESH && entry.second.bytes > 0 && (!oldest || entry.second.lastUse < oldest->lastUse)) {
+						oldest = &entry.second;
+					}
+				}
+				if (!oldest) {
+					return;
+				}
+				stats.evictions++;
+				stats.residentBytes -= oldest->bytes;
+				stats.counts[oldest->kind]--;
+				handles.erase(std::make_pair((int)oldest->kind, oldest->handle));
+				Hash hash = oldest->hash;
+				destroy(*oldest);
+				entries.erase(hash);
+			}
+		}
+
+		const Stats& getStats() const {
+			return stats;
+		}
+
+		const std::unordered_map<Hash, Entry>& getEntries() const {
+			return entries;
+		}
+
+	private:
+		TextureLoader loadTexture;
+		CubemapLoader loadCubemap;
+		Stats stats;
+		uint64_t tick;
+		std::unordered_map<Hash, Entry> entries;
+		std::map<std::pair<int, unsigned int>, Hash> handles;
+		// Files are hashed once per run (evicted ones too), later requests for the same paths only look them up
+		std::unordered_map<std::string, Hash> pathHashes;
+
+		// Hash of the files' content, of their paths when one cannot be read (the loader reports that).
+		Hash hashFiles(Kind kind, const std::vector<std::string>& paths) {
+			std::string key = KIND_NAMES[kind];
+			for (const std::string& path : paths) {
+				key += "|" + path;
+			}
+			std::unordered_map<std::string, Hash>::iterator known = pathHashes.find(key);
+			if (known != pathHashes.end()) {
+				return known->second;
+			}
+
+			Hash hash = hashBytes(KIND_NAMES[kind], strlen(KIND_NAMES[kind]));
+			std::vector<char> buffer(1 << 16);
+			for (const std::string& path : paths) {
+				std::ifstream file(path, std::ios::binary);
+				if (!file) {
+					hash = hashBytes(path.data(), path.size(), hash);
+					continue;
+				}
+				while (file) {
+					file.read(buffer.data(), buffer.size());
+					hash = hashBytes(buffer.data(), (size_t)file.gcount(), hash);
+				}
+				// Keeps "ab" + "c" apart from "a" + "bc"
+				hash = hashBytes("|", 1, hash);
+			}
+			pathHashes[key] = hash;
+			return hash;
+		}
+
+		Entry* find(Hash hash) {
+			std::unordered_map<Hash, Entry>::iterator found = entries.find(hash);
+			if (found == entries.end()) {
+				stats.misses++;
+				return NULL;
+			}
+			stats.hits++;
+			found->second.refs++;
+			found->second.lastUse = ++tick;
+			return &found->second;
+		}
+
+		void insert(Kind kind, Hash hash, const std::string& name, unsigned int handle, uint64_t bytes, Shader* shader) {
+			Entry entry = { kind, hash, name, handle, bytes, 1, ++tick, shader };
+			entries[hash] = entry;
+			handles[std::make_pair((int)kind, handle)] = hash;
+			stats.residentBytes += bytes;
+			stats.counts[kind]++;
+			trim();
+		}
+
+		void destroy(Entry& entry) {
+			if (entry.kind == KIND_TEXTURE) {
+				glDeleteTextures(1, &entry.handle);
+			} else if (entry.kind == KIND_SHADER) {
+				glDeleteProgram(entry.handle);
+				delete entry.shader;
+			}
+		}
+
+		// Sum of all levels (and faces), compressed levels report their real size.
+		static uint64_t getTextureBytes(GLenum target, unsigned int texture) {
+			GLenum face = (target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+			uint64_t bytes = 0;
+			glBindTexture(target, texture);
+			for (int level = 0; level < 16; level++) {
+				GLint width = 0, height = 0, isCompressed = GL_FALSE;
+				glGetTexLevelParameteriv(face, level, GL_TEXTURE_WIDTH, &width);
+				glGetTexLevelParameteriv(face, level, GL_TEXTURE_HEIGHT, &height);
+				if (width == 0) {
+					break;
+				}
+				glGetTexLevelParameteriv(face, level, GL_TEXTURE_COMPRESSED, &isCompressed);
+				if (isCompressed) {
+					GLint size = 0;
+					glGetTexLevelParameteriv(face, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+					bytes += size;
+				} else {
+					bytes += (uint64_t)width * height * 4;
+				}
+			}
+			glBindTexture(target, 0);
+			return (target == GL_TEXTURE_CUBE_MAP) ? bytes * 6 : bytes;
+		}
+	};
+}
+
+#endif // !ASSETS_H
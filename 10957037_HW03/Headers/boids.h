@@ -0,0 +1,365 @@
+#ifndef BOIDS_H
+#define BOIDS_H
+
+#include "../Headers/jobs.h"
+#include "../Headers/logging.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOIDS_SSE
+#include <emmintrin.h>
+#endif
+
+// Flocking fish (separation, alignment, cohesion and obstacle avoidance).
+// Fish live in structure-of-arrays form and are counting-sorted into a uniform grid every update,
+// so the neighbors of a fish are a few contiguous runs that the SIMD loop walks 4 at a time.
+// The sorted copy is only read by the steering, every fish keeps its slot in the state arrays,
+// so two states of the flock can be interpolated slot by slot.
+namespace boids {
+	struct Params {
+		float neighborRadius = 2.0f;	// also the grid cell size
+		float separationRadius = 0.8f;
+		float separationWeight = 6.0f;
+		float alignmentWeight = 1.5f;
+		float cohesionWeight = 0.8f;
+		float avoidRadius = 6.0f;
+		float avoidWeight = 30.0f;
+		float boundsWeight = 4.0f;
+		float minSpeed = 2.0f;
+		float maxSpeed = 6.0f;
+		glm::vec3 boundsMin = glm::vec3(-60.0f, -4.0f, -60.0f);
+		glm::vec3 boundsMax = glm::vec3(60.0f, 8.0f, 60.0f);
+	};
+
+	class Flock {
+	public:
+		Params Settings;
+		float LastGridTime;		// ms
+		float LastSteerTime;	// ms
+
+		Flock() : LastGridTime(0.0f), LastSteerTime(0.0f), generator(1234), nextId(0), cellSize(1.0f), cellsX(1), cellsY(1), cellsZ(1) {}
+
+		unsigned int size() const {
+			return (unsigned int)px.size();
+		}
+
+		glm::vec3 getPosition(unsigned int i) const {
+			return glm::vec3(px[i], py[i], pz[i]);
+		}
+
+		glm::vec3 getVelocity(unsigned int i) const {
+			return glm::vec3(vx[i], vy[i], vz[i]);
+		}
+
+		// All positions or velocities in slot order, e.g. to publish a state of the flock.
+		void copyPositions(std::vector<glm::vec3>& positions) const {
+			positions.resize(size());
+			for (unsigned int i = 0; i < size(); i++) {
+				positions[i] = glm::vec3(px[i], py[i], pz[i]);
+			}
+		}
+
+		void copyVelocities(std::vector<glm::vec3>& velocities) const {
+			velocities.resize(size());
+			for (unsigned int i = 0; i < size(); i++) {
+				velocities[i] = glm::vec3(vx[i], vy[i], vz[i]);
+			}
+		}
+
+		// A fish keeps its slot (and its id) until the flock shrinks below it.
+		unsigned int getId(unsigned int i) const {
+			return ids[i];
+		}
+
+		void setFish(unsigned int i, const glm::vec3& position, const glm::vec3& velocity) {
+			px[i] = position.x;
+			py[i] = position.y;
+			pz[i] = position.z;
+			vx[i] = velocity.x;
+			vy[i] = velocity.y;
+			vz[i] = velocity.z;
+		}
+
+		// Grow (new fish spawn anywhere inside the bounds) or shrink the flock.
+		void resize(unsigned int count) {
+			unsigned int old = size();
+			for (std::vector<float>* array : { &px, &py, &pz, &vx, &vy, &vz }) {
+				array->resize(count);
+			}
+			ids.resize(count);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			for (unsigned int i = old; i < count; i++) {
+				ids[i] = nextId++;
+				glm::vec3 position = glm::mix(Settings.boundsMin, Settings.boundsMax, glm::vec3(unit(generator), unit(generator), unit(generator)));
+				float angle = unit(generator) * 6.2831853f;
+				px[i] = position.x;
+				py[i] = position.y;
+				pz[i] = position.z;
+				vx[i] = cos(angle) * Settings.minSpeed;
+				vy[i] = 0.0f;
+				vz[i] = sin(angle) * Settings.minSpeed;
+			}
+		}
+
+		// One step: rebuild the grid on this thread, then steer and move the fish over the job system.
+		void update(float deltaTime, const glm::vec3& obstacle, int zone = -1) {
+			if (px.empty()) {
+				return;
+			}
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			buildGrid();
+			std::chrono::high_resolution_clock::time_point built = std::chrono::high_resolution_clock::now();
+
+			jobs::Counter counter(0);
+			jobs::get().parallelFor(size(), 256, [this, deltaTime, obstacle](unsigned int begin, unsigned int end) {
+				steer(begin, end, deltaTime, obstacle);
+			}, counter, zone);
+			jobs::get().wait(counter);
+
+			std::chrono::high_resolution_clock::time_point done = std::chrono::high_resolution_clock::now();
+			LastGridTime = std::chrono::duration<float, std::milli>(built - start).count();
+			LastSteerTime = std::chrono::duration<float, std::milli>(done - built).count();
+		}
+
+	private:
+		std::default_random_engine generator;
+
+		// Current state, in slot order
+		std::vector<float> px, py, pz, vx, vy, vz;
+		std::vector<uint32_t> ids;
+		std::vector<uint32_t> sortedSlots;	// slot of every sorted fish, where the steering writes it back
+		uint32_t nextId;
+		// Grid sorted copy the steering reads from, padded so the SIMD loop may read a few past the end
+		std::vector<float> sx, sy, sz, svx, svy, svz;
+		std::vector<uint32_t> cellOf;
+		std::vector<uint32_t> cellStart;	// fish of cell c are [cellStart[c], cellStart[c + 1])
+		std::vector<uint32_t> cellCursor;
+		glm::vec3 gridOrigin;
+		float cellSize;
+		int cellsX, cellsY, cellsZ;
+
+#ifdef BOIDS_SSE
+		typedef __m128 Lane;
+#else
+		typedef float Lane;
+#endif
+		// Running neighbor sums, 4 lanes wide with SSE
+		struct Sums {
+			Lane count, positionX, positionY, positionZ, velocityX, velocityY, velocityZ, separationX, separationY, separationZ;
+		};
+
+		int getCellAxis(float value, float origin, int cells) const {
+			return glm::clamp((int)((value - origin) / cellSize), 0, cells - 1);
+		}
+
+		// Counting sort of the fish into a uniform grid over their bounding box.
+		// Cells along x are neighbors in memory, so a 3 x 3 x 3 block is only 9 contiguous runs.
+		void buildGrid() {
+			unsigned int count = size();
+			glm::vec3 low(px[0], py[0], pz[0]), high = low;
+			for (unsigned int i = 1; i < count; i++) {
+				low = glm::min(low, glm::vec3(px[i], py[i], pz[i]));
+				high = glm::max(high, glm::vec3(px[i], py[i], pz[i]));
+			}
+			// Cells never get smaller than the neighbor radius, only bigger when a scattered flock would need too many
+			gridOrigin = low;
+			cellSize = Settings.neighborRadius;
+			uint64_t limit = std::max<uint64_t>(4096, (uint64_t)count * 4);
+			while (true) {
+				cellsX = (int)((high.x - low.x) / cellSize) + 1;
+				cellsY = (int)((high.y - low.y) / cellSize) + 1;
+				cellsZ = (int)((high.z - low.z) / cellSize) + 1;
+				if ((uint64_t)cellsX * cellsY * cellsZ <= limit) {
+					break;
+				}
+				cellSize *= 2.0f;
+			}
+
+			uint32_t cells = cellsX * cellsY * cellsZ;
+			cellStart.assign(cells + 1, 0);
+			cellOf.resize(count);
+			for (unsigned int i = 0; i < count; i++) {
+				int x = getCellAxis(px[i], gridOrigin.x, cellsX);
+				int y = getCellAxis(py[i], gridOrigin.y, cellsY);
+				int z = getCellAxis(pz[i], gridOrigin.z, cellsZ);
+				cellOf[i] = (z * cellsY + y) * cellsX + x;
+				cellStart[cellOf[i] + 1]++;
+			}
+			for (uint32_t c = 0; c < cells; c++) {
+				cellStart[c + 1] += cellStart[c];
+			}
+
+			for (std::vector<float>* array : { &sx, &sy, &sz, &svx, &svy, &svz }) {
+				array->assign(count + 3, 0.0f);
+			}
+			sortedSlots.resize(count);
+			cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+			for (unsigned int i = 0; i < count; i++) {
+				uint32_t sorted = cellCursor[cellOf[i]]++;
+				sortedSlots[sorted] = i;
+				sx[sorted] = px[i];
+				sy[sorted] = py[i];
+				sz[sorted] = pz[i];
+				svx[sorted] = vx[i];
+				svy[sorted] = vy[i];
+				svz[sorted] = vz[i];
+			}
+		}
+
+		// Add the fish in [begin, end) of the sorted arrays that are within the neighbor radius.
+		void gather(uint32_t begin, uint32_t end, const glm::vec3& position, Sums& sums) const {
+			float radius2 = Settings.neighborRadius * Settings.neighborRadius;
+			float separation2 = Settings.separationRadius * Settings.separationRadius;
+#ifdef BOIDS_SSE
+			__m128 x = _mm_set1_ps(position.x), y = _mm_set1_ps(position.y), z = _mm_set1_ps(position.z);
+			__m128 r2 = _mm_set1_ps(radius2), s2 = _mm_set1_ps(separation2);
+			__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), epsilon = _mm_set1_ps(1e-4f);
+			__m128i lanes = _mm_setr_epi32(0, 1, 2, 3), last = _mm_set1_epi32((int)end);
+			for (uint32_t j = begin; j < end; j += 4) {
+				// Lanes past the end of the run belong to other cells (or the padding)
+				__m128 inside = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32((int)j), lanes), last));
+				__m128 ox = _mm_loadu_ps(&sx[j]), oy = _mm_loadu_ps(&sy[j]), oz = _mm_loadu_ps(&sz[j]);
+				__m128 dx = _mm_sub_ps(ox, x), dy = _mm_sub_ps(oy, y), dz = _mm_sub_ps(oz, z);
+				__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				// distance 0 is the fish itself
+				__m128 near = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(d2, r2), _mm_cmpgt_ps(d2, zero)));
+				sums.count = _mm_add_ps(sums.count, _mm_and_ps(near, one));
+				sums.positionX = _mm_add_ps(sums.positionX, _mm_and_ps(near, ox));
+				sums.positionY = _mm_add_ps(sums.positionY, _mm_and_ps(near, oy));
+				sums.positionZ = _mm_add_ps(sums.positionZ, _mm_and_ps(near, oz));
+				sums.velocityX = _mm_add_ps(sums.velocityX, _mm_and_ps(near, _mm_loadu_ps(&svx[j])));
+				sums.velocityY = _mm_add_ps(sums.velocityY, _mm_and_ps(near, _mm_loadu_ps(&svy[j])));
+				sums.velocityZ = _mm_add_ps(sums.velocityZ, _mm_and_ps(near, _mm_loadu_ps(&svz[j])));
+				__m128 close = _mm_and_ps(near, _mm_cmplt_ps(d2, s2));
+				__m128 inverse = _mm_and_ps(close, _mm_div_ps(one, _mm_max_ps(d2, epsilon)));
+				sums.separationX = _mm_sub_ps(sums.separationX, _mm_mul_ps(dx, inverse));
+				sums.separationY = _mm_sub_ps(sums.separationY, _mm_mul_ps(dy, inverse));
+				sums.separationZ = _mm_sub_ps(sums.separationZ, _mm_mul_ps(dz, inverse));
+			}
+#else
+			for (uint32_t j = begin; j < end; j++) {
+				glm::vec3 offset = glm::vec3(sx[j], sy[j], sz[j]) - position;
+				float d2 = glm::dot(offset, offset);
+				if (d2 >= radius2 || d2 <= 0.0f) {
+					continue;
+				}
+				sums.count += 1.0f;
+				sums.positionX += sx[j];
+				sums.positionY += sy[j];
+				sums.positionZ += sz[j];
+				sums.velocityX += svx[j];
+				sums.velocityY += svy[j];
+				sums.velocityZ += svz[j];
+				if (d2 < separation2) {
+					float inverse = 1.0f / std::max(d2, 1e-4f);
+					sums.separationX -= offset.x * inverse;
+					sums.separationY -= offset.y * inverse;
+					sums.separationZ -= offset.z * inverse;
+				}
+			}
+#endif
+		}
+
+		static float reduce(Lane value) {
+#ifdef BOIDS_SSE
+			__m128 shuffled = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 sums = _mm_add_ps(value, shuffled);
+			shuffled = _mm_movehl_ps(shuffled, sums);
+			return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+#else
+			return value;
+#endif
+		}
+
+		// Steer the sorted fish [begin, end) and write each one back to its own slot of the state arrays.
+		void steer(unsigned int begin, unsigned int end, float deltaTime, const glm::vec3& obstacle) {
+			for (unsigned int i = begin; i < end; i++) {
+				glm::vec3 position(sx[i], sy[i], sz[i]);
+				glm::vec3 velocity(svx[i], svy[i], svz[i]);
+
+				Sums sums;
+				sums.count = sums.positionX = sums.positionY = sums.positionZ = Lane();
+				sums.velocityX = sums.velocityY = sums.velocityZ = Lane();
+				sums.separationX = sums.separationY = sums.separationZ = Lane();
+				int x = getCellAxis(position.x, gridOrigin.x, cellsX);
+				int y = getCellAxis(position.y, gridOrigin.y, cellsY);
+				int z = getCellAxis(position.z, gridOrigin.z, cellsZ);
+				int first = std::max(x - 1, 0), last = std::min(x + 1, cellsX - 1);
+				for (int cz = std::max(z - 1, 0); cz <= std::min(z + 1, cellsZ - 1); cz++) {
+					for (int cy = std::max(y - 1, 0); cy <= std::min(y + 1, cellsY - 1); cy++) {
+						int row = (cz * cellsY + cy) * cellsX;
+						gather(cellStart[row + first], cellStart[row + last + 1], position, sums);
+					}
+				}
+
+				glm::vec3 acceleration(0.0f);
+				float neighbors = reduce(sums.count);
+				if (neighbors > 0.0f) {
+					glm::vec3 center = glm::vec3(reduce(sums.positionX), reduce(sums.positionY), reduce(sums.positionZ)) / neighbors;
+					glm::vec3 heading = glm::vec3(reduce(sums.velocityX), reduce(sums.velocityY), reduce(sums.velocityZ)) / neighbors;
+					glm::vec3 separation = glm::vec3(reduce(sums.separationX), reduce(sums.separationY), reduce(sums.separationZ));
+					acceleration += (center - position) * Settings.cohesionWeight;
+					acceleration += (heading - velocity) * Settings.alignmentWeight;
+					acceleration += separation * Settings.separationWeight;
+				}
+
+				glm::vec3 away = position - obstacle;
+				float distance = glm::length(away);
+				if (distance < Settings.avoidRadius && distance > 1e-4f) {
+					acceleration += away / distance * (1.0f - distance / Settings.avoidRadius) * Settings.avoidWeight;
+				}
+
+				// Push back towards the inside once a fish leaves the bounds
+				acceleration += (glm::max(Settings.boundsMin - position, glm::vec3(0.0f)) - glm::max(position - Settings.boundsMax, glm::vec3(0.0f))) * Settings.boundsWeight;
+
+				velocity += acceleration * deltaTime;
+				float speed = glm::length(velocity);
+				if (speed > 1e-4f) {
+					velocity *= glm::clamp(speed, Settings.minSpeed, Settings.maxSpeed) / speed;
+				}
+				position += velocity * deltaTime;
+
+				uint32_t slot = sortedSlots[i];
+				px[slot] = position.x;
+				py[slot] = position.y;
+				pz[slot] = position.z;
+				vx[slot] = velocity.x;
+				vy[slot] = velocity.y;
+				vz[slot] = velocity.z;
+			}
+		}
+	};
+
+	// Time the update for growing flock sizes and log the average per step ("--bench-boids").
+	void benchmark(const std::vector<unsigned int>& counts, int steps) {
+		logging::loggingMessage(logging::LogType::INFO, "Boids benchmark, " + std::to_string(jobs::get().getWorkerCount()) + " workers, " + std::to_string(steps) + " steps per size.");
+		for (unsigned int count : counts) {
+			Flock flock;
+			flock.resize(count);
+			// Let the school form first, a random start has almost no neighbors
+			for (int i = 0; i < 10; i++) {
+				flock.update(1.0f / 60.0f, glm::vec3(0.0f));
+			}
+			float grid = 0.0f, steer = 0.0f;
+			for (int i = 0; i < steps; i++) {
+				flock.update(1.0f / 60.0f, glm::vec3(0.0f));
+				grid += flock.LastGridTime;
+				steer += flock.LastSteerTime;
+			}
+			char line[128];
+			snprintf(line, sizeof(line), "%7u fish: grid %.3f ms, steering %.3f ms, total %.3f ms", count, grid / steps, steer / steps, (grid + steer) / steps);
+			logging::loggingMessage(logging::LogType::INFO, line);
+		}
+	}
+}
+
+#endif // !BOIDS_H
@@ -0,0 +1,329 @@
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/jobs.h"
+#include "../Headers/logging.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// The seabed is split into square chunks that stream in and out around a center (the ROV or the ghost camera).
+// Each chunk carries a 16-bit height tile and its grass, box and glow prop positions. Chunks are generated
+// on the job system and their tiles uploaded into one toroidal heightmap texture (world meter x lands on texel x mod
+// HEIGHTMAP_SIZE), so memory stays the same however far it goes. terrain.h draws the seabed from that texture.
+// Everything a chunk holds is a pure function of its coordinates, the simulation thread uses the same functions for collision.
+namespace chunks {
+	const float CHUNK_SIZE = 64.0f;
+	const int CHUNK_TEXELS = 64;		// one height per meter
+	const int HEIGHTMAP_SIZE = 1024;		// texels per side of the toroidal heightmap, a multiple of CHUNK_TEXELS
+	const float SEABED_HEIGHT = -5.0f;
+	const float SEABED_RELIEF = 1.0f;	// heights stay within SEABED_HEIGHT +- SEABED_RELIEF
+	const float HEIGHT_MIN = SEABED_HEIGHT - SEABED_RELIEF;	// height of texel value 0
+	const float HEIGHT_MAX = SEABED_HEIGHT + SEABED_RELIEF;	// height of texel value 65535
+	const float TEXTURE_TILE = 8.0f;	// world units per texture repeat, same as the old floor
+	const int UPLOADS_PER_FRAME = 2;
+
+	// What a scatter() call places.
+	enum Scatter {
+		SCATTER_GRASS = 1,
+		SCATTER_BOXES = 2,
+		SCATTER_GLOW = 3,
+	};
+
+	uint32_t hashCoords(int x, int z, uint32_t salt) {
+		uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)z * 19349663u ^ salt * 83492791u;
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// Smoothly interpolated random values on the integer lattice, in [-1, 1].
+	float getValueNoise(float x, float z) {
+		float cellX = floor(x);
+		float cellZ = floor(z);
+		int ix = (int)cellX;
+		int iz = (int)cellZ;
+		float fx = x - cellX;
+		float fz = z - cellZ;
+		fx = fx * fx * (3.0f - 2.0f * fx);
+		fz = fz * fz * (3.0f - 2.0f * fz);
+		float v00 = hashCoords(ix, iz, 0) / 2147483647.5f - 1.0f;
+		float v10 = hashCoords(ix + 1, iz, 0) / 2147483647.5f - 1.0f;
+		float v01 = hashCoords(ix, iz + 1, 0) / 2147483647.5f - 1.0f;
+		float v11 = hashCoords(ix + 1, iz + 1, 0) / 2147483647.5f - 1.0f;
+		return glm::mix(glm::mix(v00, v10, fx), glm::mix(v01, v11, fx), fz);
+	}
+
+	// Height of the sand at a world position, three octaves of value noise.
+	float getSeabedHeight(float x, float z) {
+		float height = 0.0f;
+		float amplitude = 0.5f;
+		float frequency = 1.0f / 32.0f;
+		for (int octave = 0; octave < 3; octave++) {
+			height += getValueNoise(x * frequency, z * frequency) * amplitude;
+			amplitude *= 0.5f;
+			frequency *= 2.0f;
+		}
+		return SEABED_HEIGHT + height * SEABED_RELIEF;
+	}
+
+	// Append count random positions inside chunk (x, z) (y = 0), the same chunk always gives the same positions.
+	void scatter(int x, int z, Scatter kind, unsigned int count, std::vector<glm::vec3>& positions) {
+		std::mt19937 generator(hashCoords(x, z, kind));
+		std::uniform_real_distribution<float> unit(0.0f, CHUNK_SIZE);
+		for (unsigned int i = 0; i < count; i++) {
+			float px = unit(generator);
+			float pz = unit(generator);
+			positions.push_back(glm::vec3(x * CHUNK_SIZE + px, 0.0f, z * CHUNK_SIZE + pz));
+		}
+	}
+
+	int getChunkCoord(float position) {
+		return (int)floor(position / CHUNK_SIZE);
+	}
+
+	enum ChunkState {
+		CHUNK_FREE,
+		CHUNK_LOADING,	// a job is filling it
+		CHUNK_READY,	// generated, waiting for its upload
+		CHUNK_RESIDENT,	// in the heightmap
+	};
+
+	struct Chunk {
+		int x, z;
+		ChunkState state;
+		bool isSurrounded;	// resident with all 8 neighbors resident, so every height it samples is valid
+		jobs::Counter loading;
+
+		// Filled by the job, heights[row * CHUNK_TEXELS + column] is at getOrigin() + (column, 0, row)
+		std::vector<uint16_t> heights;
+		std::vector<glm::vec3> grass;	// world positions on the sand
+		std::vector<glm::vec3> boxes;	// world positions (y = 0, the boxes bob around it)
+		std::vector<glm::vec3> glow;	// world positions floating a little above the sand
+
+		Chunk() : x(0), z(0), state(CHUNK_FREE), isSurrounded(false), loading(0) {}
+
+		glm::vec3 getOrigin() const {
+			return glm::vec3(x * CHUNK_SIZE, 0.0f, z * CHUNK_SIZE);
+		}
+	};
+
+	class Streamer {
+	public:
+		Streamer() : radius(0), boxesPerChunk(0), grassPerChunk(0), glowPerChunk(0), zone(-1), version(0), uploads(0), surroundedVersion(0xFFFFFFFF), heightTexture(0) {}
+
+		// Chunks within radius (in chunks) are loaded, they are dropped once they are more than radius + 1 away.
+		static unsigned int getPoolSize(int radius) {
+			return (2 * (radius + 1) + 1) * (2 * (radius + 1) + 1);
+		}
+
+		void init(int loadRadius, unsigned int boxes, unsigned int grass, unsigned int glow, int jobZone = -1) {
+			// Every chunk that can be resident needs its own place in the heightmap
+			int maxRadius = HEIGHTMAP_SIZE / CHUNK_TEXELS / 2 - 2;
+			if (loadRadius > maxRadius) {
+				logging::loggingMessage(logging::LogType::ERROR, "Chunk load radius " + std::to_string(loadRadius) + " does not fit the heightmap, using " + std::to_string(maxRadius) + ".");
+				loadRadius = maxRadius;
+			}
+			radius = loadRadius;
+			boxesPerChunk = boxes;
+			grassPerChunk = grass;
+			glowPerChunk = glow;
+			zone = jobZone;
+			chunks = std::vector<Chunk>(getPoolSize(radius));
+
+			glGenTextures(1, &heightTexture);
+			glBindTexture(GL_TEXTURE_2D, heightTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 0, GL_RED, GL_UNSIGNED_SHORT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		// Let running jobs finish, they write into the chunks.
+		void release() {
+			for (Chunk& chunk : chunks) {
+				jobs::get().wait(chunk.loading);
+			}
+			chunks.clear();
+			glDeleteTextures(1, &heightTexture);
+			heightTexture = 0;
+		}
+
+		// Once per frame on the main thread: drop far chunks, upload finished ones and queue the missing ones nearest first.
+		// isBlocking waits for every queued chunk and uploads all of them (startup).
+		void update(const glm::vec3& center, bool isBlocking = false) {
+			int centerX = getChunkCoord(center.x);
+			int centerZ = getChunkCoord(center.z);
+			uploads = 0;
+
+			for (Chunk& chunk : chunks) {
+				if (chunk.state == CHUNK_LOADING && chunk.loading.load(std::memory_order_acquire) == 0) {
+					chunk.state = CHUNK_READY;
+				}
+				if ((chunk.state == CHUNK_READY || chunk.state == CHUNK_RESIDENT) && getDistance(chunk, centerX, centerZ) > radius + 1) {
+					if (chunk.state == CHUNK_RESIDENT) {
+						version++;
+					}
+					chunk.state = CHUNK_FREE;
+				}
+			}
+
+			for (int ring = 0; ring <= radius; ring++) {
+				for (int dz = -ring; dz <= ring; dz++) {
+					for (int dx = -ring; dx <= ring; dx++) {
+						if (std::max(abs(dx), abs(dz)) != ring || find(centerX + dx, centerZ + dz)) {
+							continue;
+						}
+						Chunk* chunk = allocate();
+						if (!chunk) {
+							continue;
+						}
+						chunk->x = centerX + dx;
+						chunk->z = centerZ + dz;
+						chunk->state = CHUNK_LOADING;
+						jobs::get().run([this, chunk]() { generate(*chunk); }, chunk->loading, zone);
+					}
+				}
+			}
+
+			for (Chunk& chunk : chunks) {
+				if (isBlocking && chunk.state == CHUNK_LOADING) {
+					jobs::get().wait(chunk.loading);
+					chunk.state = CHUNK_READY;
+				}
+				if (chunk.state == CHUNK_READY && (isBlocking || uploads < UPLOADS_PER_FRAME)) {
+					upload(chunk);
+					chunk.state = CHUNK_RESIDENT;
+					uploads++;
+					version++;
+				}
+			}
+
+			if (version != surroundedVersion) {
+				for (Chunk& chunk : chunks) {
+					chunk.isSurrounded = (chunk.state == CHUNK_RESIDENT);
+					for (int dz = -1; dz <= 1 && chunk.isSurrounded; dz++) {
+						for (int dx = -1; dx <= 1 && chunk.isSurrounded; dx++) {
+							chunk.isSurrounded = find(chunk.x + dx, chunk.z + dz, CHUNK_RESIDENT);
+						}
+					}
+				}
+				surroundedVersion = version;
+			}
+		}
+
+		const std::vector<Chunk>& getChunks() const {
+			return chunks;
+		}
+
+		// Changes whenever the set of resident chunks does, to know when to rebuild what is gathered from them.
+		unsigned int getVersion() const {
+			return version;
+		}
+
+		unsigned int getCount(ChunkState state) const {
+			unsigned int count = 0;
+			for (const Chunk& chunk : chunks) {
+				count += (chunk.state == state);
+			}
+			return count;
+		}
+
+		unsigned int getLastUploads() const {
+			return uploads;
+		}
+
+		// GL_R16, height = mix(HEIGHT_MIN, HEIGHT_MAX, texel), only the texels of resident chunks are valid.
+		unsigned int getHeightTexture() const {
+			return heightTexture;
+		}
+
+	private:
+		std::vector<Chunk> chunks;
+		int radius;
+		unsigned int boxesPerChunk;
+		unsigned int grassPerChunk;
+		unsigned int glowPerChunk;
+		int zone;
+		unsigned int version;
+		unsigned int uploads;
+		unsigned int surroundedVersion;
+		unsigned int heightTexture;
+
+		static int getDistance(const Chunk& chunk, int x, int z) {
+			return std::max(abs(chunk.x - x), abs(chunk.z - z));
+		}
+
+		// CHUNK_FREE as the state matches a chunk in any other state.
+		bool find(int x, int z, ChunkState state = CHUNK_FREE) const {
+			for (const Chunk& chunk : chunks) {
+				if (chunk.state != CHUNK_FREE && (state == CHUNK_FREE || chunk.state == state) && chunk.x == x && chunk.z == z) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		Chunk* allocate() {
+			for (Chunk& chunk : chunks) {
+				if (chunk.state == CHUNK_FREE) {
+					return &chunk;
+				}
+			}
+			return NULL;
+		}
+
+		// The tile goes where its first texel lands, chunks never straddle the wrap since HEIGHTMAP_SIZE is a multiple of CHUNK_TEXELS.
+		void upload(const Chunk& chunk) {
+			int offsetX = ((chunk.x * CHUNK_TEXELS) % HEIGHTMAP_SIZE + HEIGHTMAP_SIZE) % HEIGHTMAP_SIZE;
+			int offsetZ = ((chunk.z * CHUNK_TEXELS) % HEIGHTMAP_SIZE + HEIGHTMAP_SIZE) % HEIGHTMAP_SIZE;
+			glBindTexture(GL_TEXTURE_2D, heightTexture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, offsetX, offsetZ, CHUNK_TEXELS, CHUNK_TEXELS, GL_RED, GL_UNSIGNED_SHORT, chunk.heights.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		// Runs on a worker, only touches its own chunk.
+		void generate(Chunk& chunk) {
+			glm::vec3 origin = chunk.getOrigin();
+
+			chunk.heights.resize(CHUNK_TEXELS * CHUNK_TEXELS);
+			for (int row = 0; row < CHUNK_TEXELS; row++) {
+				for (int column = 0; column < CHUNK_TEXELS; column++) {
+					float height = getSeabedHeight(origin.x + column, origin.z + row);
+					float normalized = glm::clamp((height - HEIGHT_MIN) / (HEIGHT_MAX - HEIGHT_MIN), 0.0f, 1.0f);
+					chunk.heights[row * CHUNK_TEXELS + column] = (uint16_t)(normalized * 65535.0f + 0.5f);
+				}
+			}
+
+			chunk.grass.clear();
+			scatter(chunk.x, chunk.z, SCATTER_GRASS, grassPerChunk, chunk.grass);
+			for (glm::vec3& position : chunk.grass) {
+				position.y = getSeabedHeight(position.x, position.z);
+			}
+			chunk.boxes.clear();
+			scatter(chunk.x, chunk.z, SCATTER_BOXES, boxesPerChunk, chunk.boxes);
+			chunk.glow.clear();
+			scatter(chunk.x, chunk.z, SCATTER_GLOW, glowPerChunk, chunk.glow);
+			for (unsigned int i = 0; i < chunk.glow.size(); i++) {
+				glm::vec3& position = chunk.glow[i];
+				position.y = getSeabedHeight(position.x, position.z) + 0.4f + 2.6f * (hashCoords(chunk.x, chunk.z, SCATTER_GLOW + i) / 4294967295.0f);
+			}
+		}
+	};
+}
+
+#endif // !CHUNKS_H
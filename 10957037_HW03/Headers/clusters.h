@@ -0,0 +1,371 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/jobs.h"
+#include "../Headers/logging.h"
+#include "../Headers/shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTERS_SSE
+#include <emmintrin.h>
+#endif
+
+// Point and spot lights binned into the clusters of a view: GRID_X x GRID_Y screen tiles times GRID_Z depth slices.
+// Binning runs on the job system once per view, a job per depth slice tests the lights that reach into the slice
+// 4 at a time against the view space bounds of its clusters. The lights, the index range of every cluster and the
+// light indices go to the shader in texture buffers (GL 3.3 has no storage buffers), so lighting.fs only loops over
+// the few lights of its cluster however many there are in the world.
+namespace clusters {
+	const int GRID_X = 16;
+	const int GRID_Y = 9;
+	const int GRID_Z = 24;
+	const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+	const unsigned int MAX_CLUSTER_LIGHTS = 128;	// more lights in one cluster are dropped, it bounds the shader loop
+	const float FIRST_SLICE_DEPTH = 3.0f;	// slice 0 ends here, the others grow exponentially up to the binning distance
+	const int LIGHT_TEXTURE_UNIT = 9;
+	const int RANGE_TEXTURE_UNIT = 10;
+	const int INDEX_TEXTURE_UNIT = 11;
+
+	// Three RGBA32F texels of the light buffer. Spot lights fade out from innerCos to outerCos around direction,
+	// point lights have innerCos -1 and outerCos -2 so every direction is inside their cone.
+	struct Light {
+		glm::vec3 position;
+		float range;		// the light falls to exactly zero here
+		glm::vec3 color;	// intensity included
+		float innerCos;
+		glm::vec3 direction;
+		float outerCos;
+	};
+	static_assert(sizeof(Light) == 12 * sizeof(float), "A light is three texels");
+
+	Light makePoint(const glm::vec3& position, const glm::vec3& color, float range) {
+		return { position, range, color, -1.0f, glm::vec3(0.0f, -1.0f, 0.0f), -2.0f };
+	}
+
+	// Cone angles are measured from the direction, in degrees.
+	Light makeSpot(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& color, float range, float innerAngle, float outerAngle) {
+		return { position, range, color, std::cos(glm::radians(innerAngle)), glm::normalize(direction), std::cos(glm::radians(outerAngle)) };
+	}
+
+	// Depth in front of the camera where a slice ends, same spacing as getCluster() in lighting.fs.
+	float getSliceEnd(int slice, float maxDepth) {
+		return FIRST_SLICE_DEPTH * pow(maxDepth / FIRST_SLICE_DEPTH, (float)slice / (GRID_Z - 1));
+	}
+
+	class LightGrid {
+	public:
+		bool IsEnabled;
+		float MaxDistance;	// lights are binned up to this depth, farther fragments get none
+
+		LightGrid() : IsEnabled(true), MaxDistance(200.0f), zone(-1), boundsDepth(0.0f), boundsProjection(0.0f), maxDepth(0.0f),
+			buffers{ 0, 0, 0 }, textures{ 0, 0, 0 }, capacities{ 0, 0, 0 }, referenceCount(0), maxClusterLights(0), fullClusters(0), buildTime(0.0f) {}
+
+		void init(int jobZone = -1) {
+			zone = jobZone;
+			bounds.resize(CLUSTER_COUNT * 2);
+			ranges.resize(CLUSTER_COUNT * 2);
+			slices.resize(GRID_Z);
+			const GLenum FORMATS[BUFFER_COUNT] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+			glGenBuffers(BUFFER_COUNT, buffers);
+			glGenTextures(BUFFER_COUNT, textures);
+			for (int i = 0; i < BUFFER_COUNT; i++) {
+				capacities[i] = 4096;
+				glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+				glBufferData(GL_TEXTURE_BUFFER, capacities[i], NULL, GL_STREAM_DRAW);
+				glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+				glTexBuffer(GL_TEXTURE_BUFFER, FORMATS[i], buffers[i]);
+			}
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+
+		void clear() {
+			lights.clear();
+		}
+
+		void add(const Light& light) {
+			lights.push_back(light);
+		}
+
+		// Once per frame after the lights are added, every view bins the same lights.
+		void upload() {
+			if (IsEnabled) {
+				write(BUFFER_LIGHTS, lights.data(), lights.size() * sizeof(Light));
+			}
+		}
+
+		// Bin the lights into the clusters of a view and bind the result for the draws that follow.
+		void build(const glm::mat4& view, const glm::mat4& projection, float far) {
+			if (!IsEnabled) {
+				return;
+			}
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			maxDepth = std::max(std::min(MaxDistance, far), FIRST_SLICE_DEPTH * 2.0f);
+			if (maxDepth != boundsDepth || memcmp(&projection, &boundsProjection, sizeof(glm::mat4)) != 0) {
+				updateBounds(projection);
+			}
+
+			viewLights.resize(lights.size());
+			for (unsigned int i = 0; i < lights.size(); i++) {
+				viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].range);
+			}
+
+			jobs::Counter counter(0);
+			jobs::get().parallelFor(GRID_Z, 1, [this](unsigned int begin, unsigned int end) {
+				for (unsigned int slice = begin; slice < end; slice++) {
+					assignSlice(slice);
+				}
+			}, counter, zone);
+			jobs::get().wait(counter);
+
+			// The slices wrote their own index lists, the ranges become offsets into the concatenated one
+			indices.clear();
+			maxClusterLights = 0;
+			fullClusters = 0;
+			for (int slice = 0; slice < GRID_Z; slice++) {
+				uint32_t base = indices.size();
+				for (int cluster = slice * GRID_X * GRID_Y; cluster < (slice + 1) * GRID_X * GRID_Y; cluster++) {
+					ranges[cluster * 2] += base;
+					maxClusterLights = std::max(maxClusterLights, ranges[cluster * 2 + 1]);
+				}
+				indices.insert(indices.end(), slices[slice].indices.begin(), slices[slice].indices.end());
+				fullClusters += slices[slice].fullClusters;
+			}
+			referenceCount = indices.size();
+			write(BUFFER_RANGES, ranges.data(), ranges.size() * sizeof(uint32_t));
+			write(BUFFER_INDICES, indices.data(), indices.size() * sizeof(uint32_t));
+
+			const int UNITS[BUFFER_COUNT] = { LIGHT_TEXTURE_UNIT, RANGE_TEXTURE_UNIT, INDEX_TEXTURE_UNIT };
+			for (int i = 0; i < BUFFER_COUNT; i++) {
+				glActiveTexture(GL_TEXTURE0 + UNITS[i]);
+				glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			}
+			glActiveTexture(GL_TEXTURE0);
+			buildTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		// After build(), for the view being drawn.
+		void setUniforms(const Shader& shader) const {
+			shader.setBool("useClusteredLights", IsEnabled);
+			if (IsEnabled) {
+				shader.setVec3("clusterDepths", glm::vec3(FIRST_SLICE_DEPTH, (GRID_Z - 1) / log(maxDepth / FIRST_SLICE_DEPTH), maxDepth));
+			}
+		}
+
+		void setConstants(Shader& shader) const {
+			shader.use();
+			shader.setInt("clusterLights", LIGHT_TEXTURE_UNIT);
+			shader.setInt("clusterRanges", RANGE_TEXTURE_UNIT);
+			shader.setInt("clusterIndices", INDEX_TEXTURE_UNIT);
+			shader.setVec3("clusterGrid", glm::vec3(GRID_X, GRID_Y, GRID_Z));
+			shader.setBool("useClusteredLights", false);
+		}
+
+		unsigned int getLightCount() const {
+			return lights.size();
+		}
+
+		// Light indices in all clusters of the last view.
+		unsigned int getReferenceCount() const {
+			return referenceCount;
+		}
+
+		unsigned int getMaxClusterLights() const {
+			return maxClusterLights;
+		}
+
+		// Clusters of the last view that had more than MAX_CLUSTER_LIGHTS lights.
+		unsigned int getFullClusters() const {
+			return fullClusters;
+		}
+
+		// CPU ms of the last build().
+		float getBuildTime() const {
+			return buildTime;
+		}
+
+		void release() {
+			if (buffers[0]) {
+				glDeleteTextures(BUFFER_COUNT, textures);
+				glDeleteBuffers(BUFFER_COUNT, buffers);
+			}
+			for (int i = 0; i < BUFFER_COUNT; i++) {
+				buffers[i] = 0;
+				textures[i] = 0;
+				capacities[i] = 0;
+			}
+		}
+
+	private:
+		enum {
+			BUFFER_LIGHTS,
+			BUFFER_RANGES,
+			BUFFER_INDICES,
+			BUFFER_COUNT,
+		};
+
+		// Lights reaching into one depth slice in structure-of-arrays form, padded to a multiple of 4 with lights that hit nothing
+		struct Slice {
+			std::vector<float> x, y, z, radius2;
+			std::vector<uint32_t> ids;
+			std::vector<uint32_t> indices;
+			unsigned int fullClusters;
+		};
+
+		std::vector<Light> lights;
+		std::vector<glm::vec4> viewLights;	// view space position and range
+		std::vector<glm::vec3> bounds;		// view space min and max of every cluster
+		std::vector<uint32_t> ranges;		// first index and count of every cluster
+		std::vector<uint32_t> indices;
+		std::vector<Slice> slices;
+		int zone;
+		float boundsDepth;
+		glm::mat4 boundsProjection;
+		float maxDepth;
+		unsigned int buffers[BUFFER_COUNT];
+		unsigned int textures[BUFFER_COUNT];
+		size_t capacities[BUFFER_COUNT];
+		unsigned int referenceCount;
+		unsigned int maxClusterLights;
+		unsigned int fullClusters;
+		float buildTime;
+
+		// Orphan the old contents, the previous view may still be drawing from them.
+		void write(int buffer, const void* data, size_t bytes) {
+			glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+			capacities[buffer] = std::max(capacities[buffer], bytes);
+			glBufferData(GL_TEXTURE_BUFFER, capacities[buffer], NULL, GL_STREAM_DRAW);
+			if (bytes > 0) {
+				glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+
+		// Tile corners are unprojected at two clip depths and slid along their ray to the slice depths,
+		// which works for perspective and orthographic projections in either depth convention.
+		void updateBounds(const glm::mat4& projection) {
+			glm::mat4 inverse = glm::inverse(projection);
+			std::vector<glm::vec3> first((GRID_X + 1) * (GRID_Y + 1)), second((GRID_X + 1) * (GRID_Y + 1));
+			for (int j = 0; j <= GRID_Y; j++) {
+				for (int i = 0; i <= GRID_X; i++) {
+					float x = -1.0f + 2.0f * i / GRID_X;
+					float y = -1.0f + 2.0f * j / GRID_Y;
+					glm::vec4 a = inverse * glm::vec4(x, y, 0.25f, 1.0f);
+					glm::vec4 b = inverse * glm::vec4(x, y, 0.75f, 1.0f);
+					first[j * (GRID_X + 1) + i] = glm::vec3(a) / a.w;
+					second[j * (GRID_X + 1) + i] = glm::vec3(b) / b.w;
+				}
+			}
+
+			for (int slice = 0; slice < GRID_Z; slice++) {
+				float depths[2] = { (slice == 0) ? 0.0f : getSliceEnd(slice - 1, maxDepth), getSliceEnd(slice, maxDepth) };
+				for (int j = 0; j < GRID_Y; j++) {
+					for (int i = 0; i < GRID_X; i++) {
+						glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+						for (int corner = 0; corner < 4; corner++) {
+							int index = (j + corner / 2) * (GRID_X + 1) + i + corner % 2;
+							const glm::vec3& a = first[index];
+							const glm::vec3& b = second[index];
+							for (float depth : depths) {
+								glm::vec3 point = a + (b - a) * ((depth + a.z) / (a.z - b.z));
+								low = glm::min(low, point);
+								high = glm::max(high, point);
+							}
+						}
+						int cluster = (slice * GRID_Y + j) * GRID_X + i;
+						bounds[cluster * 2] = low;
+						bounds[cluster * 2 + 1] = high;
+					}
+				}
+			}
+			boundsDepth = maxDepth;
+			boundsProjection = projection;
+		}
+
+		// Runs on a worker, only writes its own slice and clusters.
+		void assignSlice(int index) {
+			Slice& slice = slices[index];
+			float sliceNear = (index == 0) ? 0.0f : getSliceEnd(index - 1, maxDepth);
+			float sliceFar = getSliceEnd(index, maxDepth);
+			slice.x.clear();
+			slice.y.clear();
+			slice.z.clear();
+			slice.radius2.clear();
+			slice.ids.clear();
+			slice.indices.clear();
+			slice.fullClusters = 0;
+			for (unsigned int i = 0; i < viewLights.size(); i++) {
+				const glm::vec4& light = viewLights[i];
+				if (-light.z + light.w >= sliceNear && -light.z - light.w <= sliceFar) {
+					slice.x.push_back(light.x);
+					slice.y.push_back(light.y);
+					slice.z.push_back(light.z);
+					slice.radius2.push_back(light.w * light.w);
+					slice.ids.push_back(i);
+				}
+			}
+			while (slice.ids.size() % 4 != 0) {
+				slice.x.push_back(0.0f);
+				slice.y.push_back(0.0f);
+				slice.z.push_back(0.0f);
+				slice.radius2.push_back(-1.0f);
+				slice.ids.push_back(0);
+			}
+
+			for (int cluster = index * GRID_X * GRID_Y; cluster < (index + 1) * GRID_X * GRID_Y; cluster++) {
+				uint32_t first = slice.indices.size();
+				testCluster(slice, bounds[cluster * 2], bounds[cluster * 2 + 1]);
+				if (slice.indices.size() - first > MAX_CLUSTER_LIGHTS) {
+					slice.indices.resize(first + MAX_CLUSTER_LIGHTS);
+					slice.fullClusters++;
+				}
+				ranges[cluster * 2] = first;
+				ranges[cluster * 2 + 1] = slice.indices.size() - first;
+			}
+		}
+
+		// Append the lights whose sphere touches the box, the closest point of the box is within the range.
+		static void testCluster(Slice& slice, const glm::vec3& low, const glm::vec3& high) {
+			unsigned int count = slice.ids.size();
+#ifdef CLUSTERS_SSE
+			__m128 lowX = _mm_set1_ps(low.x), lowY = _mm_set1_ps(low.y), lowZ = _mm_set1_ps(low.z);
+			__m128 highX = _mm_set1_ps(high.x), highY = _mm_set1_ps(high.y), highZ = _mm_set1_ps(high.z);
+			__m128 zero = _mm_setzero_ps();
+			for (unsigned int j = 0; j < count; j += 4) {
+				__m128 x = _mm_loadu_ps(&slice.x[j]), y = _mm_loadu_ps(&slice.y[j]), z = _mm_loadu_ps(&slice.z[j]);
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(lowX, x), _mm_sub_ps(x, highX)), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(lowY, y), _mm_sub_ps(y, highY)), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(lowZ, z), _mm_sub_ps(z, highZ)), zero);
+				__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&slice.radius2[j])));
+				for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+					if (mask & 1) {
+						slice.indices.push_back(slice.ids[j + lane]);
+					}
+				}
+			}
+#else
+			for (unsigned int j = 0; j < count; j++) {
+				glm::vec3 center(slice.x[j], slice.y[j], slice.z[j]);
+				glm::vec3 offset = glm::max(glm::max(low - center, center - high), glm::vec3(0.0f));
+				if (glm::dot(offset, offset) <= slice.radius2[j]) {
+					slice.indices.push_back(slice.ids[j]);
+				}
+			}
+#endif
+		}
+	};
+}
+
+#endif // !CLUSTERS_H
@@ -0,0 +1,341 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Swept spheres against oriented boxes and the seabed (a heightfield, treated as flat under each sphere), with a static uniform grid over the boxes.
+// A body is a compound of spheres, it is moved with move(), which stops at the first contact,
+// slides the rest of the motion along the contact plane and finally pushes the spheres out of anything
+// they still overlap (turning in place or a bobbing box can cause that).
+namespace collision {
+	// Gap kept between a body and what it touches
+	const float SKIN = 1e-3f;
+	const int MAX_SLIDES = 4;
+
+	struct Sphere {
+		glm::vec3 center;
+		float radius;
+	};
+
+	struct OBB {
+		glm::vec3 center;
+		glm::vec3 halfExtents;
+		glm::mat3 axes;	// columns are the local x, y and z axes
+	};
+
+	// A box that may bob up and down: center.y + amplitude * sin(time * frequency + phase).
+	struct Obstacle {
+		OBB box;
+		float bobAmplitude;
+		float bobFrequency;
+		float bobPhase;
+	};
+
+	struct Contact {
+		float time;			// 0 - 1 along the motion
+		glm::vec3 normal;	// pointing away from what was hit
+	};
+
+	glm::vec3 closestPoint(const OBB& box, const glm::vec3& point) {
+		glm::vec3 offset = point - box.center;
+		glm::vec3 result = box.center;
+		for (int i = 0; i < 3; i++) {
+			float distance = glm::clamp(glm::dot(offset, box.axes[i]), -box.halfExtents[i], box.halfExtents[i]);
+			result += box.axes[i] * distance;
+		}
+		return result;
+	}
+
+	// Direction out of the box for a point inside it, through the nearest face.
+	glm::vec3 getExitNormal(const OBB& box, const glm::vec3& point) {
+		glm::vec3 offset = point - box.center;
+		int axis = 0;
+		float least = FLT_MAX;
+		float side = 1.0f;
+		for (int i = 0; i < 3; i++) {
+			float distance = glm::dot(offset, box.axes[i]);
+			float depth = box.halfExtents[i] - fabs(distance);
+			if (depth < least) {
+				least = depth;
+				axis = i;
+				side = (distance < 0.0f) ? -1.0f : 1.0f;
+			}
+		}
+		return box.axes[axis] * side;
+	}
+
+	// Time of impact by conservative advancement: the sphere can always move by its gap to the box without touching it.
+	bool sweepSphereOBB(const Sphere& sphere, const glm::vec3& motion, const OBB& box, Contact& contact) {
+		float length = glm::length(motion);
+		float t = 0.0f;
+		for (int i = 0; i < 32; i++) {
+			glm::vec3 center = sphere.center + motion * t;
+			glm::vec3 closest = closestPoint(box, center);
+			float distance = glm::length(center - closest);
+			float gap = distance - sphere.radius;
+			if (gap <= SKIN) {
+				glm::vec3 normal = (distance > 1e-6f) ? (center - closest) / distance : getExitNormal(box, center);
+				// Already touching and moving away (or along) is no contact
+				if (glm::dot(motion, normal) >= 0.0f) {
+					return false;
+				}
+				contact.time = t;
+				contact.normal = normal;
+				return true;
+			}
+			if (length < 1e-7f) {
+				return false;
+			}
+			t += gap / length;
+			if (t > 1.0f) {
+				return false;
+			}
+		}
+		// Grazing motion that did not converge, stop here to be safe
+		glm::vec3 center = sphere.center + motion * t;
+		glm::vec3 offset = center - closestPoint(box, center);
+		contact.time = t;
+		contact.normal = (glm::length(offset) > 1e-6f) ? glm::normalize(offset) : getExitNormal(box, center);
+		return true;
+	}
+
+	// Against the horizontal plane y = height, from above.
+	bool sweepSpherePlane(const Sphere& sphere, const glm::vec3& motion, float height, Contact& contact) {
+		if (motion.y >= 0.0f) {
+			return false;
+		}
+		float gap = sphere.center.y - sphere.radius - height;
+		float t = (gap <= SKIN) ? 0.0f : gap / -motion.y;
+		if (t > 1.0f) {
+			return false;
+		}
+		contact.time = t;
+		contact.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		return true;
+	}
+
+	class World {
+	public:
+		std::function<float(float, float)> SeabedHeight;	// height of the seabed at (x, z)
+		unsigned int LastCandidates;	// boxes tested by the last move()
+
+		World() : SeabedHeight([](float, float) { return -FLT_MAX; }), LastCandidates(0), cellSize(1.0f), queryStamp(0) {
+			cells[0] = cells[1] = cells[2] = 1;
+		}
+
+		unsigned int size() const {
+			return obstacles.size();
+		}
+
+		// Pose of an obstacle at the given time.
+		OBB getBox(unsigned int i, float time) const {
+			const Obstacle& obstacle = obstacles[i];
+			OBB box = obstacle.box;
+			box.center.y += obstacle.bobAmplitude * sin(time * obstacle.bobFrequency + obstacle.bobPhase);
+			return box;
+		}
+
+		// Bin every obstacle into all cells its bounds (including the bobbing range) touch.
+		void build(const std::vector<Obstacle>& source, float size) {
+			obstacles = source;
+			cellSize = size;
+			bounds.resize(obstacles.size() * 2);
+			glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+			for (unsigned int i = 0; i < obstacles.size(); i++) {
+				const OBB& box = obstacles[i].box;
+				glm::vec3 extent(0.0f);
+				for (int axis = 0; axis < 3; axis++) {
+					extent += glm::abs(box.axes[axis]) * box.halfExtents[axis];
+				}
+				extent.y += fabs(obstacles[i].bobAmplitude);
+				bounds[i * 2] = box.center - extent;
+				bounds[i * 2 + 1] = box.center + extent;
+				low = glm::min(low, bounds[i * 2]);
+				high = glm::max(high, bounds[i * 2 + 1]);
+			}
+			if (obstacles.empty()) {
+				low = high = glm::vec3(0.0f);
+			}
+			origin = low;
+			for (int axis = 0; axis < 3; axis++) {
+				cells[axis] = (int)((high[axis] - low[axis]) / cellSize) + 1;
+			}
+
+			// Two passes: count per cell, then fill (same layout as the boids grid)
+			cellStart.assign(cells[0] * cells[1] * cells[2] + 1, 0);
+			for (int pass = 0; pass < 2; pass++) {
+				if (pass == 1) {
+					for (unsigned int c = 1; c < cellStart.size(); c++) {
+						cellStart[c] += cellStart[c - 1];
+					}
+					items.resize(cellStart.back());
+					cursor.assign(cellStart.begin(), cellStart.end() - 1);
+				}
+				for (unsigned int i = 0; i < obstacles.size(); i++) {
+					int first[3], last[3];
+					getCellRange(bounds[i * 2], bounds[i * 2 + 1], first, last);
+					for (int z = first[2]; z <= last[2]; z++) {
+						for (int y = first[1]; y <= last[1]; y++) {
+							for (int x = first[0]; x <= last[0]; x++) {
+								int cell = (z * cells[1] + y) * cells[0] + x;
+								if (pass == 0) {
+									cellStart[cell + 1]++;
+								} else {
+									items[cursor[cell]++] = i;
+								}
+							}
+						}
+					}
+				}
+			}
+			stamps.assign(obstacles.size(), 0);
+			queryStamp = 0;
+		}
+
+		// Move a body (spheres in body space, turned by yaw degrees around y) from start towards end.
+		glm::vec3 move(const std::vector<Sphere>& shape, float yaw, const glm::vec3& start, const glm::vec3& end, float time) {
+			glm::mat3 rotation = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f)));
+			float reach = 0.0f;
+			for (const Sphere& sphere : shape) {
+				reach = std::max(reach, glm::length(sphere.center) + sphere.radius);
+			}
+			LastCandidates = 0;
+
+			glm::vec3 position = start;
+			glm::vec3 remaining = end - start;
+			for (int slide = 0; slide < MAX_SLIDES && glm::length(remaining) > 1e-6f; slide++) {
+				query(glm::min(position, position + remaining) - glm::vec3(reach), glm::max(position, position + remaining) + glm::vec3(reach));
+				LastCandidates += candidates.size();
+
+				Contact first = { 1.0f, glm::vec3(0.0f) };
+				bool isHit = false;
+				for (const Sphere& part : shape) {
+					Sphere sphere = { position + rotation * part.center, part.radius };
+					Contact contact;
+					for (uint32_t i : candidates) {
+						if (sweepSphereOBB(sphere, remaining, getBox(i, time), contact) && contact.time < first.time) {
+							first = contact;
+							isHit = true;
+						}
+					}
+					glm::vec3 target = sphere.center + remaining;
+					float seabed = std::max(SeabedHeight(sphere.center.x, sphere.center.z), SeabedHeight(target.x, target.z));
+					if (sweepSpherePlane(sphere, remaining, seabed, contact) && contact.time < first.time) {
+						first = contact;
+						isHit = true;
+					}
+				}
+				if (!isHit) {
+					position += remaining;
+					break;
+				}
+
+				// Stop just before the contact, then slide what is left along the contact plane
+				float length = glm::length(remaining);
+				position += remaining * std::max(0.0f, first.time - SKIN / length);
+				remaining *= 1.0f - first.time;
+				remaining -= first.normal * std::min(0.0f, glm::dot(remaining, first.normal));
+			}
+
+			depenetrate(shape, rotation, reach, position, time);
+			return position;
+		}
+
+	private:
+		std::vector<Obstacle> obstacles;
+		std::vector<glm::vec3> bounds;	// min and max per obstacle
+		glm::vec3 origin;
+		float cellSize;
+		int cells[3];
+		std::vector<uint32_t> cellStart;	// items of cell c are [cellStart[c], cellStart[c + 1])
+		std::vector<uint32_t> items;
+		std::vector<uint32_t> cursor;
+
+		// An obstacle in several cells is only returned once per query
+		std::vector<uint32_t> stamps;
+		uint32_t queryStamp;
+		std::vector<uint32_t> candidates;
+
+		void getCellRange(const glm::vec3& low, const glm::vec3& high, int first[3], int last[3]) const {
+			for (int axis = 0; axis < 3; axis++) {
+				first[axis] = glm::clamp((int)floor((low[axis] - origin[axis]) / cellSize), 0, cells[axis] - 1);
+				last[axis] = glm::clamp((int)floor((high[axis] - origin[axis]) / cellSize), 0, cells[axis] - 1);
+			}
+		}
+
+		// Obstacles whose bounds may overlap the box [low, high].
+		void query(const glm::vec3& low, const glm::vec3& high) {
+			candidates.clear();
+			if (obstacles.empty()) {
+				return;
+			}
+			if (++queryStamp == 0) {
+				std::fill(stamps.begin(), stamps.end(), 0);
+				queryStamp = 1;
+			}
+			int first[3], last[3];
+			getCellRange(low, high, first, last);
+			for (int z = first[2]; z <= last[2]; z++) {
+				for (int y = first[1]; y <= last[1]; y++) {
+					for (int x = first[0]; x <= last[0]; x++) {
+						int cell = (z * cells[1] + y) * cells[0] + x;
+						for (uint32_t j = cellStart[cell]; j < cellStart[cell + 1]; j++) {
+							uint32_t i = items[j];
+							if (stamps[i] == queryStamp) {
+								continue;
+							}
+							stamps[i] = queryStamp;
+							const glm::vec3& boxLow = bounds[i * 2];
+							const glm::vec3& boxHigh = bounds[i * 2 + 1];
+							if (boxLow.x <= high.x && boxHigh.x >= low.x && boxLow.y <= high.y && boxHigh.y >= low.y && boxLow.z <= high.z && boxHigh.z >= low.z) {
+								candidates.push_back(i);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// Push the spheres out of every box and the seabed they overlap.
+		void depenetrate(const std::vector<Sphere>& shape, const glm::mat3& rotation, float reach, glm::vec3& position, float time) {
+			query(position - glm::vec3(reach), position + glm::vec3(reach));
+			for (int iteration = 0; iteration < 2; iteration++) {
+				for (const Sphere& part : shape) {
+					for (uint32_t i : candidates) {
+						OBB box = getBox(i, time);
+						glm::vec3 center = position + rotation * part.center;
+						glm::vec3 closest = closestPoint(box, center);
+						glm::vec3 offset = center - closest;
+						float distance = glm::length(offset);
+						if (distance >= part.radius) {
+							continue;
+						}
+						if (distance > 1e-6f) {
+							position += offset / distance * (part.radius - distance + SKIN);
+						} else {
+							// Center inside the box, leave through the nearest face
+							glm::vec3 normal = getExitNormal(box, center);
+							float depth = glm::dot(closestPoint(box, center + normal * 1e3f) - center, normal);
+							position += normal * (depth + part.radius + SKIN);
+						}
+					}
+					glm::vec3 center = position + rotation * part.center;
+					float depth = SeabedHeight(center.x, center.z) - (center.y - part.radius);
+					if (depth > 0.0f) {
+						position.y += depth + SKIN;
+					}
+				}
+			}
+		}
+	};
+}
+
+#endif // !COLLISION_H
@@ -0,0 +1,321 @@
+#ifndef COOKEDTEXTURE_H
+#define COOKEDTEXTURE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Cooked texture: a header, a level table and the full mip chain, already in the GL internal format, so loading is
+// one glCompressedTexImage2D per level with no decoding and no glGenerateMipmap. Tools/texturecooker.cpp writes them
+// next to the source image (sand.jpg => sand.ctex), loadTexture() and loadCubemap() prefer them when they exist.
+// Opaque images become BC1 (4 bits per texel), images with alpha BC3 (8 bits per texel).
+namespace cooked {
+	const char MAGIC[4] = { 'H', 'W', 'T', 'X' };
+	const uint32_t VERSION = 1;
+	const uint32_t MAX_LEVELS = 16;
+	const uint64_t LEVEL_ALIGNMENT = 16;
+	const char* const EXTENSION = ".ctex";
+
+	enum Format {
+		FORMAT_RGBA8,
+		FORMAT_BC1,
+		FORMAT_BC3,
+		FORMAT_COUNT,
+	};
+	const char* const FORMAT_NAMES[FORMAT_COUNT] = { "RGBA8", "BC1", "BC3" };
+	// GL_RGBA8, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	const uint32_t GL_INTERNAL_FORMATS[FORMAT_COUNT] = { 0x8058, 0x83F0, 0x83F3 };
+	const uint32_t BLOCK_BYTES[FORMAT_COUNT] = { 0, 8, 16 };	// 0 => not block compressed
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t glInternalFormat;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t channels;	// of the source image, the runtime picks the wrap mode by it
+	};
+
+	struct Level {
+		uint64_t offset;	// bytes from the start of the file
+		uint64_t size;
+	};
+
+	static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed");
+	static_assert(sizeof(Level) == 16, "Level layout changed");
+
+	// RGBA8 texels, rows top to bottom like stb_image returns them.
+	struct Image {
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	std::string getCookedPath(const std::string& source) {
+		size_t dot = source.find_last_of('.');
+		size_t separator = source.find_last_of("/\\");
+		if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+			return source + EXTENSION;
+		}
+		return source.substr(0, dot) + EXTENSION;
+	}
+
+	uint64_t getLevelSize(Format format, int width, int height) {
+		if (BLOCK_BYTES[format] == 0) {
+			return (uint64_t)width * height * 4;
+		}
+		return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * BLOCK_BYTES[format];
+	}
+
+	// Box filter, odd sizes repeat their last row or column.
+	Image downsample(const Image& source) {
+		Image result;
+		result.width = std::max(1, source.width / 2);
+		result.height = std::max(1, source.height / 2);
+		result.pixels.resize((size_t)result.width * result.height * 4);
+		for (int y = 0; y < result.height; y++) {
+			int y0 = std::min(y * 2, source.height - 1);
+			int y1 = std::min(y * 2 + 1, source.height - 1);
+			for (int x = 0; x < result.width; x++) {
+				int x0 = std::min(x * 2, source.width - 1);
+				int x1 = std::min(x * 2 + 1, source.width - 1);
+				for (int c = 0; c < 4; c++) {
+					int sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] + source.pixels[((size_t)y0 * source.width + x1) * 4 + c]
+						+ source.pixels[((size_t)y1 * source.width + x0) * 4 + c] + source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+					result.pixels[((size_t)y * result.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		return result;
+	}
+
+	uint16_t packRGB565(const float color[3]) {
+		int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+		int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+		int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(uint16_t packed, int color[3]) {
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// Endpoints at the extremes of the block along its principal axis, every texel takes the nearest of the 4 colors.
+	void encodeBC1Block(const unsigned char texels[64], unsigned char block[8]) {
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				mean[c] += texels[i * 4 + c] / 16.0f;
+			}
+		}
+		float covariance[6] = { 0.0f };	// xx, xy, xz, yy, yz, zz
+		for (int i = 0; i < 16; i++) {
+			float d[3] = { texels[i * 4] - mean[0], texels[i * 4 + 1] - mean[1], texels[i * 4 + 2] - mean[2] };
+			covariance[0] += d[0] * d[0];
+			covariance[1] += d[0] * d[1];
+			covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1];
+			covariance[4] += d[1] * d[2];
+			covariance[5] += d[2] * d[2];
+		}
+		// Power iteration
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[3] = {
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+			};
+			float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+			if (length < 1e-6f) {
+				break;
+			}
+			for (int c = 0; c < 3; c++) {
+				axis[c] = next[c] / length;
+			}
+		}
+		float low = 1e30f, high = -1e30f;
+		for (int i = 0; i < 16; i++) {
+			float t = (texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2];
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		float start[3], end[3];
+		for (int c = 0; c < 3; c++) {
+			start[c] = mean[c] + axis[c] * high / axisLength;
+			end[c] = mean[c] + axis[c] * low / axisLength;
+		}
+
+		// c0 > c1 selects the 4 color mode
+		uint16_t color0 = packRGB565(start);
+		uint16_t color1 = packRGB565(end);
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+		uint32_t indices = 0;
+		if (color0 != color1) {
+			int palette[4][3];
+			unpackRGB565(color0, palette[0]);
+			unpackRGB565(color1, palette[1]);
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestError = 0x7FFFFFFF;
+				for (int p = 0; p < 4; p++) {
+					int error = 0;
+					for (int c = 0; c < 3; c++) {
+						int d = texels[i * 4 + c] - palette[p][c];
+						error += d * d;
+					}
+					if (error < bestError) {
+						best = p;
+						bestError = error;
+					}
+				}
+				indices |= (uint32_t)best << (i * 2);
+			}
+		}
+		block[0] = color0 & 0xFF;
+		block[1] = color0 >> 8;
+		block[2] = color1 & 0xFF;
+		block[3] = color1 >> 8;
+		for (int i = 0; i < 4; i++) {
+			block[4 + i] = (indices >> (i * 8)) & 0xFF;
+		}
+	}
+
+	// BC4-style alpha (8 interpolated values between the block's min and max) followed by a BC1 color block.
+	void encodeBC3Block(const unsigned char texels[64], unsigned char block[16]) {
+		int alpha0 = 0, alpha1 = 255;
+		for (int i = 0; i < 16; i++) {
+			alpha0 = std::max(alpha0, (int)texels[i * 4 + 3]);
+			alpha1 = std::min(alpha1, (int)texels[i * 4 + 3]);
+		}
+		uint64_t indices = 0;
+		if (alpha0 != alpha1) {
+			int palette[8] = { alpha0, alpha1 };
+			for (int p = 1; p < 7; p++) {
+				palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+			}
+			for (int i = 0; i < 16; i++) {
+				int best = 0;
+				for (int p = 1; p < 8; p++) {
+					if (std::abs(texels[i * 4 + 3] - palette[p]) < std::abs(texels[i * 4 + 3] - palette[best])) {
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+		block[0] = (unsigned char)alpha0;
+		block[1] = (unsigned char)alpha1;
+		for (int i = 0; i < 6; i++) {
+			block[2 + i] = (indices >> (i * 8)) & 0xFF;
+		}
+		encodeBC1Block(texels, block + 8);
+	}
+
+	// One mip level in the given format, partial edge blocks repeat the last texel.
+	std::vector<unsigned char> encode(const Image& image, Format format) {
+		if (BLOCK_BYTES[format] == 0) {
+			return image.pixels;
+		}
+		std::vector<unsigned char> result(getLevelSize(format, image.width, image.height));
+		int blocksWide = (image.width + 3) / 4;
+		unsigned char texels[64];
+		for (int by = 0; by < (image.height + 3) / 4; by++) {
+			for (int bx = 0; bx < blocksWide; bx++) {
+				for (int i = 0; i < 16; i++) {
+					int x = std::min(bx * 4 + i % 4, image.width - 1);
+					int y = std::min(by * 4 + i / 4, image.height - 1);
+					memcpy(texels + i * 4, &image.pixels[((size_t)y * image.width + x) * 4], 4);
+				}
+				unsigned char* block = &result[((size_t)by * blocksWide + bx) * BLOCK_BYTES[format]];
+				if (format == FORMAT_BC1) {
+					encodeBC1Block(texels, block);
+				} else {
+					encodeBC3Block(texels, block);
+				}
+			}
+		}
+		return result;
+	}
+
+	// Builds the mip chain of image down to 1 x 1 and writes it.
+	bool write(const std::string& path, const Image& image, Format format, int channels) {
+		std::vector<std::vector<unsigned char>> levels;
+		levels.push_back(encode(image, format));
+		Image level = image;
+		while ((level.width > 1 || level.height > 1) && levels.size() < MAX_LEVELS) {
+			level = downsample(level);
+			levels.push_back(encode(level, format));
+		}
+
+		FileHeader header;
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.format = format;
+		header.glInternalFormat = GL_INTERNAL_FORMATS[format];
+		header.width = image.width;
+		header.height = image.height;
+		header.levelCount = (uint32_t)levels.size();
+		header.channels = channels;
+		std::vector<Level> table(levels.size());
+		uint64_t offset = sizeof(FileHeader) + table.size() * sizeof(Level);
+		for (size_t i = 0; i < levels.size(); i++) {
+			offset = (offset + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+			table[i].offset = offset;
+			table[i].size = levels[i].size();
+			offset += levels[i].size();
+		}
+
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		bool isWritten = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(table.data(), sizeof(Level), table.size(), file) == table.size();
+		const char padding[LEVEL_ALIGNMENT] = { 0 };
+		for (size_t i = 0; i < levels.size() && isWritten; i++) {
+			size_t position = (size_t)std::ftell(file);
+			isWritten = std::fwrite(padding, 1, table[i].offset - position, file) == table[i].offset - position
+				&& std::fwrite(levels[i].data(), 1, levels[i].size(), file) == levels[i].size();
+		}
+		return std::fclose(file) == 0 && isWritten;
+	}
+
+	// Returns the header if data holds a complete cooked texture, the level table follows it.
+	const FileHeader* validate(const char* data, uint64_t size) {
+		const FileHeader* header = (const FileHeader*)data;
+		if (!data || size < sizeof(FileHeader) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+			|| header->format >= FORMAT_COUNT || header->glInternalFormat != GL_INTERNAL_FORMATS[header->format]
+			|| header->width == 0 || header->height == 0 || header->levelCount == 0 || header->levelCount > MAX_LEVELS
+			|| size < sizeof(FileHeader) + header->levelCount * sizeof(Level)) {
+			return NULL;
+		}
+		const Level* levels = (const Level*)(data + sizeof(FileHeader));
+		for (uint32_t i = 0; i < header->levelCount; i++) {
+			int width = std::max(1, (int)(header->width >> i));
+			int height = std::max(1, (int)(header->height >> i));
+			if (levels[i].offset > size || levels[i].size > size - levels[i].offset
+				|| levels[i].size != getLevelSize((Format)header->format, width, height)) {
+				return NULL;
+			}
+		}
+		return header;
+	}
+}
+
+#endif // !COOKEDTEXTURE_H
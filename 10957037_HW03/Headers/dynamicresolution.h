@@ -0,0 +1,88 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Adjusts the resolution of the main view and of the ortho monitors to keep the frame time inside a budget.
+// Over budget the ortho monitors are lowered first, under budget the main view is raised first.
+// Only the views that are drawn this frame are scaled, a hidden view keeps its scale.
+class DynamicResolution {
+public:
+	bool Enabled;
+	float TargetFrameTime;	// ms
+	float MinScale;
+	float MaxScale;
+	float MainScale;
+	float OrthoScale;
+	float AverageFrameTime;	// ms
+
+	DynamicResolution() : Enabled(false), TargetFrameTime(16.6f), MinScale(0.5f), MaxScale(1.0f),
+		MainScale(1.0f), OrthoScale(1.0f), AverageFrameTime(0.0f), overFrames(0), underFrames(0), cooldown(0) {}
+
+	// Feed the last frame time (ms) and which views are on screen, call once per frame.
+	void update(float frameTime, bool isMainVisible, bool isOrthoVisible) {
+		AverageFrameTime = (AverageFrameTime == 0.0f) ? frameTime : glm::mix(AverageFrameTime, frameTime, SMOOTHING);
+		if (!Enabled) {
+			MainScale = MaxScale;
+			OrthoScale = MaxScale;
+			overFrames = underFrames = cooldown = 0;
+			return;
+		}
+
+		// Give the new resolution a few frames to show up in the average.
+		if (cooldown > 0) {
+			cooldown--;
+			return;
+		}
+
+		// Hysteresis: only react after the average stays outside the dead band for a while.
+		if (AverageFrameTime > TargetFrameTime * (1.0f + UPPER_MARGIN)) {
+			overFrames++;
+			underFrames = 0;
+		} else if (AverageFrameTime < TargetFrameTime * (1.0f - LOWER_MARGIN)) {
+			underFrames++;
+			overFrames = 0;
+		} else {
+			overFrames = underFrames = 0;
+		}
+
+		if (overFrames >= DECREASE_FRAMES) {
+			// Scale area roughly with the ratio of budget to frame time.
+			float step = glm::clamp(sqrt(TargetFrameTime / AverageFrameTime), 1.0f - MAX_STEP, 1.0f - MIN_STEP);
+			if (isOrthoVisible && OrthoScale > MinScale) {
+				OrthoScale = glm::max(OrthoScale * step, MinScale);
+			} else if (isMainVisible) {
+				MainScale = glm::max(MainScale * step, MinScale);
+			}
+			overFrames = 0;
+			cooldown = COOLDOWN_FRAMES;
+		} else if (underFrames >= INCREASE_FRAMES) {
+			float step = 1.0f + MIN_STEP;
+			if (isMainVisible && MainScale < MaxScale) {
+				MainScale = glm::min(MainScale * step, MaxScale);
+			} else if (isOrthoVisible) {
+				OrthoScale = glm::min(OrthoScale * step, MaxScale);
+			}
+			underFrames = 0;
+			cooldown = COOLDOWN_FRAMES;
+		}
+	}
+
+private:
+	const float SMOOTHING = 0.1f;
+	const float UPPER_MARGIN = 0.05f;
+	const float LOWER_MARGIN = 0.15f;
+	const float MIN_STEP = 0.05f;
+	const float MAX_STEP = 0.25f;
+	const int DECREASE_FRAMES = 10;
+	const int INCREASE_FRAMES = 60;
+	const int COOLDOWN_FRAMES = 15;
+
+	int overFrames;
+	int underFrames;
+	int cooldown;
+};
+
+#endif // !DYNAMICRESOLUTION_H
@@ -0,0 +1,43 @@
+#ifndef FIXEDTIMESTEP_H
+#define FIXEDTIMESTEP_H
+
+#include <glm/glm.hpp>
+
+// Accumulates render frame time and hands it out as whole simulation steps of a fixed length.
+// Whatever is left over (getAlpha) is used to interpolate between the last two simulated states.
+class FixedTimestep {
+public:
+	float Step;		// seconds
+	int MaxSteps;	// per frame, the rest is dropped so a long hitch cannot snowball
+	int LastSteps;
+
+	FixedTimestep(float rate = 120.0f, int maxSteps = 8) : Step(1.0f / rate), MaxSteps(maxSteps), LastSteps(0), accumulator(0.0) {}
+
+	// Add the frame time and return how many steps to simulate this frame.
+	int advance(float frameTime) {
+		accumulator += frameTime;
+		int steps = (int)(accumulator / Step);
+		if (steps > MaxSteps) {
+			steps = MaxSteps;
+			accumulator = 0.0;
+		} else {
+			accumulator -= steps * (double)Step;
+		}
+		LastSteps = steps;
+		return steps;
+	}
+
+	// How far (0-1) the render time is between the previous and the current state.
+	float getAlpha() const {
+		return glm::clamp((float)(accumulator / Step), 0.0f, 1.0f);
+	}
+
+	float getRate() const {
+		return 1.0f / Step;
+	}
+
+private:
+	double accumulator;
+};
+
+#endif // !FIXEDTIMESTEP_H
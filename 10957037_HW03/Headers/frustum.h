@@ -0,0 +1,47 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+namespace frustum {
+	// Six planes (ax + by + cz + d >= 0 is inside) of a projection * view matrix, works for perspective and orthogonal.
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	// isZeroToOne for a [0, 1] clip depth range (reversed depth), the near and far planes swap places then.
+	// A far plane at infinity has no normal and is replaced by a plane everything is inside of.
+	Frustum extract(const glm::mat4& viewProjection, bool isZeroToOne = false) {
+		glm::mat4 m = glm::transpose(viewProjection);
+		Frustum result;
+		result.planes[0] = m[3] + m[0];	// left
+		result.planes[1] = m[3] - m[0];	// right
+		result.planes[2] = m[3] + m[1];	// bottom
+		result.planes[3] = m[3] - m[1];	// top
+		result.planes[4] = isZeroToOne ? m[2] : m[3] + m[2];	// near (far when reversed)
+		result.planes[5] = m[3] - m[2];	// far (near when reversed)
+		for (int i = 0; i < 6; i++) {
+			float length = glm::length(glm::vec3(result.planes[i]));
+			result.planes[i] = (length > 1e-6f) ? result.planes[i] / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		return result;
+	}
+
+	bool intersectsSphere(const Frustum& frustum, const glm::vec3& center, float radius) {
+		for (int i = 0; i < 6; i++) {
+			if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Bounding sphere of a model space sphere under a model matrix (radius scaled by the largest axis).
+	void transformSphere(const glm::mat4& model, const glm::vec3& center, float radius, glm::vec3& worldCenter, float& worldRadius) {
+		worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+		float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		worldRadius = radius * scale;
+	}
+}
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,391 @@
+#ifndef GPUBOIDS_H
+#define GPUBOIDS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/boids.h"
+#include "../Headers/logging.h"
+#include "../Headers/profiler.h"
+#include "../Headers/shader.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The boids of boids::Flock simulated with fragment shader passes on float textures (OpenGL 3.3 has no compute shaders).
+// Every update: sort (cell, fish) keys with a bitonic sort, count the fish per cell with additive blending,
+// prefix sum the counts into the end of every cell's run, copy the fish into sorted order and steer.
+// Positions and velocities stay on the GPU, the fish are drawn instanced straight from them.
+namespace boids {
+	// Texels per row of the fish state textures
+	const int STATE_WIDTH = 256;
+	const int CELL_WIDTH = 512;
+	const unsigned int MAX_CELLS = 512 * 512;
+
+	class GpuFlock {
+	public:
+		Params Settings;
+
+		GpuFlock() : count(0), capacity(0), stateHeight(0), current(0), emptyVAO(0), cellHeight(0), cellSize(1.0f), cells(1),
+			keyShader(NULL), sortShader(NULL), countShader(NULL), scanShader(NULL), reorderShader(NULL), steerShader(NULL) {
+			for (int i = 0; i < 2; i++) {
+				positions[i] = velocities[i] = keys[i] = cellSums[i] = 0;
+				stateFBO[i] = keyFBO[i] = cellFBO[i] = 0;
+			}
+			sortedPositions = sortedVelocities = cellCounts = 0;
+			sortedFBO = countFBO = 0;
+		}
+
+		void init() {
+			glGenVertexArrays(1, &emptyVAO);
+			keyShader = new Shader("Shaders/screen.vs", "Shaders/boids_key.fs");
+			sortShader = new Shader("Shaders/screen.vs", "Shaders/boids_sort.fs");
+			countShader = new Shader("Shaders/boids_count.vs", "Shaders/boids_count.fs");
+			scanShader = new Shader("Shaders/screen.vs", "Shaders/boids_scan.fs");
+			reorderShader = new Shader("Shaders/screen.vs", "Shaders/boids_reorder.fs");
+			steerShader = new Shader("Shaders/screen.vs", "Shaders/boids_steer.fs");
+
+			reorderShader->use();
+			reorderShader->setInt("keys", 0);
+			reorderShader->setInt("positions", 1);
+			reorderShader->setInt("velocities", 2);
+			steerShader->use();
+			steerShader->setInt("positions", 0);
+			steerShader->setInt("velocities", 1);
+			steerShader->setInt("sortedPositions", 2);
+			steerShader->setInt("sortedVelocities", 3);
+			steerShader->setInt("cellEnds", 4);
+		}
+
+		void release() {
+			destroy();
+			glDeleteVertexArrays(1, &emptyVAO);
+			for (Shader** shader : { &keyShader, &sortShader, &countShader, &scanShader, &reorderShader, &steerShader }) {
+				delete *shader;
+				*shader = NULL;
+			}
+		}
+
+		unsigned int size() const {
+			return count;
+		}
+
+		// Textures the instanced fish draw reads, one fish per texel in rows of STATE_WIDTH.
+		unsigned int getPositionTexture() const {
+			return positions[current];
+		}
+
+		unsigned int getVelocityTexture() const {
+			return velocities[current];
+		}
+
+		// Positions before the last update, the draw interpolates from them to the current ones.
+		unsigned int getPreviousPositionTexture() const {
+			return positions[1 - current];
+		}
+
+		// Replace the GPU fish with the ones of a CPU flock.
+		void upload(const Flock& flock) {
+			count = flock.size();
+			unsigned int needed = 1;
+			while (needed < std::max(count, (unsigned int)STATE_WIDTH)) {
+				needed <<= 1;
+			}
+			if (needed != capacity) {
+				capacity = needed;
+				create();
+			}
+
+			std::vector<glm::vec4> position(capacity, glm::vec4(0.0f)), velocity(capacity, glm::vec4(0.0f));
+			for (unsigned int i = 0; i < count; i++) {
+				position[i] = glm::vec4(flock.getPosition(i), 1.0f);
+				velocity[i] = glm::vec4(flock.getVelocity(i), 0.0f);
+			}
+			// Into both states, so there is nothing stale to interpolate from before the first update
+			for (int i = 0; i < 2; i++) {
+				glBindTexture(GL_TEXTURE_2D, positions[i]);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, STATE_WIDTH, stateHeight, GL_RGBA, GL_FLOAT, position.data());
+			}
+			glBindTexture(GL_TEXTURE_2D, velocities[current]);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, STATE_WIDTH, stateHeight, GL_RGBA, GL_FLOAT, velocity.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		// Read the fish back into a CPU flock of the same size (switching backends and validation only).
+		void download(Flock& flock) {
+			std::vector<glm::vec4> position(capacity), velocity(capacity);
+			glBindFramebuffer(GL_FRAMEBUFFER, stateFBO[current]);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			glReadPixels(0, 0, STATE_WIDTH, stateHeight, GL_RGBA, GL_FLOAT, position.data());
+			glReadBuffer(GL_COLOR_ATTACHMENT1);
+			glReadPixels(0, 0, STATE_WIDTH, stateHeight, GL_RGBA, GL_FLOAT, velocity.data());
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			flock.resize(count);
+			for (unsigned int i = 0; i < count; i++) {
+				flock.setFish(i, glm::vec3(position[i]), glm::vec3(velocity[i]));
+			}
+		}
+
+		// One step, leaves blending on, depth testing on and the default framebuffer bound like the rest of the frame expects.
+		void update(float deltaTime, const glm::vec3& obstacle) {
+			if (count == 0) {
+				return;
+			}
+			updateGrid();
+			glDisable(GL_DEPTH_TEST);
+			glDisable(GL_BLEND);
+			glBindVertexArray(emptyVAO);
+			glViewport(0, 0, STATE_WIDTH, stateHeight);
+
+			// Sort keys
+			keyShader->use();
+			setGridUniforms(*keyShader);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, positions[current]);
+			drawPass(keyFBO[0]);
+
+			int key = 0;
+			sortShader->use();
+			sortShader->setInt("stateWidth", STATE_WIDTH);
+			for (unsigned int blockSize = 2; blockSize <= capacity; blockSize <<= 1) {
+				sortShader->setInt("blockSize", blockSize);
+				for (unsigned int distance = blockSize >> 1; distance > 0; distance >>= 1) {
+					sortShader->setInt("compareDistance", distance);
+					glBindTexture(GL_TEXTURE_2D, keys[key]);
+					drawPass(keyFBO[1 - key]);
+					key = 1 - key;
+				}
+			}
+
+			// Fish per cell, then the inclusive prefix sum of the counts
+			glViewport(0, 0, CELL_WIDTH, cellHeight);
+			glBindFramebuffer(GL_FRAMEBUFFER, countFBO);
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE, GL_ONE);
+			countShader->use();
+			countShader->setInt("stateWidth", STATE_WIDTH);
+			countShader->setInt("cellWidth", CELL_WIDTH);
+			countShader->setVec2("cellTextureSize", glm::vec2(CELL_WIDTH, cellHeight));
+			glBindTexture(GL_TEXTURE_2D, keys[key]);
+			profiler::countDrawCall(0);
+			glDrawArrays(GL_POINTS, 0, count);
+			glDisable(GL_BLEND);
+
+			int sum = 0;
+			scanShader->use();
+			scanShader->setInt("cellWidth", CELL_WIDTH);
+			glBindTexture(GL_TEXTURE_2D, cellCounts);
+			for (unsigned int offset = 1; offset < cells; offset <<= 1) {
+				scanShader->setInt("offset", offset);
+				drawPass(cellFBO[sum]);
+				glBindTexture(GL_TEXTURE_2D, cellSums[sum]);
+				sum = 1 - sum;
+			}
+			unsigned int cellEnds = (cells > 1) ? cellSums[1 - sum] : cellCounts;
+
+			// Fish in sorted order
+			glViewport(0, 0, STATE_WIDTH, stateHeight);
+			reorderShader->use();
+			reorderShader->setInt("stateWidth", STATE_WIDTH);
+			reorderShader->setInt("count", count);
+			bindTextures({ keys[key], positions[current], velocities[current] });
+			drawPass(sortedFBO);
+
+			// Steer into the other state textures
+			steerShader->use();
+			setGridUniforms(*steerShader);
+			steerShader->setInt("cellWidth", CELL_WIDTH);
+			steerShader->setFloat("deltaTime", deltaTime);
+			steerShader->setVec3("obstacle", obstacle);
+			steerShader->setFloat("neighborRadius", Settings.neighborRadius);
+			steerShader->setFloat("separationRadius", Settings.separationRadius);
+			steerShader->setFloat("separationWeight", Settings.separationWeight);
+			steerShader->setFloat("alignmentWeight", Settings.alignmentWeight);
+			steerShader->setFloat("cohesionWeight", Settings.cohesionWeight);
+			steerShader->setFloat("avoidRadius", Settings.avoidRadius);
+			steerShader->setFloat("avoidWeight", Settings.avoidWeight);
+			steerShader->setFloat("boundsWeight", Settings.boundsWeight);
+			steerShader->setFloat("minSpeed", Settings.minSpeed);
+			steerShader->setFloat("maxSpeed", Settings.maxSpeed);
+			steerShader->setVec3("boundsMin", Settings.boundsMin);
+			steerShader->setVec3("boundsMax", Settings.boundsMax);
+			bindTextures({ positions[current], velocities[current], sortedPositions, sortedVelocities, cellEnds });
+			drawPass(stateFBO[1 - current]);
+			current = 1 - current;
+
+			bindTextures({ 0, 0, 0, 0, 0 });
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glEnable(GL_DEPTH_TEST);
+		}
+
+	private:
+		unsigned int count, capacity, stateHeight;
+		int current;
+		unsigned int emptyVAO;
+
+		// [current] is the state, the other one is written by the steer pass
+		unsigned int positions[2], velocities[2], stateFBO[2];
+		unsigned int keys[2], keyFBO[2];
+		unsigned int sortedPositions, sortedVelocities, sortedFBO;
+		unsigned int cellCounts, countFBO;
+		unsigned int cellSums[2], cellFBO[2];
+		int cellHeight;
+
+		// Grid over the bounds, fish outside fall into the border cells
+		glm::vec3 gridOrigin;
+		glm::ivec3 gridCells;
+		float cellSize;
+		unsigned int cells;
+
+		Shader* keyShader;
+		Shader* sortShader;
+		Shader* countShader;
+		Shader* scanShader;
+		Shader* reorderShader;
+		Shader* steerShader;
+
+		unsigned int createTexture(GLenum format, int width, int height) {
+			unsigned int texture;
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, (format == GL_R32F) ? GL_RED : (format == GL_RG32F) ? GL_RG : GL_RGBA, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			return texture;
+		}
+
+		unsigned int createFramebuffer(unsigned int first, unsigned int second = 0) {
+			unsigned int fbo;
+			glGenFramebuffers(1, &fbo);
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, first, 0);
+			GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			if (second) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, second, 0);
+			}
+			glDrawBuffers(second ? 2 : 1, buffers);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				logging::loggingMessage(logging::LogType::ERROR, "GPU flock framebuffer is not complete.");
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return fbo;
+		}
+
+		// Textures for capacity fish (a power of two, the bitonic sort needs it) and for the largest grid.
+		void create() {
+			destroy();
+			stateHeight = capacity / STATE_WIDTH;
+			for (int i = 0; i < 2; i++) {
+				positions[i] = createTexture(GL_RGBA32F, STATE_WIDTH, stateHeight);
+				velocities[i] = createTexture(GL_RGBA32F, STATE_WIDTH, stateHeight);
+				stateFBO[i] = createFramebuffer(positions[i], velocities[i]);
+				keys[i] = createTexture(GL_RG32F, STATE_WIDTH, stateHeight);
+				keyFBO[i] = createFramebuffer(keys[i]);
+			}
+			sortedPositions = createTexture(GL_RGBA32F, STATE_WIDTH, stateHeight);
+			sortedVelocities = createTexture(GL_RGBA32F, STATE_WIDTH, stateHeight);
+			sortedFBO = createFramebuffer(sortedPositions, sortedVelocities);
+
+			cellHeight = MAX_CELLS / CELL_WIDTH;
+			cellCounts = createTexture(GL_R32F, CELL_WIDTH, cellHeight);
+			countFBO = createFramebuffer(cellCounts);
+			for (int i = 0; i < 2; i++) {
+				cellSums[i] = createTexture(GL_R32F, CELL_WIDTH, cellHeight);
+				cellFBO[i] = createFramebuffer(cellSums[i]);
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+			current = 0;
+		}
+
+		void destroy() {
+			std::vector<unsigned int> textures = { positions[0], positions[1], velocities[0], velocities[1], keys[0], keys[1],
+				sortedPositions, sortedVelocities, cellCounts, cellSums[0], cellSums[1] };
+			std::vector<unsigned int> framebuffers = { stateFBO[0], stateFBO[1], keyFBO[0], keyFBO[1], sortedFBO, countFBO, cellFBO[0], cellFBO[1] };
+			glDeleteTextures(textures.size(), textures.data());
+			glDeleteFramebuffers(framebuffers.size(), framebuffers.data());
+			for (int i = 0; i < 2; i++) {
+				positions[i] = velocities[i] = keys[i] = cellSums[i] = 0;
+				stateFBO[i] = keyFBO[i] = cellFBO[i] = 0;
+			}
+			sortedPositions = sortedVelocities = cellCounts = 0;
+			sortedFBO = countFBO = 0;
+		}
+
+		// Cells at least the neighbor radius wide over the bounds plus a margin for fish that overshoot.
+		void updateGrid() {
+			glm::vec3 margin(Settings.neighborRadius * 2.0f);
+			gridOrigin = Settings.boundsMin - margin;
+			glm::vec3 extent = Settings.boundsMax + margin - gridOrigin;
+			cellSize = Settings.neighborRadius;
+			while (true) {
+				gridCells = glm::ivec3((int)(extent.x / cellSize) + 1, (int)(extent.y / cellSize) + 1, (int)(extent.z / cellSize) + 1);
+				cells = gridCells.x * gridCells.y * gridCells.z;
+				if (cells <= MAX_CELLS) {
+					break;
+				}
+				cellSize *= 2.0f;
+			}
+		}
+
+		void setGridUniforms(Shader& shader) {
+			shader.setInt("stateWidth", STATE_WIDTH);
+			shader.setInt("count", count);
+			shader.setVec3("gridOrigin", gridOrigin);
+			shader.setVec3("gridCells", glm::vec3(gridCells.x, gridCells.y, gridCells.z));
+			shader.setFloat("cellSize", cellSize);
+		}
+
+		void bindTextures(std::initializer_list<unsigned int> textures) {
+			int unit = 0;
+			for (unsigned int texture : textures) {
+				glActiveTexture(GL_TEXTURE0 + unit++);
+				glBindTexture(GL_TEXTURE_2D, texture);
+			}
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		// Fullscreen triangle into the framebuffer, the viewport is set by the caller.
+		void drawPass(unsigned int framebuffer) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			profiler::countDrawCall(1);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+	};
+
+	// Run the same fish on both backends for a few steps and log the largest position difference.
+	float validateGpu(unsigned int count, int steps, const Params& settings) {
+		Flock cpu;
+		cpu.Settings = settings;
+		cpu.resize(count);
+		GpuFlock gpu;
+		gpu.Settings = settings;
+		gpu.init();
+		gpu.upload(cpu);
+
+		float worst = 0.0f;
+		for (int step = 0; step < steps; step++) {
+			cpu.update(1.0f / 60.0f, glm::vec3(0.0f));
+			gpu.update(1.0f / 60.0f, glm::vec3(0.0f));
+		}
+		// Both backends keep every fish in its upload slot
+		Flock result;
+		gpu.download(result);
+		for (unsigned int i = 0; i < count; i++) {
+			worst = std::max(worst, glm::length(result.getPosition(i) - cpu.getPosition(i)));
+		}
+		gpu.release();
+
+		logging::loggingMessage((worst < 1e-3f) ? logging::LogType::INFO : logging::LogType::ERROR,
+			"GPU flock validation: " + std::to_string(count) + " fish, " + std::to_string(steps) + " steps, max position difference " + std::to_string(worst));
+		return worst;
+	}
+}
+
+#endif // !GPUBOIDS_H
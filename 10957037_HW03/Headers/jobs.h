@@ -0,0 +1,211 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "../Headers/profiler.h"
+#include "../Headers/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with one deque per thread (the main thread has queue 0, other threads that
+// push jobs attach() to queues of their own). A thread runs the newest job of its own deque and steals the
+// oldest job of another one when it is empty. Threads that are not workers only steal from the workers,
+// so the main thread and e.g. the simulation thread never wait on each other's jobs.
+// Every job decrements a counter when it is done, wait() keeps running jobs until the counter reaches zero.
+namespace jobs {
+	typedef std::atomic<int> Counter;
+
+	struct Job {
+		std::function<void()> work;
+		Counter* counter;
+		int zone;	// profiler zone the job time is added to, -1 for none
+	};
+
+	class WorkQueue {
+	public:
+		void push(Job job) {
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.push_back(std::move(job));
+		}
+
+		// Owner side: newest job first, it is most likely still in cache.
+		bool pop(Job& job) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (jobs.empty()) {
+				return false;
+			}
+			job = std::move(jobs.back());
+			jobs.pop_back();
+			return true;
+		}
+
+		// Thief side: oldest job first, usually the biggest remaining range.
+		bool steal(Job& job) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (jobs.empty()) {
+				return false;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	class JobSystem {
+	public:
+		JobSystem() : firstWorker(1), running(false), pending(0) {}
+
+		// Start the workers, the calling thread becomes thread 0.
+		// externalCount more queues are kept for other threads, see attach().
+		void init(unsigned int workerCount, unsigned int externalCount = 0) {
+			getThreadIndex() = 0;
+			firstWorker = 1 + externalCount;
+			for (unsigned int i = 0; i < firstWorker + workerCount; i++) {
+				queues.push_back(new WorkQueue());
+			}
+			running = true;
+			for (unsigned int i = firstWorker; i < firstWorker + workerCount; i++) {
+				workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+			}
+		}
+
+		// Call on a thread that is not a worker before it pushes jobs, index 1 to the externalCount of init().
+		void attach(unsigned int index) {
+			getThreadIndex() = index;
+		}
+
+		void release() {
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				running = false;
+			}
+			wakeup.notify_all();
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+			workers.clear();
+			for (WorkQueue* queue : queues) {
+				delete queue;
+			}
+			queues.clear();
+		}
+
+		unsigned int getWorkerCount() const {
+			return workers.size();
+		}
+
+		// Queue one job, counter is incremented now and decremented when the job is done.
+		void run(std::function<void()> work, Counter& counter, int zone = -1) {
+			push({ std::move(work), &counter, zone });
+			notify();
+		}
+
+		// Split [0, count) into ranges of at most grain items, body(begin, end) runs once per range.
+		void parallelFor(unsigned int count, unsigned int grain, std::function<void(unsigned int, unsigned int)> body, Counter& counter, int zone = -1) {
+			grain = std::max(1u, grain);
+			for (unsigned int begin = 0; begin < count; begin += grain) {
+				unsigned int end = std::min(count, begin + grain);
+				push({ [body, begin, end]() { body(begin, end); }, &counter, zone });
+			}
+			notify();
+		}
+
+		// Help with queued jobs until the counter reaches zero.
+		void wait(Counter& counter) {
+			unsigned int self = getThreadIndex();
+			while (counter.load(std::memory_order_acquire) > 0) {
+				if (!runOne(self)) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		std::vector<std::thread> workers;
+		std::vector<WorkQueue*> queues;
+		unsigned int firstWorker;	// queues before it belong to the main and the attached threads
+		std::atomic<bool> running;
+		std::atomic<int> pending;
+		std::mutex sleepLock;
+		std::condition_variable wakeup;
+
+		unsigned int& getThreadIndex() {
+			thread_local unsigned int index = 0;
+			return index;
+		}
+
+		void push(Job job) {
+			job.counter->fetch_add(1, std::memory_order_relaxed);
+			pending.fetch_add(1, std::memory_order_release);
+			queues[getThreadIndex()]->push(std::move(job));
+		}
+
+		void notify() {
+			// Taking the lock orders the push before a worker's check, so no wakeup is lost.
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+			}
+			wakeup.notify_all();
+		}
+
+		bool runOne(unsigned int self) {
+			Job job;
+			bool found = queues[self]->pop(job);
+			for (unsigned int i = 1; !found && i < queues.size(); i++) {
+				unsigned int victim = (self + i) % queues.size();
+				if (self >= firstWorker || victim >= firstWorker) {
+					found = queues[victim]->steal(job);
+				}
+			}
+			if (!found) {
+				return false;
+			}
+			pending.fetch_sub(1, std::memory_order_relaxed);
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			if (job.zone >= 0) {
+				trace::Scope scope(profiler::get().Zones[job.zone].name);
+				job.work();
+			} else {
+				job.work();
+			}
+			std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+			if (job.zone >= 0) {
+				profiler::get().addJobTime(job.zone, elapsed.count());
+			}
+			job.counter->fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+
+		void workerLoop(unsigned int index) {
+			getThreadIndex() = index;
+			trace::get().setThreadName("Worker " + std::to_string(index));
+			while (running) {
+				if (runOne(index)) {
+					continue;
+				}
+				std::unique_lock<std::mutex> guard(sleepLock);
+				wakeup.wait_for(guard, std::chrono::milliseconds(2), [this]() { return !running || pending.load(std::memory_order_acquire) > 0; });
+			}
+		}
+	};
+
+	// The single job system of the program.
+	JobSystem& get() {
+		static JobSystem instance;
+		return instance;
+	}
+}
+
+#endif // !JOBS_H
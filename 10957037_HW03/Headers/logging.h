@@ -1,9 +1,28 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <ctime>
+#include <cstdio>
+#include <mutex>
 #include <string>
-#include <iostream>
+#include <thread>
+
+// Messages below this level are dropped, e.g. define LOGGING_MIN_LEVEL as 1 to drop DEBUG.
+// loggingMessage() checks the level at runtime (its string is already built),
+// LOGGING_MESSAGE() checks it before the message expression, so a filtered call compiles to nothing.
+#ifndef LOGGING_MIN_LEVEL
+#define LOGGING_MIN_LEVEL 0
+#endif
+
+#define LOGGING_MESSAGE(type, message) \
+	do { \
+		if ((type) >= LOGGING_MIN_LEVEL) { \
+			logging::loggingMessage((type), (message)); \
+		} \
+	} while (0)
 
 namespace logging {
 	// This is for the argument "type" which in the loggingMessage().
@@ -14,41 +33,165 @@ namespace logging {
 		ERROR,
 	};
 
-	// Generate timestamp for logging
-	std::string getTimestamp(void) {
-		time_t timer = std::time(0);
-		std::tm bt{};
-		localtime_s(&bt, &timer);
+	// Slots of the message ring, when it is full new messages are dropped instead of waiting.
+	const unsigned int QUEUE_SIZE = 1024;
+
+	struct Message {
+		std::atomic<unsigned int> sequence;
+		int type;
+		time_t time;
+		std::string text;
+	};
+
+	// Bounded lock-free multi-producer / single-consumer ring (per-slot sequence numbers).
+	// Any thread may push, a background thread formats and writes the messages,
+	// so logging never waits on the console.
+	class Logger {
+	public:
+		Logger() : head(0), tail(0), dropped(0), running(true), cachedSecond(0) {
+			for (unsigned int i = 0; i < QUEUE_SIZE; i++) {
+				queue[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			writer = std::thread(&Logger::run, this);
+		}
+
+		~Logger() {
+			running = false;
+			wakeup.notify_one();
+			writer.join();
+		}
+
+		void push(int type, std::string text) {
+			unsigned int position = head.load(std::memory_order_relaxed);
+			Message* slot;
+			while (true) {
+				slot = &queue[position % QUEUE_SIZE];
+				unsigned int sequence = slot->sequence.load(std::memory_order_acquire);
+				int difference = (int)(sequence - position);
+				if (difference == 0) {
+					if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				} else if (difference < 0) {
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				} else {
+					position = head.load(std::memory_order_relaxed);
+				}
+			}
+			slot->type = type;
+			slot->time = std::time(0);
+			slot->text.swap(text);
+			slot->sequence.store(position + 1, std::memory_order_release);
+			wakeup.notify_one();
+		}
+
+	private:
+		Message queue[QUEUE_SIZE];
+		std::atomic<unsigned int> head;
+		unsigned int tail;
+		std::atomic<unsigned int> dropped;
+		std::atomic<bool> running;
+		std::thread writer;
+		std::mutex wakeupLock;
+		std::condition_variable wakeup;
+
+		// Only touched by the writer thread
+		time_t cachedSecond;
+		char cachedTimestamp[64];
+
+		void run() {
+			while (true) {
+				bool wrote = false;
+				while (pop()) {
+					wrote = true;
+				}
+				unsigned int lost = dropped.exchange(0, std::memory_order_relaxed);
+				if (lost > 0) {
+					std::fprintf(stderr, "%s[WARNING] Log queue full, %u messages dropped.\n", getTimestamp(std::time(0)), lost);
+					wrote = true;
+				}
+				if (wrote) {
+					std::fflush(stdout);
+				}
+				if (!running) {
+					break;
+				}
+				// Producers never take the lock, so a missed notify only delays the write a little.
+				std::unique_lock<std::mutex> guard(wakeupLock);
+				wakeup.wait_for(guard, std::chrono::milliseconds(50));
+			}
+			while (pop());
+			std::fflush(stdout);
+		}
+
+		bool pop() {
+			Message& slot = queue[tail % QUEUE_SIZE];
+			if ((int)(slot.sequence.load(std::memory_order_acquire) - (tail + 1)) < 0) {
+				return false;
+			}
+			write(slot.type, slot.time, slot.text);
+			slot.text.clear();
+			slot.sequence.store(tail + QUEUE_SIZE, std::memory_order_release);
+			tail++;
+			return true;
+		}
+
+		void write(int type, time_t time, const std::string& text) {
+			const char* timestamp = getTimestamp(time);
+			switch (type) {
+			case DEBUG:
+				std::fprintf(stdout, "%s[DEBUG] %s\n", timestamp, text.c_str());
+				break;
+			case INFO:
+				std::fprintf(stdout, "%s[INFO] %s\n", timestamp, text.c_str());
+				break;
+			case WARNING:
+				std::fprintf(stdout, "%s[WARNING] %s\n", timestamp, text.c_str());
+				break;
+			case ERROR:
+				std::fprintf(stderr, "%s[ERROR] %s\n", timestamp, text.c_str());
+				break;
+			default:
+				std::fprintf(stderr, "%s[ERROR] Undefined type in loggingMessage().\n", timestamp);
+				break;
+			}
+		}
+
+		// Generate timestamp for logging, formatted once per second.
+		const char* getTimestamp(time_t timer) {
+			if (timer != cachedSecond) {
+				std::tm bt{};
+#ifdef _WIN32
+				localtime_s(&bt, &timer);
+#else
+				localtime_r(&timer, &bt);
+#endif
+				std::strftime(cachedTimestamp, sizeof(cachedTimestamp), "%F %T ", &bt);
+				cachedSecond = timer;
+			}
+			return cachedTimestamp;
+		}
+	};
 
-		char buffer[64];
-		return { buffer, std::strftime(buffer, sizeof(buffer), "%F %T ", &bt) };
+	// The single logger of the program, its writer thread is stopped (and drained) at exit.
+	Logger& getLogger() {
+		static Logger instance;
+		return instance;
 	}
 
 	// Logging out the message.
 	void loggingMessage(int type, std::string message) {
-		switch (type) {
-		case DEBUG:
-			std::cout << getTimestamp() << "[DEBUG] " << message << std::endl;
-			break;
-		case INFO:
-			std::cout << getTimestamp() << "[INFO] " << message << std::endl;
-			break;
-		case WARNING:
-			std::cout << getTimestamp() << "[WARNING] " << message << std::endl;
-			break;
-		case ERROR:
-			std::cerr << getTimestamp() << "[ERROR] " << message << std::endl;
-			break;
-		default:
-			std::cerr << getTimestamp() << "[ERROR] " << "Undefined type in loggingMessage()." << std::endl;
-			break;
+		if (type < LOGGING_MIN_LEVEL) {
+			return;
 		}
+		getLogger().push(type, std::move(message));
 	}
 
-	void showInitInfo(const GLubyte* renderer, const GLubyte* version) {
-		std::cout << getTimestamp() << "[INFO] GPU: " << renderer << std::endl;
-		std::cout << getTimestamp() << "[INFO] OpenGL Version: " << version << std::endl;
+	void showInitInfo(const unsigned char* renderer, const unsigned char* version) {
+		loggingMessage(INFO, std::string("GPU: ") + (const char*)renderer);
+		loggingMessage(INFO, std::string("OpenGL Version: ") + (const char*)version);
 	}
 }
 
-#endif // !LOGGING_H
\ No newline at end of file
+#endif // !LOGGING_H
@@ -0,0 +1,220 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "../Headers/logging.h"
+#include "../Headers/profiler.h"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Vertex layout shared by every mesh: float position, snorm 10-10-10-2 normal, half-float texture coords.
+// 20 bytes instead of the 32 bytes of 8 interleaved floats.
+struct PackedVertex {
+	float position[3];
+	GLuint normal;
+	GLuint textureCoords;
+};
+
+// One mesh suballocated from the registry's arena buffer.
+struct Mesh {
+	std::string name;
+	GLint baseVertex;
+	GLsizei vertexCount;
+	GLsizei indexCount;
+	GLenum indexType;
+	GLintptr indexOffset;
+	GLsizeiptr vertexBytes;
+	GLsizeiptr indexBytes;
+};
+
+class MeshRegistry {
+public:
+	static const unsigned int INVALID_MESH = 0xFFFFFFFF;
+
+	unsigned int VAO;
+	unsigned int arenaBuffer;
+
+	MeshRegistry() : VAO(0), arenaBuffer(0), maxVertices(0), indexCapacity(0), vertexCursor(0), indexCursor(0) {}
+
+	// Allocate the arena: the first part holds vertices, the rest holds indices.
+	void init(GLsizei vertexCapacity, GLsizeiptr indexBytesCapacity) {
+		maxVertices = vertexCapacity;
+		indexCapacity = indexBytesCapacity;
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &arenaBuffer);
+		glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+			glBufferData(GL_ARRAY_BUFFER, getCapacity(), NULL, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenaBuffer);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, textureCoords));
+		glBindVertexArray(0);
+	}
+
+	// Add a mesh from interleaved vertices (3 position, 3 normal, 2 texture coords), indices may be empty.
+	unsigned int add(const std::string& name, const std::vector<float>& vertices, const std::vector<unsigned int>& indices) {
+		std::vector<PackedVertex> packed = packVertices(vertices);
+		if (packed.size() <= 0xFFFF) {
+			std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+			return addPacked(name, packed.data(), packed.size(), shortIndices.data(), GL_UNSIGNED_SHORT, shortIndices.size());
+		}
+		return addPacked(name, packed.data(), packed.size(), indices.data(), GL_UNSIGNED_INT, indices.size());
+	}
+
+	// Add a mesh that is already in the arena layout, the data goes straight to the buffer (scene files map it from disk).
+	unsigned int addPacked(const std::string& name, const PackedVertex* vertices, GLsizei vertexCount, const void* indices, GLenum indexType, GLsizei indexCount) {
+		Mesh mesh;
+		mesh.name = name;
+		mesh.vertexCount = vertexCount;
+		mesh.indexCount = indexCount;
+		mesh.indexType = indexType;
+		mesh.vertexBytes = mesh.vertexCount * sizeof(PackedVertex);
+		mesh.indexBytes = mesh.indexCount * ((mesh.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint));
+
+		// Keep every index block 4-byte aligned.
+		GLintptr alignedCursor = (indexCursor + 3) & ~(GLintptr)3;
+		if (vertexCursor + mesh.vertexCount > maxVertices || alignedCursor + mesh.indexBytes > indexCapacity) {
+			logging::loggingMessage(logging::LogType::ERROR, "Mesh arena is full, failed to add mesh: " + name);
+			return INVALID_MESH;
+		}
+		mesh.baseVertex = vertexCursor;
+		mesh.indexOffset = getVertexRegionBytes() + alignedCursor;
+
+		glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, mesh.baseVertex * sizeof(PackedVertex), mesh.vertexBytes, vertices);
+		if (mesh.indexCount > 0) {
+			glBufferSubData(GL_ARRAY_BUFFER, mesh.indexOffset, mesh.indexBytes, indices);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		vertexCursor += mesh.vertexCount;
+		indexCursor = alignedCursor + mesh.indexBytes;
+		meshes.push_back(mesh);
+		return meshes.size() - 1;
+	}
+
+	// Copy a mesh back from the buffer in the arena layout (for writing scene files).
+	void read(unsigned int id, std::vector<PackedVertex>& vertices, std::vector<unsigned char>& indices) const {
+		const Mesh& mesh = meshes[id];
+		vertices.resize(mesh.vertexCount);
+		indices.resize(mesh.indexBytes);
+		glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+		glGetBufferSubData(GL_ARRAY_BUFFER, mesh.baseVertex * sizeof(PackedVertex), mesh.vertexBytes, vertices.data());
+		if (mesh.indexBytes > 0) {
+			glGetBufferSubData(GL_ARRAY_BUFFER, mesh.indexOffset, mesh.indexBytes, indices.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Overwrite the vertices of a mesh in place, the vertex count must not grow.
+	void update(unsigned int id, const std::vector<float>& vertices) {
+		if (id >= meshes.size() || (GLsizei)(vertices.size() / 8) > meshes[id].vertexCount) {
+			logging::loggingMessage(logging::LogType::ERROR, "Invalid mesh update.");
+			return;
+		}
+		std::vector<PackedVertex> packed = packVertices(vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, meshes[id].baseVertex * sizeof(PackedVertex), packed.size() * sizeof(PackedVertex), packed.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void draw(unsigned int id) {
+		if (id >= meshes.size()) {
+			return;
+		}
+		const Mesh& mesh = meshes[id];
+		glBindVertexArray(VAO);
+		profiler::countDrawCall((mesh.indexCount > 0 ? mesh.indexCount : mesh.vertexCount) / 3);
+		if (mesh.indexCount > 0) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)mesh.indexOffset, mesh.baseVertex);
+		} else {
+			glDrawArrays(GL_TRIANGLES, mesh.baseVertex, mesh.vertexCount);
+		}
+		glBindVertexArray(0);
+	}
+
+	// Draw the mesh instanceCount times, the vertex shader tells the copies apart by gl_InstanceID.
+	void drawInstanced(unsigned int id, GLsizei instanceCount) {
+		if (id >= meshes.size() || instanceCount <= 0) {
+			return;
+		}
+		const Mesh& mesh = meshes[id];
+		glBindVertexArray(VAO);
+		profiler::countDrawCall((mesh.indexCount > 0 ? mesh.indexCount : mesh.vertexCount) / 3 * instanceCount);
+		if (mesh.indexCount > 0) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)mesh.indexOffset, instanceCount, mesh.baseVertex);
+		} else {
+			glDrawArraysInstanced(GL_TRIANGLES, mesh.baseVertex, mesh.vertexCount, instanceCount);
+		}
+		glBindVertexArray(0);
+	}
+
+	const Mesh& get(unsigned int id) const {
+		return meshes[id];
+	}
+
+	unsigned int find(const std::string& name) const {
+		for (unsigned int i = 0; i < meshes.size(); i++) {
+			if (meshes[i].name == name) {
+				return i;
+			}
+		}
+		return INVALID_MESH;
+	}
+
+	const std::vector<Mesh>& getMeshes() const {
+		return meshes;
+	}
+
+	static std::vector<PackedVertex> packVertices(const std::vector<float>& vertices) {
+		std::vector<PackedVertex> packed(vertices.size() / 8);
+		for (unsigned int i = 0; i < packed.size(); i++) {
+			const float* v = &vertices[i * 8];
+			packed[i].position[0] = v[0];
+			packed[i].position[1] = v[1];
+			packed[i].position[2] = v[2];
+			packed[i].normal = glm::packSnorm3x10_1x2(glm::vec4(v[3], v[4], v[5], 0.0f));
+			packed[i].textureCoords = glm::packHalf2x16(glm::vec2(v[6], v[7]));
+		}
+		return packed;
+	}
+
+	GLsizeiptr getCapacity() const {
+		return getVertexRegionBytes() + indexCapacity;
+	}
+
+	GLsizeiptr getUsedBytes() const {
+		return vertexCursor * sizeof(PackedVertex) + indexCursor;
+	}
+
+	void release() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &arenaBuffer);
+		meshes.clear();
+		vertexCursor = 0;
+		indexCursor = 0;
+	}
+
+private:
+	std::vector<Mesh> meshes;
+	GLsizei maxVertices;
+	GLsizeiptr indexCapacity;
+	GLsizei vertexCursor;
+	GLintptr indexCursor;
+
+	GLsizeiptr getVertexRegionBytes() const {
+		return maxVertices * sizeof(PackedVertex);
+	}
+};
+
+#endif // !MESH_H
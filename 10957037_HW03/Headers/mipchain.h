@@ -0,0 +1,388 @@
+#ifndef MIPCHAIN_H
+#define MIPCHAIN_H
+
+#include "../Headers/jobs.h"
+#include "../Headers/logging.h"
+#include "../Headers/stb_image.h"
+#include "../Headers/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIPCHAIN_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MIPCHAIN_AVX2_TARGET
+#else
+#define MIPCHAIN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Textures decoded and mipmapped on the CPU instead of by glGenerateMipmap.
+// Level 0 is converted to linear floats once, every level is a 2x2 box filter of the one above and is converted
+// back to bytes, so color channels of sRGB images are averaged in linear space (alpha and 1-2 channel images are data).
+// Rows are split over the job pool, the AVX2 loops are picked at run time.
+namespace mipchain {
+	const int SRGB_STEPS = 4096;
+	const unsigned int PIXELS_PER_JOB = 1 << 16;
+
+	struct Level {
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;	// tightly packed, channels bytes per pixel
+	};
+
+	struct Chain {
+		int channels;
+		std::vector<Level> levels;
+		double decodeTime;	// ms
+		double mipTime;	// ms
+	};
+
+	bool hasAvx2() {
+#ifdef MIPCHAIN_AVX2
+#ifdef _MSC_VER
+		static const bool isSupported = []() {
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) {
+				return false;
+			}
+			__cpuid(info, 1);
+			// The OS has to save the YMM registers too
+			if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) {
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}();
+		return isSupported;
+#else
+		static const bool isSupported = __builtin_cpu_supports("avx2") != 0;
+		return isSupported;
+#endif
+#else
+		return false;
+#endif
+	}
+
+	// [0, 256) decodes sRGB bytes, [256, 512) decodes linear bytes, so one gather handles color and alpha lanes.
+	const float* getDecodeTable() {
+		static const std::vector<float> table = []() {
+			std::vector<float> values(512);
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				values[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				values[256 + i] = c;
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	// Linear [0, 1] in SRGB_STEPS steps to sRGB bytes.
+	const int* getEncodeTable() {
+		static const std::vector<int> table = []() {
+			std::vector<int> values(SRGB_STEPS);
+			for (int i = 0; i < SRGB_STEPS; i++) {
+				float l = i / (float)(SRGB_STEPS - 1);
+				float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				values[i] = std::min(255, std::max(0, (int)(c * 255.0f + 0.5f)));
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	// Decode table offset of every RGBA lane.
+	void getLaneOffsets(bool isSrgb, int offsets[4]) {
+		for (int c = 0; c < 4; c++) {
+			offsets[c] = (isSrgb && c < 3) ? 0 : 256;
+		}
+	}
+
+#ifdef MIPCHAIN_AVX2
+	MIPCHAIN_AVX2_TARGET size_t linearizeAvx2(const unsigned char* source, int channels, const int offsets[4], const float* table, float* target, size_t begin, size_t end) {
+		__m256i offset = _mm256_setr_epi32(offsets[0], offsets[1], offsets[2], offsets[3], offsets[0], offsets[1], offsets[2], offsets[3]);
+		// Byte offsets of the lanes of pixel 0 and 1, alpha of a 3 channel image reads the next pixel and is replaced
+		__m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, channels, channels + 1, channels + 2, channels + 3);
+		__m256 alpha = (channels == 3) ? _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1)) : _mm256_setzero_ps();
+		__m256 one = _mm256_set1_ps(1.0f);
+		size_t i = begin;
+		for (; i + 2 <= end; i += 2) {
+			__m256i bytes = _mm256_i32gather_epi32((const int*)(source + i * channels), lanes, 1);
+			bytes = _mm256_and_si256(bytes, _mm256_set1_epi32(0xFF));
+			__m256 values = _mm256_i32gather_ps(table, _mm256_add_epi32(bytes, offset), 4);
+			_mm256_storeu_ps(target + i * 4, _mm256_blendv_ps(values, one, alpha));
+		}
+		return i;
+	}
+
+	MIPCHAIN_AVX2_TARGET size_t quantizeAvx2(const float* source, int channels, bool isSrgb, const int* table, unsigned char* target, size_t begin, size_t end) {
+		__m256 color = isSrgb ? _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0)) : _mm256_setzero_ps();
+		__m256 zero = _mm256_setzero_ps();
+		__m256 one = _mm256_set1_ps(1.0f);
+		// Low byte of every 32-bit lane to the front of its 128-bit half, then both halves together
+		__m256i pack = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		__m256i join = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+		size_t i = begin;
+		for (; i + 2 <= end; i += 2) {
+			__m256 value = _mm256_min_ps(one, _mm256_max_ps(zero, _mm256_loadu_ps(source + i * 4)));
+			__m256i steps = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps((float)(SRGB_STEPS - 1))), _mm256_set1_ps(0.5f)));
+			__m256i srgb = _mm256_i32gather_epi32(table, steps, 4);
+			__m256i linear = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+			__m256i bytes = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(linear), _mm256_castsi256_ps(srgb), color));
+			bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(bytes, pack), join);
+			uint64_t packed = (uint64_t)_mm_cvtsi128_si64(_mm256_castsi256_si128(bytes));
+			if (channels == 4) {
+				memcpy(target + i * 4, &packed, 8);
+			} else {
+				memcpy(target + i * 3, &packed, 3);
+				packed >>= 32;
+				memcpy(target + i * 3 + 3, &packed, 3);
+			}
+		}
+		return i;
+	}
+
+	// Two target pixels per step: four source pixels of both rows are summed, then neighbors across the halves.
+	MIPCHAIN_AVX2_TARGET int downsampleRowAvx2(const float* row0, const float* row1, float* out, int targetWidth) {
+		__m256 quarter = _mm256_set1_ps(0.25f);
+		int x = 0;
+		for (; x + 2 <= targetWidth; x += 2) {
+			__m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+			__m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+			__m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+			_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(sum, quarter));
+		}
+		return x;
+	}
+#endif
+
+	// Bytes of pixels [begin, end) to RGBA floats.
+	void linearize(const unsigned char* source, int channels, bool isSrgb, float* target, size_t begin, size_t end, bool useSimd) {
+		const float* table = getDecodeTable();
+		int offsets[4];
+		getLaneOffsets(isSrgb, offsets);
+		size_t i = begin;
+#ifdef MIPCHAIN_AVX2
+		// The last two pixels are left to the scalar loop, so the 4 byte gathers stay inside the image
+		if (useSimd && channels >= 3) {
+			i = linearizeAvx2(source, channels, offsets, table, target, begin, end > begin + 2 ? end - 2 : begin);
+		}
+#endif
+		// Missing channels read as 0, a missing alpha as 1
+		for (; i < end; i++) {
+			for (int c = 0; c < 4; c++) {
+				target[i * 4 + c] = (c < channels) ? table[offsets[c] + source[i * channels + c]] : (c == 3 ? 1.0f : 0.0f);
+			}
+		}
+	}
+
+	// RGBA floats of pixels [begin, end) back to bytes.
+	void quantize(const float* source, int channels, bool isSrgb, unsigned char* target, size_t begin, size_t end, bool useSimd) {
+		const int* table = getEncodeTable();
+		size_t i = begin;
+#ifdef MIPCHAIN_AVX2
+		if (useSimd && channels >= 3) {
+			i = quantizeAvx2(source, channels, isSrgb, table, target, begin, end);
+		}
+#endif
+		for (; i < end; i++) {
+			for (int c = 0; c < channels; c++) {
+				float value = std::min(1.0f, std::max(0.0f, source[i * 4 + c]));
+				target[i * channels + c] = (unsigned char)((isSrgb && c < 3) ? table[(int)(value * (SRGB_STEPS - 1) + 0.5f)] : (int)(value * 255.0f + 0.5f));
+			}
+		}
+	}
+
+	// Rows [rowBegin, rowEnd) of the next level, odd sizes drop their last row or column like GL's level sizes.
+	void downsample(const float* source, int sourceWidth, int sourceHeight, float* target, int targetWidth, int rowBegin, int rowEnd, bool useSimd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			const float* row0 = source + (size_t)std::min(y * 2, sourceHeight - 1) * sourceWidth * 4;
+			const float* row1 = source + (size_t)std::min(y * 2 + 1, sourceHeight - 1) * sourceWidth * 4;
+			float* out = target + (size_t)y * targetWidth * 4;
+			int x = 0;
+#ifdef MIPCHAIN_AVX2
+			if (useSimd && sourceWidth > 1) {
+				x = downsampleRowAvx2(row0, row1, out, targetWidth);
+			}
+#endif
+			for (; x < targetWidth; x++) {
+				int x0 = std::min(x * 2, sourceWidth - 1) * 4;
+				int x1 = std::min(x * 2 + 1, sourceWidth - 1) * 4;
+				// Same order as the AVX2 loop, so both round alike
+				for (int c = 0; c < 4; c++) {
+					out[x * 4 + c] = ((row0[x0 + c] + row1[x0 + c]) + (row0[x1 + c] + row1[x1 + c])) * 0.25f;
+				}
+			}
+		}
+	}
+
+
+	// body(begin, end) over row ranges of about PIXELS_PER_JOB pixels, on the job pool or on this thread.
+	void forRows(int rows, int width, bool useJobs, const std::function<void(unsigned int, unsigned int)>& body) {
+		if (!useJobs || jobs::get().getWorkerCount() == 0) {
+			body(0, rows);
+			return;
+		}
+		jobs::Counter counter(0);
+		jobs::get().parallelFor(rows, std::max(1u, PIXELS_PER_JOB / std::max(1, width)), body, counter);
+		jobs::get().wait(counter);
+	}
+
+	// Levels down to 1 x 1 from tightly packed pixels, levels[0] is a copy of them.
+	void build(const unsigned char* pixels, int width, int height, int channels, bool isSrgb, bool isMipmapped, Chain& chain, bool useSimd = true, bool useJobs = true) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		useSimd = useSimd && hasAvx2();
+		isSrgb = isSrgb && channels >= 3;
+		chain.channels = channels;
+		chain.levels.assign(1, Level{ width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * channels) });
+		if (!isMipmapped) {
+			chain.mipTime = 0.0;
+			return;
+		}
+
+		std::vector<float> current;
+		std::vector<float> next;
+		while (width > 1 || height > 1) {
+			int nextWidth = std::max(1, width / 2);
+			int nextHeight = std::max(1, height / 2);
+			next.resize((size_t)nextWidth * nextHeight * 4);
+			chain.levels.push_back(Level{ nextWidth, nextHeight, std::vector<unsigned char>((size_t)nextWidth * nextHeight * channels) });
+			Level& level = chain.levels.back();
+			bool isFromBytes = chain.levels.size() == 2;
+			forRows(nextHeight, nextWidth * 2, useJobs, [&](unsigned int begin, unsigned int end) {
+				if (isFromBytes) {
+					// Level 1 linearizes two rows of level 0 at a time, level 0 is never stored as floats
+					std::vector<float> rows((size_t)width * 2 * 4);
+					for (int y = begin; y < (int)end; y++) {
+						const unsigned char* row0 = pixels + (size_t)std::min(y * 2, height - 1) * width * channels;
+						const unsigned char* row1 = pixels + (size_t)std::min(y * 2 + 1, height - 1) * width * channels;
+						linearize(row0, channels, isSrgb, rows.data(), 0, width, useSimd);
+						linearize(row1, channels, isSrgb, rows.data() + (size_t)width * 4, 0, width, useSimd);
+						downsample(rows.data(), width, 2, next.data() + (size_t)y * nextWidth * 4, nextWidth, 0, 1, useSimd);
+					}
+				} else {
+					downsample(current.data(), width, height, next.data(), nextWidth, begin, end, useSimd);
+				}
+				quantize(next.data(), channels, isSrgb, level.pixels.data(), (size_t)begin * nextWidth, (size_t)end * nextWidth, useSimd);
+			});
+			current.swap(next);
+			width = nextWidth;
+			height = nextHeight;
+		}
+		chain.mipTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Decode a file with its original channel count and build its chain, color images are treated as sRGB.
+	bool load(const std::string& path, Chain& chain, bool isMipmapped, bool useSimd = true, bool useJobs = true) {
+		trace::Scope scope("Decode " + path);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		int width, height, channels;
+		unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+		if (!data) {
+			return false;
+		}
+		double decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		build(data, width, height, channels, true, isMipmapped, chain, useSimd, useJobs);
+		chain.decodeTime = decodeTime;
+		stbi_image_free(data);
+		return true;
+	}
+
+	// Files decoded on the job pool ahead of time, one job per file, take() hands a chain over once it is done.
+	class Batch {
+	public:
+		~Batch() {
+			clear();
+		}
+
+		void add(const std::string& path, bool isMipmapped) {
+			slots.push_back(std::unique_ptr<Slot>(new Slot()));
+			Slot* slot = slots.back().get();
+			slot->path = path;
+			slot->isLoaded = false;
+			jobs::get().run([slot, isMipmapped]() { slot->isLoaded = load(slot->path, slot->chain, isMipmapped); }, slot->counter);
+		}
+
+		// False if the path was never added or failed to decode.
+		bool take(const std::string& path, Chain& chain) {
+			for (size_t i = 0; i < slots.size(); i++) {
+				if (slots[i]->path != path) {
+					continue;
+				}
+				jobs::get().wait(slots[i]->counter);
+				bool isLoaded = slots[i]->isLoaded;
+				chain = std::move(slots[i]->chain);
+				slots.erase(slots.begin() + i);
+				return isLoaded;
+			}
+			return false;
+		}
+
+		// Drop chains nobody took (the asset cache already had them).
+		void clear() {
+			for (std::unique_ptr<Slot>& slot : slots) {
+				jobs::get().wait(slot->counter);
+			}
+			slots.clear();
+		}
+
+	private:
+		struct Slot {
+			std::string path;
+			Chain chain;
+			bool isLoaded;
+			jobs::Counter counter{ 0 };
+		};
+		std::vector<std::unique_ptr<Slot>> slots;
+	};
+
+	// Decode and mip throughput of each file (level 0 bytes per second), scalar and AVX2, one thread and the job pool.
+	void benchmark(const std::vector<std::string>& paths, int repeats) {
+		logging::loggingMessage(logging::LogType::INFO, "Image benchmark, " + std::to_string(jobs::get().getWorkerCount()) + " workers, AVX2 " + (hasAvx2() ? "on" : "off") + ", " + std::to_string(repeats) + " runs per file.");
+		for (const std::string& path : paths) {
+			int width, height, channels;
+			double decodeTime = 0.0;
+			unsigned char* data = NULL;
+			for (int i = 0; i < repeats; i++) {
+				stbi_image_free(data);
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+				decodeTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+			if (!data) {
+				logging::loggingMessage(logging::LogType::WARNING, "Image benchmark failed to load " + path);
+				continue;
+			}
+			double megabytes = (double)width * height * channels / (1024.0 * 1024.0);
+			double mipTimes[3] = { 0.0, 0.0, 0.0 };
+			for (int i = 0; i < repeats; i++) {
+				Chain chain;
+				build(data, width, height, channels, true, true, chain, false, false);
+				mipTimes[0] += chain.mipTime / 1000.0;
+				build(data, width, height, channels, true, true, chain, true, false);
+				mipTimes[1] += chain.mipTime / 1000.0;
+				build(data, width, height, channels, true, true, chain, true, true);
+				mipTimes[2] += chain.mipTime / 1000.0;
+			}
+			stbi_image_free(data);
+			char line[256];
+			snprintf(line, sizeof(line), "%s (%d x %d x %d): decode %.0f MB/s, mips scalar %.0f MB/s, AVX2 %.0f MB/s, AVX2 + jobs %.0f MB/s", path.c_str(), width, height, channels,
+				megabytes * repeats / decodeTime, megabytes * repeats / mipTimes[0], megabytes * repeats / mipTimes[1], megabytes * repeats / mipTimes[2]);
+			logging::loggingMessage(logging::LogType::INFO, line);
+		}
+	}
+}
+
+#endif // !MIPCHAIN_H
@@ -0,0 +1,232 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include "../Headers/trace.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace profiler {
+	// Frames kept for the rolling graphs.
+	const int HISTORY = 120;
+
+	// GPU queries are read back this many frames later, so reading them never stalls.
+	const int QUERY_LATENCY = 4;
+
+	struct Zone {
+		std::string name;
+
+		// Accumulated during the current frame
+		double cpuTime;
+		unsigned int drawCalls;
+		unsigned int triangles;
+		unsigned int uniforms;
+		double jobTime;		// summed over every thread that ran jobs of this zone
+		unsigned int jobs;
+
+		// Results of the last complete frame (ms)
+		float lastCpuTime;
+		float lastGpuTime;
+		unsigned int lastDrawCalls;
+		unsigned int lastTriangles;
+		unsigned int lastUniforms;
+		float lastJobTime;
+		unsigned int lastJobs;
+
+		float cpuHistory[HISTORY];
+		float gpuHistory[HISTORY];
+	};
+
+	struct PendingQuery {
+		int zone;
+		GLuint query;
+	};
+
+	class Profiler {
+	public:
+		std::vector<Zone> Zones;
+		int HistoryOffset;
+		bool EnableGPU;
+
+		Profiler() : HistoryOffset(0), EnableGPU(true), frameIndex(0), gpuZone(-1) {}
+
+		// Register a named zone and return its id.
+		int registerZone(const std::string& name) {
+			Zone zone = {};
+			zone.name = name;
+			Zones.push_back(zone);
+			gpuTimes.push_back(0.0f);
+			return Zones.size() - 1;
+		}
+
+		// Collect the GPU results of QUERY_LATENCY frames ago, and publish the CPU results of the last frame.
+		void beginFrame() {
+			int slot = frameIndex % QUERY_LATENCY;
+			std::vector<PendingQuery>& pending = pendingQueries[slot];
+
+			bool available = true;
+			for (unsigned int i = 0; i < gpuTimes.size(); i++) {
+				gpuTimes[i] = 0.0f;
+			}
+			for (unsigned int i = 0; i < pending.size() && available; i++) {
+				GLint ready = 0;
+				glGetQueryObjectiv(pending[i].query, GL_QUERY_RESULT_AVAILABLE, &ready);
+				if (!ready) {
+					available = false;
+					break;
+				}
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(pending[i].query, GL_QUERY_RESULT, &elapsed);
+				gpuTimes[pending[i].zone] += elapsed / 1000000.0f;
+			}
+
+			// Hand the query objects back to the pool
+			for (unsigned int i = 0; i < pending.size(); i++) {
+				freeQueries.push_back(pending[i].query);
+			}
+			pending.clear();
+
+			std::lock_guard<std::mutex> guard(jobLock);
+			for (unsigned int i = 0; i < Zones.size(); i++) {
+				Zone& zone = Zones[i];
+				if (available) {
+					zone.lastGpuTime = gpuTimes[i];
+				}
+				zone.lastCpuTime = (float)(zone.cpuTime * 1000.0);
+				zone.lastDrawCalls = zone.drawCalls;
+				zone.lastTriangles = zone.triangles;
+				zone.lastUniforms = zone.uniforms;
+				zone.lastJobTime = (float)(zone.jobTime * 1000.0);
+				zone.lastJobs = zone.jobs;
+				zone.cpuHistory[HistoryOffset] = zone.lastCpuTime;
+				zone.gpuHistory[HistoryOffset] = zone.lastGpuTime;
+
+				zone.cpuTime = 0.0;
+				zone.drawCalls = 0;
+				zone.triangles = 0;
+				zone.uniforms = 0;
+				zone.jobTime = 0.0;
+				zone.jobs = 0;
+			}
+			HistoryOffset = (HistoryOffset + 1) % HISTORY;
+			frameIndex++;
+			trace::get().endFrame();
+		}
+
+		void beginZone(int id) {
+			stack.push_back(id);
+			starts.push_back(std::chrono::high_resolution_clock::now());
+			trace::get().begin(Zones[id].name);
+
+			// GL_TIME_ELAPSED queries cannot nest, only the outermost zone is timed on the GPU.
+			if (EnableGPU && gpuZone < 0) {
+				GLuint query = getQuery();
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				pendingQueries[frameIndex % QUERY_LATENCY].push_back({ id, query });
+				gpuZone = stack.size() - 1;
+			}
+		}
+
+		void endZone() {
+			if (stack.empty()) {
+				return;
+			}
+			if (gpuZone == (int)stack.size() - 1) {
+				glEndQuery(GL_TIME_ELAPSED);
+				gpuZone = -1;
+			}
+			std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - starts.back();
+			Zones[stack.back()].cpuTime += elapsed.count();
+			trace::get().end();
+			stack.pop_back();
+			starts.pop_back();
+		}
+
+		// Counters are added to the innermost open zone.
+		void countDrawCall(unsigned int triangles) {
+			if (!stack.empty()) {
+				Zones[stack.back()].drawCalls++;
+				Zones[stack.back()].triangles += triangles;
+			}
+		}
+
+		void countUniform() {
+			if (!stack.empty()) {
+				Zones[stack.back()].uniforms++;
+			}
+		}
+
+		// Called from any thread when a job of the zone finished.
+		void addJobTime(int id, double seconds) {
+			std::lock_guard<std::mutex> guard(jobLock);
+			Zones[id].jobTime += seconds;
+			Zones[id].jobs++;
+		}
+
+		void release() {
+			for (int slot = 0; slot < QUERY_LATENCY; slot++) {
+				for (unsigned int i = 0; i < pendingQueries[slot].size(); i++) {
+					freeQueries.push_back(pendingQueries[slot][i].query);
+				}
+				pendingQueries[slot].clear();
+			}
+			if (!freeQueries.empty()) {
+				glDeleteQueries(freeQueries.size(), freeQueries.data());
+			}
+			freeQueries.clear();
+		}
+
+	private:
+		unsigned int frameIndex;
+		int gpuZone;
+		std::vector<int> stack;
+		std::vector<std::chrono::high_resolution_clock::time_point> starts;
+		std::vector<float> gpuTimes;
+		std::vector<PendingQuery> pendingQueries[QUERY_LATENCY];
+		std::vector<GLuint> freeQueries;
+		std::mutex jobLock;
+
+		GLuint getQuery() {
+			if (freeQueries.empty()) {
+				GLuint query;
+				glGenQueries(1, &query);
+				return query;
+			}
+			GLuint query = freeQueries.back();
+			freeQueries.pop_back();
+			return query;
+		}
+	};
+
+	// The single profiler of the program.
+	Profiler& get() {
+		static Profiler instance;
+		return instance;
+	}
+
+	// Times everything until the end of the enclosing scope.
+	class ScopedZone {
+	public:
+		ScopedZone(int id) {
+			get().beginZone(id);
+		}
+
+		~ScopedZone() {
+			get().endZone();
+		}
+	};
+
+	void countDrawCall(unsigned int triangles) {
+		get().countDrawCall(triangles);
+	}
+
+	void countUniform() {
+		get().countUniform();
+	}
+}
+
+#endif // !PROFILER_H
@@ -0,0 +1,85 @@
+#ifndef REVERSEZ_H
+#define REVERSEZ_H
+
+#include <glad/glad.h>
+
+#include "../Headers/logging.h"
+
+#include <cstring>
+#include <string>
+
+// ARB_clip_control (core in GL 4.5), not part of the 3.3 loader
+#ifndef GL_ZERO_TO_ONE
+#define GL_LOWER_LEFT 0x8CA1
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#define GL_ZERO_TO_ONE 0x935F
+#endif
+
+// Depth convention shared by the projections, the depth test and frustum culling.
+// Reversed depth maps the near plane to 1 and the far plane to 0 in a [0, 1] clip range, so with a float depth
+// buffer the float exponent cancels the 1/z falloff of perspective depth and precision stays even at any distance.
+// That also allows a far plane at infinity. Without glClipControl the standard [-1, 1] mapping is used.
+namespace reversez {
+	typedef void (APIENTRYP ClipControlProc)(GLenum origin, GLenum depth);
+
+	class DepthMode {
+	public:
+		bool IsReversed;	// wanted, only used when isSupported()
+		bool IsInfinite;
+
+		DepthMode() : IsReversed(true), IsInfinite(false), clipControl(NULL) {}
+
+		// Look up glClipControl, needs GL 4.5 or ARB_clip_control.
+		void init(GLADloadproc load) {
+			GLint major = 0, minor = 0, count = 0;
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			bool isSupported = major > 4 || (major == 4 && minor >= 5);
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count && !isSupported; i++) {
+				const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+				isSupported = extension && strcmp(extension, "GL_ARB_clip_control") == 0;
+			}
+			clipControl = isSupported ? (ClipControlProc)load("glClipControl") : NULL;
+			if (!clipControl) {
+				logging::loggingMessage(logging::LogType::WARNING, "No glClipControl, reversed depth is not available.");
+			}
+		}
+
+		bool isSupported() const {
+			return clipControl != NULL;
+		}
+
+		bool isReversed() const {
+			return IsReversed && isSupported();
+		}
+
+		// Clip range, clear value and depth test of the current mode, call again after changing it.
+		void apply() const {
+			if (clipControl) {
+				clipControl(GL_LOWER_LEFT, isReversed() ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+			}
+			glClearDepth(isReversed() ? 0.0 : 1.0);
+			glDepthFunc(getDepthFunc(false));
+		}
+
+		// Closer passes, isEqualPassing also lets equal depth pass (the sky is drawn behind everything).
+		GLenum getDepthFunc(bool isEqualPassing) const {
+			if (isReversed()) {
+				return isEqualPassing ? GL_GEQUAL : GL_GREATER;
+			}
+			return isEqualPassing ? GL_LEQUAL : GL_LESS;
+		}
+
+	private:
+		ClipControlProc clipControl;
+	};
+
+	// The single depth mode of the program.
+	DepthMode& get() {
+		static DepthMode instance;
+		return instance;
+	}
+}
+
+#endif // !REVERSEZ_H
@@ -0,0 +1,610 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/assets.h"
+#include "../Headers/frustum.h"
+#include "../Headers/logging.h"
+#include "../Headers/mesh.h"
+#include "../Headers/platform.h"
+#include "../Headers/shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary scene file: a header, a section table and sections of fixed-size records, every section starting on a
+// 256 byte boundary. Vertices are stored in the MeshRegistry layout (PackedVertex) and instances as RGBA32F texels,
+// so a loaded file is mapped into memory and its sections go to the GPU as they are, nothing is parsed or copied.
+// Little-endian only, like every target of this project.
+namespace scene {
+	const char MAGIC[4] = { 'H', 'W', 'S', 'C' };
+	const uint32_t VERSION = 1;
+	const uint64_t SECTION_ALIGNMENT = 256;
+	const int INSTANCE_TEXTURE_UNIT = 6;
+
+	enum SectionType {
+		SECTION_MESHES,		// MeshRecord
+		SECTION_VERTICES,	// PackedVertex
+		SECTION_INDICES,	// 16 or 32 bit indices, every mesh block 4 byte aligned
+		SECTION_MATERIALS,	// MaterialRecord
+		SECTION_GROUPS,		// GroupRecord
+		SECTION_INSTANCES,	// Instance
+		SECTION_COUNT,
+	};
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t sectionCount;
+		uint64_t fileSize;
+		uint64_t reserved;
+	};
+
+	struct Section {
+		uint32_t type;
+		uint32_t count;		// records
+		uint64_t offset;	// bytes from the start of the file
+		uint64_t size;		// bytes
+	};
+
+	struct MeshRecord {
+		char name[32];
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint64_t indexOffset;	// bytes into the index section
+		uint32_t indexCount;
+		uint32_t indexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	};
+
+	// An empty texture path draws the color instead.
+	struct MaterialRecord {
+		char texture[64];
+		float color[3];
+		float shininess;
+	};
+
+	// A run of instances of one mesh, the writer splits them into cells so every group can be culled on its own.
+	struct GroupRecord {
+		char name[32];
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		float center[3];	// bounding sphere of all instances
+		float radius;
+	};
+
+	// Position and uniform scale, one texel of the instance buffer.
+	struct Instance {
+		float position[3];
+		float scale;
+	};
+
+	static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed");
+	static_assert(sizeof(Section) == 24, "Section layout changed");
+	static_assert(sizeof(MeshRecord) == 56, "MeshRecord layout changed");
+	static_assert(sizeof(MaterialRecord) == 80, "MaterialRecord layout changed");
+	static_assert(sizeof(GroupRecord) == 64, "GroupRecord layout changed");
+	static_assert(sizeof(Instance) == 16, "Instance layout changed");
+	static_assert(sizeof(PackedVertex) == 20, "PackedVertex layout changed");
+
+	const uint64_t RECORD_SIZES[SECTION_COUNT] = {
+		sizeof(MeshRecord), sizeof(PackedVertex), 1, sizeof(MaterialRecord), sizeof(GroupRecord), sizeof(Instance),
+	};
+
+	std::string getName(const char* name, size_t capacity) {
+		return std::string(name, std::find(name, name + capacity, '\0') - name);
+	}
+
+	void setName(char* name, size_t capacity, const std::string& value) {
+		memset(name, 0, capacity);
+		memcpy(name, value.c_str(), std::min(value.size(), capacity - 1));
+	}
+
+	// Builds a scene in memory and writes it out in one go (offline, the export path of main).
+	class Writer {
+	public:
+		// vertexCount PackedVertex and indexCount indices of indexType, as read back from a MeshRegistry.
+		unsigned int addMesh(const std::string& name, const PackedVertex* vertices, uint32_t vertexCount, const void* indices, GLenum indexType, uint32_t indexCount) {
+			MeshRecord mesh;
+			setName(mesh.name, sizeof(mesh.name), name);
+			mesh.firstVertex = (uint32_t)this->vertices.size();
+			mesh.vertexCount = vertexCount;
+			mesh.indexOffset = (this->indices.size() + 3) & ~(uint64_t)3;
+			mesh.indexCount = indexCount;
+			mesh.indexType = indexType;
+			this->vertices.insert(this->vertices.end(), vertices, vertices + vertexCount);
+			size_t indexBytes = indexCount * ((indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint));
+			this->indices.resize(mesh.indexOffset + indexBytes, 0);
+			if (indexBytes > 0) {
+				memcpy(&this->indices[mesh.indexOffset], indices, indexBytes);
+			}
+			meshes.push_back(mesh);
+			return meshes.size() - 1;
+		}
+
+		unsigned int addMaterial(const std::string& texture, const glm::vec3& color, float shininess) {
+			MaterialRecord material;
+			setName(material.texture, sizeof(material.texture), texture);
+			material.color[0] = color.x;
+			material.color[1] = color.y;
+			material.color[2] = color.z;
+			material.shininess = shininess;
+			materials.push_back(material);
+			return materials.size() - 1;
+		}
+
+		// Sort the instances into cellSize squares (xz), one group per non-empty cell.
+		// meshRadius bounds the mesh at scale 1 around its origin.
+		void addGroups(const std::string& name, unsigned int mesh, unsigned int material, const std::vector<Instance>& source, float cellSize, float meshRadius) {
+			std::vector<std::pair<uint64_t, uint32_t>> keys(source.size());
+			for (uint32_t i = 0; i < source.size(); i++) {
+				int64_t x = (int64_t)floor(source[i].position[0] / cellSize);
+				int64_t z = (int64_t)floor(source[i].position[2] / cellSize);
+				keys[i] = std::make_pair(((uint64_t)(uint32_t)x << 32) | (uint32_t)z, i);
+			}
+			std::sort(keys.begin(), keys.end());
+
+			for (size_t begin = 0; begin < keys.size();) {
+				size_t end = begin;
+				glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+				float maxScale = 0.0f;
+				while (end < keys.size() && keys[end].first == keys[begin].first) {
+					const Instance& instance = source[keys[end].second];
+					glm::vec3 position(instance.position[0], instance.position[1], instance.position[2]);
+					low = glm::min(low, position);
+					high = glm::max(high, position);
+					maxScale = std::max(maxScale, instance.scale);
+					instances.push_back(instance);
+					end++;
+				}
+				GroupRecord group;
+				setName(group.name, sizeof(group.name), name);
+				group.mesh = mesh;
+				group.material = material;
+				group.firstInstance = (uint32_t)(instances.size() - (end - begin));
+				group.instanceCount = (uint32_t)(end - begin);
+				glm::vec3 center = (low + high) / 2.0f;
+				group.center[0] = center.x;
+				group.center[1] = center.y;
+				group.center[2] = center.z;
+				group.radius = glm::length(high - center) + meshRadius * maxScale;
+				groups.push_back(group);
+				begin = end;
+			}
+		}
+
+		bool write(const std::string& path) const {
+			const void* data[SECTION_COUNT] = { meshes.data(), vertices.data(), indices.data(), materials.data(), groups.data(), instances.data() };
+			const size_t counts[SECTION_COUNT] = { meshes.size(), vertices.size(), indices.size(), materials.size(), groups.size(), instances.size() };
+
+			FileHeader header;
+			memcpy(header.magic, MAGIC, sizeof(MAGIC));
+			header.version = VERSION;
+			header.headerSize = sizeof(FileHeader);
+			header.sectionCount = SECTION_COUNT;
+			header.reserved = 0;
+			Section sections[SECTION_COUNT];
+			uint64_t offset = sizeof(FileHeader) + sizeof(sections);
+			for (int i = 0; i < SECTION_COUNT; i++) {
+				offset = getAligned(offset);
+				sections[i].type = i;
+				sections[i].count = (uint32_t)counts[i];
+				sections[i].offset = offset;
+				sections[i].size = counts[i] * RECORD_SIZES[i];
+				offset += sections[i].size;
+			}
+			header.fileSize = offset;
+
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			if (!file) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to open scene file for writing: " + path);
+				return false;
+			}
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)sections, sizeof(sections));
+			const char padding[SECTION_ALIGNMENT] = { 0 };
+			for (int i = 0; i < SECTION_COUNT; i++) {
+				file.write(padding, sections[i].offset - (uint64_t)file.tellp());
+				file.write((const char*)data[i], sections[i].size);
+			}
+			if (!file) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to write scene file: " + path);
+				return false;
+			}
+			return true;
+		}
+
+		size_t getInstanceCount() const {
+			return instances.size();
+		}
+
+	private:
+		std::vector<MeshRecord> meshes;
+		std::vector<PackedVertex> vertices;
+		std::vector<unsigned char> indices;
+		std::vector<MaterialRecord> materials;
+		std::vector<GroupRecord> groups;
+		std::vector<Instance> instances;
+
+		static uint64_t getAligned(uint64_t offset) {
+			return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+		}
+	};
+
+	// Read-only mapping of a whole file.
+	class MappedFile {
+	public:
+		MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+			file = INVALID_HANDLE_VALUE;
+			mapping = NULL;
+#endif
+		}
+
+		~MappedFile() {
+			close();
+		}
+
+		bool open(const std::string& path) {
+			close();
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			LARGE_INTEGER fileSize;
+			if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+				size = (uint64_t)fileSize.QuadPart;
+				mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mapping) {
+					data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				}
+			}
+#else
+			int file = ::open(path.c_str(), O_RDONLY);
+			struct stat status;
+			if (file >= 0 && fstat(file, &status) == 0 && status.st_size > 0) {
+				size = (uint64_t)status.st_size;
+				void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+				data = (address == MAP_FAILED) ? NULL : (const char*)address;
+			}
+			// The mapping keeps the file alive
+			if (file >= 0) {
+				::close(file);
+			}
+#endif
+			if (!data) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to map file: " + path);
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+#ifdef _WIN32
+			if (data) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (data) {
+				munmap((void*)data, size);
+			}
+#endif
+			data = NULL;
+			size = 0;
+		}
+
+		const char* getData() const {
+			return data;
+		}
+
+		uint64_t getSize() const {
+			return size;
+		}
+
+	private:
+		const char* data;
+		uint64_t size;
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#endif
+	};
+
+	// A mapped scene file, the accessors point into the mapping and stay valid until close().
+	class Scene {
+	public:
+		Scene() {
+			close();
+		}
+
+		// Map the file and check every offset, count and reference before anything touches the GPU.
+		bool load(const std::string& path) {
+			close();
+			if (!file.open(path)) {
+				return false;
+			}
+			if (!validate()) {
+				logging::loggingMessage(logging::LogType::ERROR, "Invalid scene file: " + path);
+				close();
+				return false;
+			}
+			Path = path;
+			return true;
+		}
+
+		void close() {
+			file.close();
+			for (int i = 0; i < SECTION_COUNT; i++) {
+				sections[i] = NULL;
+				counts[i] = 0;
+			}
+			Path.clear();
+		}
+
+		bool isLoaded() const {
+			return file.getData() != NULL;
+		}
+
+		uint64_t getFileSize() const {
+			return file.getSize();
+		}
+
+		uint32_t getCount(SectionType type) const {
+			return counts[type];
+		}
+
+		const MeshRecord& getMesh(uint32_t i) const {
+			return ((const MeshRecord*)sections[SECTION_MESHES])[i];
+		}
+
+		const PackedVertex* getVertices(const MeshRecord& mesh) const {
+			return (const PackedVertex*)sections[SECTION_VERTICES] + mesh.firstVertex;
+		}
+
+		const void* getIndices(const MeshRecord& mesh) const {
+			return sections[SECTION_INDICES] + mesh.indexOffset;
+		}
+
+		const MaterialRecord& getMaterial(uint32_t i) const {
+			return ((const MaterialRecord*)sections[SECTION_MATERIALS])[i];
+		}
+
+		const GroupRecord& getGroup(uint32_t i) const {
+			return ((const GroupRecord*)sections[SECTION_GROUPS])[i];
+		}
+
+		const Instance* getInstances() const {
+			return (const Instance*)sections[SECTION_INSTANCES];
+		}
+
+		std::string Path;
+
+	private:
+		MappedFile file;
+		const char* sections[SECTION_COUNT];
+		uint32_t counts[SECTION_COUNT];
+
+		bool validate() {
+			const FileHeader* header = (const FileHeader*)file.getData();
+			if (file.getSize() < sizeof(FileHeader) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+				|| header->headerSize != sizeof(FileHeader) || header->fileSize != file.getSize()
+				|| header->sectionCount > (file.getSize() - sizeof(FileHeader)) / sizeof(Section)) {
+				return false;
+			}
+			const Section* table = (const Section*)(file.getData() + sizeof(FileHeader));
+			for (uint32_t i = 0; i < header->sectionCount; i++) {
+				const Section& section = table[i];
+				if (section.type >= SECTION_COUNT || sections[section.type] || section.offset % SECTION_ALIGNMENT != 0
+					|| section.offset > file.getSize() || section.size > file.getSize() - section.offset
+					|| section.size != section.count * RECORD_SIZES[section.type]) {
+					return false;
+				}
+				sections[section.type] = file.getData() + section.offset;
+				counts[section.type] = section.count;
+			}
+			for (int i = 0; i < SECTION_COUNT; i++) {
+				if (!sections[i]) {
+					return false;
+				}
+			}
+
+			// Meshes are small, their indices are checked too so no draw reads past its vertices
+			for (uint32_t i = 0; i < counts[SECTION_MESHES]; i++) {
+				const MeshRecord& mesh = getMesh(i);
+				uint64_t indexSize = (mesh.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+				if ((mesh.indexType != GL_UNSIGNED_SHORT && mesh.indexType != GL_UNSIGNED_INT) || mesh.indexOffset % 4 != 0
+					|| (uint64_t)mesh.firstVertex + mesh.vertexCount > counts[SECTION_VERTICES]
+					|| mesh.indexOffset > counts[SECTION_INDICES] || mesh.indexCount * indexSize > counts[SECTION_INDICES] - mesh.indexOffset) {
+					return false;
+				}
+				for (uint32_t j = 0; j < mesh.indexCount; j++) {
+					const char* index = (const char*)getIndices(mesh) + j * indexSize;
+					uint32_t value = (indexSize == sizeof(GLushort)) ? *(const GLushort*)index : *(const GLuint*)index;
+					if (value >= mesh.vertexCount) {
+						return false;
+					}
+				}
+			}
+			for (uint32_t i = 0; i < counts[SECTION_GROUPS]; i++) {
+				const GroupRecord& group = getGroup(i);
+				if (group.mesh >= counts[SECTION_MESHES] || group.material >= counts[SECTION_MATERIALS]
+					|| (uint64_t)group.firstInstance + group.instanceCount > counts[SECTION_INSTANCES]) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	// A scene on the GPU: its meshes in the MeshRegistry arena and all instances in one texture buffer,
+	// every group is one instanced draw. Meshes and textures come from the asset cache, so scenes share them.
+	class GpuScene {
+	public:
+		struct Group {
+			std::string name;
+			unsigned int mesh;	// MeshRegistry id
+			unsigned int material;
+			GLint firstInstance;
+			GLsizei instanceCount;
+			glm::vec3 center;
+			float radius;
+		};
+
+		struct Material {
+			unsigned int texture;	// 0 => color only
+			glm::vec3 color;
+			float shininess;
+		};
+
+		GpuScene() : instanceBuffer(0), instanceTexture(0), instanceCount(0), cache(NULL), groupsDrawn(0), instancesDrawn(0) {}
+
+		// The mapped meshes and instances are handed to GL directly (meshes only when the cache does not have them yet).
+		bool upload(const Scene& scene, MeshRegistry& registry, assets::Cache& cache) {
+			release();
+			GLint maxTexels = 0;
+			glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+			if (scene.getCount(SECTION_INSTANCES) > (uint32_t)maxTexels) {
+				logging::loggingMessage(logging::LogType::ERROR, "Too many scene instances for a texture buffer: " + std::to_string(scene.getCount(SECTION_INSTANCES)));
+				return false;
+			}
+
+			this->cache = &cache;
+			meshes.resize(scene.getCount(SECTION_MESHES));
+			for (uint32_t i = 0; i < meshes.size(); i++) {
+				const MeshRecord& mesh = scene.getMesh(i);
+				meshes[i] = cache.acquireMesh(registry, "Scene " + getName(mesh.name, sizeof(mesh.name)), scene.getVertices(mesh), mesh.vertexCount,
+					scene.getIndices(mesh), mesh.indexType, mesh.indexCount);
+			}
+			for (uint32_t i = 0; i < scene.getCount(SECTION_MATERIALS); i++) {
+				const MaterialRecord& record = scene.getMaterial(i);
+				std::string texture = getName(record.texture, sizeof(record.texture));
+				Material material;
+				material.texture = texture.empty() ? 0 : cache.acquireTexture(texture);
+				material.color = glm::vec3(record.color[0], record.color[1], record.color[2]);
+				material.shininess = record.shininess;
+				materials.push_back(material);
+			}
+			for (uint32_t i = 0; i < scene.getCount(SECTION_GROUPS); i++) {
+				const GroupRecord& record = scene.getGroup(i);
+				if (meshes[record.mesh] == MeshRegistry::INVALID_MESH) {
+					continue;
+				}
+				groups.push_back({ getName(record.name, sizeof(record.name)), meshes[record.mesh], record.material, (GLint)record.firstInstance,
+					(GLsizei)record.instanceCount, glm::vec3(record.center[0], record.center[1], record.center[2]), record.radius });
+			}
+
+			instanceCount = scene.getCount(SECTION_INSTANCES);
+			glGenBuffers(1, &instanceBuffer);
+			glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+			glBufferData(GL_TEXTURE_BUFFER, instanceCount * sizeof(Instance), scene.getInstances(), GL_STATIC_DRAW);
+			glGenTextures(1, &instanceTexture);
+			glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+			return true;
+		}
+
+		// Groups outside the view are skipped, the shader state is restored for the textured draws after this one.
+		void draw(Shader& shader, MeshRegistry& registry, const frustum::Frustum& view) {
+			groupsDrawn = 0;
+			instancesDrawn = 0;
+			if (groups.empty()) {
+				return;
+			}
+			glActiveTexture(GL_TEXTURE0 + INSTANCE_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+			glActiveTexture(GL_TEXTURE0);
+			shader.setBool("isSceneInstanced", true);
+			for (const Group& group : groups) {
+				if (!frustum::intersectsSphere(view, group.center, group.radius)) {
+					continue;
+				}
+				const Material& material = materials[group.material];
+				shader.setBool("enableTexture", material.texture != 0);
+				glBindTexture(GL_TEXTURE_2D, material.texture);
+				shader.setVec3("color", material.color);
+				shader.setFloat("material.shininess", material.shininess);
+				shader.setInt("sceneFirstInstance", group.firstInstance);
+				registry.drawInstanced(group.mesh, group.instanceCount);
+				groupsDrawn++;
+				instancesDrawn += group.instanceCount;
+			}
+			shader.setBool("isSceneInstanced", false);
+			shader.setBool("enableTexture", true);
+			shader.setFloat("material.shininess", 64.0f);
+			glActiveTexture(GL_TEXTURE0 + INSTANCE_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		void release() {
+			if (instanceTexture) {
+				glDeleteTextures(1, &instanceTexture);
+				glDeleteBuffers(1, &instanceBuffer);
+			}
+			for (unsigned int mesh : meshes) {
+				if (mesh != MeshRegistry::INVALID_MESH) {
+					cache->release(assets::KIND_MESH, mesh);
+				}
+			}
+			for (const Material& material : materials) {
+				if (material.texture) {
+					cache->release(assets::KIND_TEXTURE, material.texture);
+				}
+			}
+			instanceBuffer = 0;
+			instanceTexture = 0;
+			instanceCount = 0;
+			groups.clear();
+			meshes.clear();
+			materials.clear();
+		}
+
+		const std::vector<Group>& getGroups() const {
+			return groups;
+		}
+
+		uint32_t getInstanceCount() const {
+			return instanceCount;
+		}
+
+		unsigned int getGroupsDrawn() const {
+			return groupsDrawn;
+		}
+
+		unsigned int getInstancesDrawn() const {
+			return instancesDrawn;
+		}
+
+	private:
+		unsigned int instanceBuffer;
+		unsigned int instanceTexture;
+		uint32_t instanceCount;
+		assets::Cache* cache;
+		std::vector<Group> groups;
+		std::vector<unsigned int> meshes;
+		std::vector<Material> materials;
+		unsigned int groupsDrawn;
+		unsigned int instancesDrawn;
+	};
+}
+
+#endif // !SCENE_H
@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 
 #include "..\Headers\logging.h";
+#include "../Headers/profiler.h"
 
 #include <string>
 #include <fstream>
@@ -15,6 +16,7 @@ public:
 	unsigned int ID;
 
 	Shader(const char* vertexPath, const char* fragmentPath) {
+		trace::Scope scope(std::string("Shader ") + vertexPath);
 		std::string vertexCode;
 		std::string fragmentCode;
 
@@ -74,30 +76,42 @@ public:
 	}
 
 	void setBool(const std::string& name, bool value) const {
+		profiler::countUniform();
 		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 	}
 
 	void setInt(const std::string& name, int value) const {
+		profiler::countUniform();
 		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 	}
 
 	void setFloat(const std::string& name, float value) const {
+		profiler::countUniform();
 		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 	}
 
+	void setVec2(const std::string& name, glm::vec2 vector) const {
+		profiler::countUniform();
+		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &vector[0]);
+	}
+
 	void setVec3(const std::string& name, glm::vec3 vector) const {
+		profiler::countUniform();
 		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &vector[0]);
 	}
 
 	void setVec3(const std::string& name, float x, float y, float z) const {
+		profiler::countUniform();
 		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
 	}
 
 	void setMat3(const std::string& name, glm::mat3 matrices) const {
+		profiler::countUniform();
 		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &matrices[0][0]);
 	}
 
 	void setMat4(const std::string& name, glm::mat4 matrices) const {
+		profiler::countUniform();
 		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &matrices[0][0]);
 	}
 
@@ -0,0 +1,421 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Headers/frustum.h"
+#include "../Headers/logging.h"
+#include "../Headers/mesh.h"
+#include "../Headers/reversez.h"
+#include "../Headers/shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Cascaded shadow maps of the sun. The view from near to Distance is split into CASCADE_COUNT slices and each
+// slice gets an orthographic map around its bounding sphere, snapped to whole texels so the edges do not crawl
+// while the camera moves. The first cascades hold every caster and are drawn every frame. The far ones only hold
+// static casters (seabed, grass, boxes, scene files) and are fitted with a margin, so a map stays valid until the
+// view leaves it, the sun turns by SunThreshold or the static content changes; at most CachedUpdatesPerFrame of
+// them are drawn again in one frame.
+namespace shadows {
+	const int CASCADE_COUNT = 4;
+	const int FIRST_CACHED_CASCADE = 2;
+	const int TEXTURE_UNIT = 7;
+	const int INSTANCE_TEXTURE_UNIT = 8;
+	const float CACHE_MARGIN = 1.3f;		// cached cascades cover this much more than their slice
+	const float CASTER_DISTANCE = 50.0f;	// casters this far toward the sun from a slice still shade it
+	const float MIN_SUN_HEIGHT = 0.05f;		// a lower sun lights almost nothing and casts no shadows
+
+	const int SIZE_COUNT = 3;
+	const int SIZES[SIZE_COUNT] = { 512, 1024, 2048 };
+	const char* const SIZE_NAMES[SIZE_COUNT] = { "512", "1024", "2048" };
+
+	struct Cascade {
+		float splitNear;	// view distances of the slice
+		float splitFar;
+		glm::vec3 center;	// sphere the map covers
+		float radius;
+		float texelSize;	// meters
+		glm::mat4 view;		// rotation toward the sun, the projection holds the position
+		glm::mat4 projection;
+		glm::mat4 lookup;	// world to map coordinates and depth, all in [0, 1]
+		glm::vec3 sunDirection;
+		unsigned int staticVersion;
+		unsigned int renderedFrame;
+		bool isValid;
+		bool isDue;			// drawn this frame
+	};
+
+	// Orthographic projection into the current clip depth range.
+	glm::mat4 getOrthoMatrix(float left, float right, float bottom, float top, float near, float far, bool isZeroToOne) {
+		glm::mat4 matrix(1.0f);
+		matrix[0][0] = 2.0f / (right - left);
+		matrix[1][1] = 2.0f / (top - bottom);
+		matrix[3][0] = -(right + left) / (right - left);
+		matrix[3][1] = -(top + bottom) / (top - bottom);
+		if (isZeroToOne) {
+			matrix[2][2] = -1.0f / (far - near);
+			matrix[3][2] = -near / (far - near);
+		} else {
+			matrix[2][2] = -2.0f / (far - near);
+			matrix[3][2] = -(far + near) / (far - near);
+		}
+		return matrix;
+	}
+
+	class CascadedShadows {
+	public:
+		bool IsEnabled;
+		int Size;					// texels per map side, one of SIZES
+		float Distance;				// shadows end this far from the camera
+		float SplitLambda;			// 0 => even slices, 1 => logarithmic
+		float SunThreshold;			// degrees the sun turns before cached cascades are drawn again
+		int CachedUpdatesPerFrame;
+
+		CascadedShadows() : IsEnabled(true), Size(1024), Distance(120.0f), SplitLambda(0.75f), SunThreshold(1.0f), CachedUpdatesPerFrame(1),
+			texture(0), framebuffer(0), textureSize(0), isActive(false), frame(0), cascadesDrawn(0) {
+			for (int i = 0; i < CASCADE_COUNT; i++) {
+				cascades[i] = Cascade();
+				cascades[i].isValid = false;
+				cascades[i].isDue = false;
+			}
+		}
+
+		void init() {
+			create();
+		}
+
+		// Fit the cascades to the view volume (4 corners on the near and on the far plane, the far plane at distance far)
+		// and mark the ones to draw this frame.
+		void update(const std::vector<glm::vec4>& nearCorners, const std::vector<glm::vec4>& farCorners, float near, float far, const glm::vec3& sunDirection, unsigned int staticVersion) {
+			frame++;
+			cascadesDrawn = 0;
+			for (int i = 0; i < CASCADE_COUNT; i++) {
+				cascades[i].isDue = false;
+			}
+			if (Size != textureSize) {
+				create();
+			}
+			glm::vec3 direction = glm::normalize(sunDirection);
+			isActive = IsEnabled && direction.y > MIN_SUN_HEIGHT;
+			if (!isActive) {
+				return;
+			}
+
+			float shadowFar = std::min(Distance, far);
+			float cosThreshold = std::cos(glm::radians(SunThreshold));
+			std::vector<int> stale;
+			bool isCovered[CASCADE_COUNT] = { false };
+			glm::vec3 centers[CASCADE_COUNT];
+			float radii[CASCADE_COUNT];
+			for (int i = 0; i < CASCADE_COUNT; i++) {
+				Cascade& cascade = cascades[i];
+				cascade.splitNear = getSplit(i, near, shadowFar);
+				cascade.splitFar = getSplit(i + 1, near, shadowFar);
+				getSliceSphere(nearCorners, farCorners, (cascade.splitNear - near) / (far - near), (cascade.splitFar - near) / (far - near), centers[i], radii[i]);
+				if (i < FIRST_CACHED_CASCADE) {
+					fit(cascade, centers[i], radii[i], direction, staticVersion);
+					continue;
+				}
+				// A map fitted far larger than the slice wastes its texels, fit it again
+				isCovered[i] = cascade.isValid && glm::length(centers[i] - cascade.center) + radii[i] <= cascade.radius
+					&& radii[i] * CACHE_MARGIN * 2.0f > cascade.radius;
+				if (!isCovered[i] || cascade.staticVersion != staticVersion || glm::dot(cascade.sunDirection, direction) < cosThreshold) {
+					stale.push_back(i);
+				}
+			}
+
+			// Maps the view has already left go first, then the ones drawn longest ago
+			std::sort(stale.begin(), stale.end(), [this, &isCovered](int a, int b) {
+				if (isCovered[a] != isCovered[b]) {
+					return !isCovered[a];
+				}
+				return cascades[a].renderedFrame < cascades[b].renderedFrame;
+			});
+			for (int i = 0; i < (int)stale.size() && i < CachedUpdatesPerFrame; i++) {
+				fit(cascades[stale[i]], centers[stale[i]], radii[stale[i]] * CACHE_MARGIN, direction, staticVersion);
+			}
+		}
+
+		bool isShadowing() const {
+			return isActive;
+		}
+
+		const Cascade& getCascade(int index) const {
+			return cascades[index];
+		}
+
+		// Casters of the cascade are the ones inside its box.
+		frustum::Frustum getFrustum(int index) const {
+			return frustum::extract(cascades[index].projection * cascades[index].view, reversez::get().isReversed());
+		}
+
+		// Depth state for the maps, the due cascades are drawn between begin() and end().
+		void begin() {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glViewport(0, 0, textureSize, textureSize);
+			glClearDepth(1.0);
+			glDepthFunc(GL_LESS);
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(2.0f, 2.0f);
+		}
+
+		void beginCascade(int index) {
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, index);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			cascadesDrawn++;
+		}
+
+		// Back to the depth test of the views.
+		void end() {
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			reversez::get().apply();
+		}
+
+		// Maps that were never drawn get a matrix that puts everything outside them.
+		void setUniforms(Shader& shader) const {
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			glActiveTexture(GL_TEXTURE0);
+			shader.setBool("useShadows", isActive);
+			for (int i = 0; i < CASCADE_COUNT; i++) {
+				shader.setMat4("shadowMatrices[" + std::to_string(i) + "]", cascades[i].isValid ? cascades[i].lookup : glm::mat4(0.0f));
+				shader.setFloat("shadowTexelSizes[" + std::to_string(i) + "]", cascades[i].isValid ? cascades[i].texelSize : 0.0f);
+			}
+		}
+
+		void setConstants(Shader& shader) const {
+			shader.use();
+			shader.setInt("shadowMap", TEXTURE_UNIT);
+		}
+
+		unsigned int getTexture() const {
+			return texture;
+		}
+
+		unsigned int getFrame() const {
+			return frame;
+		}
+
+		unsigned int getCascadesDrawn() const {
+			return cascadesDrawn;
+		}
+
+		void release() {
+			if (texture) {
+				glDeleteTextures(1, &texture);
+				glDeleteFramebuffers(1, &framebuffer);
+			}
+			texture = 0;
+			framebuffer = 0;
+			textureSize = 0;
+		}
+
+	private:
+		Cascade cascades[CASCADE_COUNT];
+		unsigned int texture;
+		unsigned int framebuffer;
+		int textureSize;
+		bool isActive;
+		unsigned int frame;
+		unsigned int cascadesDrawn;
+
+		// One depth layer per cascade, sampled with hardware depth comparison.
+		void create() {
+			release();
+			textureSize = Size;
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, textureSize, textureSize, CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+			glGenFramebuffers(1, &framebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				logging::loggingMessage(logging::LogType::ERROR, "Shadow map framebuffer is not complete.");
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			for (int i = 0; i < CASCADE_COUNT; i++) {
+				cascades[i].isValid = false;
+			}
+		}
+
+		// Between even and logarithmic slices, split 0 is near and split CASCADE_COUNT is far.
+		float getSplit(int index, float near, float far) const {
+			float part = (float)index / CASCADE_COUNT;
+			float logarithmic = near * std::pow(far / near, part);
+			float even = near + (far - near) * part;
+			return glm::mix(even, logarithmic, SplitLambda);
+		}
+
+		// Sphere around the part of the view volume between the fractions begin and end of the way to the far plane.
+		static void getSliceSphere(const std::vector<glm::vec4>& nearCorners, const std::vector<glm::vec4>& farCorners, float begin, float end, glm::vec3& center, float& radius) {
+			glm::vec3 corners[8];
+			center = glm::vec3(0.0f);
+			for (int i = 0; i < 4; i++) {
+				glm::vec3 near(nearCorners[i]);
+				glm::vec3 far(farCorners[i]);
+				corners[i] = glm::mix(near, far, begin);
+				corners[i + 4] = glm::mix(near, far, end);
+				center += (corners[i] + corners[i + 4]) / 8.0f;
+			}
+			radius = 0.0f;
+			for (int i = 0; i < 8; i++) {
+				radius = std::max(radius, glm::length(corners[i] - center));
+			}
+			// Rounded up, so turning the camera does not change the texel size
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+		}
+
+		void fit(Cascade& cascade, const glm::vec3& center, float radius, const glm::vec3& direction, unsigned int staticVersion) {
+			glm::vec3 up = (std::abs(direction.z) < 0.9f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			cascade.view = glm::lookAt(glm::vec3(0.0f), -direction, up);
+
+			// Whole texels in light space, the map moves in steps the rasterizer cannot see
+			cascade.texelSize = 2.0f * radius / textureSize;
+			glm::vec3 lightCenter = glm::vec3(cascade.view * glm::vec4(center, 1.0f));
+			lightCenter.x = std::floor(lightCenter.x / cascade.texelSize) * cascade.texelSize;
+			lightCenter.y = std::floor(lightCenter.y / cascade.texelSize) * cascade.texelSize;
+			bool isZeroToOne = reversez::get().isReversed();
+			cascade.projection = getOrthoMatrix(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+				-lightCenter.z - radius - CASTER_DISTANCE, -lightCenter.z + radius, isZeroToOne);
+
+			glm::mat4 bias(1.0f);
+			bias[0][0] = 0.5f;
+			bias[1][1] = 0.5f;
+			bias[3][0] = 0.5f;
+			bias[3][1] = 0.5f;
+			if (!isZeroToOne) {
+				bias[2][2] = 0.5f;
+				bias[3][2] = 0.5f;
+			}
+			cascade.lookup = bias * cascade.projection * cascade.view;
+			cascade.center = glm::vec3(glm::transpose(cascade.view) * glm::vec4(lightCenter, 1.0f));
+			cascade.radius = radius;
+			cascade.sunDirection = direction;
+			cascade.staticVersion = staticVersion;
+			cascade.renderedFrame = frame;
+			cascade.isValid = true;
+			cascade.isDue = true;
+		}
+	};
+
+	// Model matrices of the casters of every due cascade in one texture buffer (4 texels per matrix),
+	// each batch is one instanced draw of a mesh.
+	class CasterBatches {
+	public:
+		struct Batch {
+			int cascade;
+			unsigned int mesh;		// MeshRegistry id
+			unsigned int texture;	// alpha tested against it, 0 => opaque
+			GLint firstInstance;
+			GLsizei instanceCount;
+		};
+
+		CasterBatches() : buffer(0), bufferTexture(0), capacity(0) {}
+
+		void clear() {
+			batches.clear();
+			matrices.clear();
+		}
+
+		// The matrices added until the next begin() belong to this batch.
+		void begin(int cascade, unsigned int mesh, unsigned int texture) {
+			batches.push_back({ cascade, mesh, texture, (GLint)matrices.size(), 0 });
+		}
+
+		void add(const glm::mat4& matrix) {
+			matrices.push_back(matrix);
+			batches.back().instanceCount++;
+		}
+
+		// One upload for all cascades, the buffer only grows.
+		void upload() {
+			if (!buffer) {
+				glGenBuffers(1, &buffer);
+				glGenTextures(1, &bufferTexture);
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+			if (matrices.size() > capacity) {
+				capacity = std::max<size_t>(matrices.size(), capacity * 2);
+				glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+				glBindTexture(GL_TEXTURE_BUFFER, bufferTexture);
+				glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+				glBindTexture(GL_TEXTURE_BUFFER, 0);
+			}
+			if (!matrices.empty()) {
+				glBufferSubData(GL_TEXTURE_BUFFER, 0, matrices.size() * sizeof(glm::mat4), matrices.data());
+			}
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+
+		void draw(Shader& shader, MeshRegistry& registry, int cascade) {
+			glActiveTexture(GL_TEXTURE0 + INSTANCE_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, bufferTexture);
+			glActiveTexture(GL_TEXTURE0);
+			shader.setBool("isMatrixInstanced", true);
+			for (const Batch& batch : batches) {
+				if (batch.cascade != cascade || batch.instanceCount == 0) {
+					continue;
+				}
+				shader.setBool("enableTexture", batch.texture != 0);
+				glBindTexture(GL_TEXTURE_2D, batch.texture);
+				shader.setInt("matrixFirstInstance", batch.firstInstance);
+				registry.drawInstanced(batch.mesh, batch.instanceCount);
+			}
+			shader.setBool("isMatrixInstanced", false);
+			shader.setBool("enableTexture", false);
+			glActiveTexture(GL_TEXTURE0 + INSTANCE_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		void setConstants(Shader& shader) const {
+			shader.use();
+			shader.setInt("matrixInstances", INSTANCE_TEXTURE_UNIT);
+		}
+
+		unsigned int getInstanceCount() const {
+			return matrices.size();
+		}
+
+		unsigned int getBatchCount() const {
+			return batches.size();
+		}
+
+		void release() {
+			if (buffer) {
+				glDeleteTextures(1, &bufferTexture);
+				glDeleteBuffers(1, &buffer);
+			}
+			buffer = 0;
+			bufferTexture = 0;
+			capacity = 0;
+		}
+
+	private:
+		std::vector<Batch> batches;
+		std::vector<glm::mat4> matrices;
+		unsigned int buffer;
+		unsigned int bufferTexture;
+		size_t capacity;
+	};
+}
+
+#endif // !SHADOWS_H
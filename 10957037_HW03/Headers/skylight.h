@@ -0,0 +1,136 @@
+#ifndef SKYLIGHT_H
+#define SKYLIGHT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/logging.h"
+#include "../Headers/shader.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Diffuse light of the skybox as second order spherical harmonics: 9 colors instead of six faces.
+// The coefficients are projected once from a small mip level of the cube map and already convolved with
+// the cosine lobe (and divided by pi), so the shader gets the ambient color of a normal from a dot product.
+namespace skylight {
+	const int SH_COUNT = 9;
+	const int PROJECTION_SIZE = 32;	// largest face size read back for the projection
+	const float PI = 3.14159265f;
+
+	struct Irradiance {
+		glm::vec3 coefficients[SH_COUNT];
+	};
+
+	// Real basis functions for l <= 2, same order and constants as getSkyAmbient() in lighting.fs.
+	void evaluateBasis(const glm::vec3& d, float basis[SH_COUNT]) {
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * d.y;
+		basis[2] = 0.488603f * d.z;
+		basis[3] = 0.488603f * d.x;
+		basis[4] = 1.092548f * d.x * d.y;
+		basis[5] = 1.092548f * d.y * d.z;
+		basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+		basis[7] = 1.092548f * d.x * d.z;
+		basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+	}
+
+	// Direction through (u, v) in [-1, 1] of a face, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order.
+	glm::vec3 getFaceDirection(int face, float u, float v) {
+		switch (face) {
+		case 0: return glm::vec3(1.0f, -v, -u);
+		case 1: return glm::vec3(-1.0f, -v, u);
+		case 2: return glm::vec3(u, 1.0f, v);
+		case 3: return glm::vec3(u, -1.0f, -v);
+		case 4: return glm::vec3(u, -v, 1.0f);
+		default: return glm::vec3(-u, -v, -1.0f);
+		}
+	}
+
+	// Project the cube map, it should have mips (level 0 of a big sky is a lot to read back).
+	Irradiance project(unsigned int cubemap) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		Irradiance irradiance;
+		for (int i = 0; i < SH_COUNT; i++) {
+			irradiance.coefficients[i] = glm::vec3(0.0f);
+		}
+
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		GLint level = 0, size = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+		while (size > PROJECTION_SIZE) {
+			GLint next = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, level + 1, GL_TEXTURE_WIDTH, &next);
+			if (next == 0) {
+				break;
+			}
+			level++;
+			size = next;
+		}
+		if (size == 0) {
+			logging::loggingMessage(logging::LogType::WARNING, "Sky irradiance: the cube map is empty.");
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			return irradiance;
+		}
+
+		// Texels near the face corners cover a smaller solid angle, the weights sum to about 4 pi
+		std::vector<float> pixels((size_t)size * size * 3);
+		float basis[SH_COUNT];
+		float totalWeight = 0.0f;
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		for (int face = 0; face < 6; face++) {
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, pixels.data());
+			for (int y = 0; y < size; y++) {
+				for (int x = 0; x < size; x++) {
+					float u = (x + 0.5f) / size * 2.0f - 1.0f;
+					float v = (y + 0.5f) / size * 2.0f - 1.0f;
+					float distanceSquared = 1.0f + u * u + v * v;
+					float weight = 4.0f / (size * size * distanceSquared * std::sqrt(distanceSquared));
+					evaluateBasis(glm::normalize(getFaceDirection(face, u, v)), basis);
+					const float* texel = &pixels[((size_t)y * size + x) * 3];
+					glm::vec3 color(texel[0], texel[1], texel[2]);
+					for (int i = 0; i < SH_COUNT; i++) {
+						irradiance.coefficients[i] += color * (basis[i] * weight);
+					}
+					totalWeight += weight;
+				}
+			}
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		// Cosine lobe per band (pi, 2 pi / 3, pi / 4), divided by pi so a white sky gives 1
+		const float BAND_SCALES[SH_COUNT] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+		for (int i = 0; i < SH_COUNT; i++) {
+			irradiance.coefficients[i] *= 4.0f * PI / totalWeight * BAND_SCALES[i];
+		}
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		char line[128];
+		snprintf(line, sizeof(line), "Sky irradiance projected from %d x %d faces in %.2f ms.", size, size, elapsed);
+		logging::loggingMessage(logging::LogType::INFO, line);
+		return irradiance;
+	}
+
+	// Ambient color for a normal, the CPU side of getSkyAmbient().
+	glm::vec3 evaluate(const Irradiance& irradiance, const glm::vec3& normal) {
+		float basis[SH_COUNT];
+		evaluateBasis(normal, basis);
+		glm::vec3 result(0.0f);
+		for (int i = 0; i < SH_COUNT; i++) {
+			result += irradiance.coefficients[i] * basis[i];
+		}
+		return result;
+	}
+
+	void setUniforms(const Shader& shader, const Irradiance& irradiance) {
+		for (int i = 0; i < SH_COUNT; i++) {
+			shader.setVec3("skyIrradiance[" + std::to_string(i) + "]", irradiance.coefficients[i]);
+		}
+	}
+}
+
+#endif // !SKYLIGHT_H
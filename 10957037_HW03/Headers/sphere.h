@@ -0,0 +1,156 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <map>
+#include <cmath>
+
+namespace sphere {
+	// UV spheres are built from latitude x longitude bands, icospheres by subdividing an icosahedron.
+	enum SphereType {
+		UV_SPHERE,
+		ICO_SPHERE,
+	};
+
+	// Detail level of each LOD, from the finest (LOD 0) to the coarsest.
+	// UV sphere: bands per axis (30x30 = 1800 triangles ... 6x6 = 72 triangles).
+	// Icosphere: subdivision count (3 = 1280 triangles ... 0 = 20 triangles).
+	const unsigned int LOD_COUNT = 4;
+	const unsigned int UV_SEGMENTS[LOD_COUNT] = { 30, 18, 10, 6 };
+	const unsigned int ICO_SUBDIVISIONS[LOD_COUNT] = { 3, 2, 1, 0 };
+
+	// A sphere whose projected radius (in pixels) is above LOD_THRESHOLDS[i] uses LOD i.
+	const float LOD_THRESHOLDS[LOD_COUNT - 1] = { 64.0f, 20.0f, 6.0f };
+
+	// Push one vertex of the unit sphere: position, normal, texture coords.
+	void pushVertex(std::vector<float>& vertices, glm::vec3 position, float u, float v) {
+		glm::vec3 normal = glm::normalize(position);
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
+		vertices.push_back(normal.x);
+		vertices.push_back(normal.y);
+		vertices.push_back(normal.z);
+		vertices.push_back(u);
+		vertices.push_back(v);
+	}
+
+	// Generate a unit UV sphere with 8 floats per vertex.
+	void geneUVSphere(unsigned int latitude, unsigned int longitude, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+		vertices.clear();
+		indices.clear();
+
+		for (unsigned int i = 0; i <= latitude; i++) {
+			float theta = i * M_PI / latitude;
+			float sinTheta = sin(theta);
+			float cosTheta = cos(theta);
+			for (unsigned int j = 0; j <= longitude; j++) {
+				float phi = j * 2.0f * M_PI / longitude;
+				float sinPhi = sin(phi);
+				float cosPhi = cos(phi);
+
+				float u = 1.0f - ((float)j / longitude);
+				float v = 1.0f - ((float)i / latitude);
+				pushVertex(vertices, glm::vec3(cosPhi * sinTheta, cosTheta, sinPhi * sinTheta), u, -v);
+			}
+		}
+
+		for (unsigned int i = 0; i < latitude; i++) {
+			for (unsigned int j = 0; j < longitude; j++) {
+				unsigned int first = (i * (longitude + 1)) + j;
+				unsigned int second = first + longitude + 1;
+
+				indices.push_back(first);
+				indices.push_back(second);
+				indices.push_back(first + 1);
+
+				indices.push_back(second);
+				indices.push_back(second + 1);
+				indices.push_back(first + 1);
+			}
+		}
+	}
+
+	// Return the index of the normalized midpoint of edge (a, b), creating it only once per edge.
+	unsigned int getMidpoint(std::vector<glm::vec3>& positions, std::map<std::pair<unsigned int, unsigned int>, unsigned int>& cache, unsigned int a, unsigned int b) {
+		std::pair<unsigned int, unsigned int> key = (a < b) ? std::make_pair(a, b) : std::make_pair(b, a);
+		auto found = cache.find(key);
+		if (found != cache.end()) {
+			return found->second;
+		}
+
+		positions.push_back(glm::normalize((positions[a] + positions[b]) * 0.5f));
+		unsigned int index = positions.size() - 1;
+		cache[key] = index;
+		return index;
+	}
+
+	// Generate a unit icosphere with 8 floats per vertex, texture coords use the spherical mapping.
+	void geneIcosphere(unsigned int subdivisions, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+		vertices.clear();
+		indices.clear();
+
+		const float t = (1.0f + sqrt(5.0f)) / 2.0f;
+		std::vector<glm::vec3> positions = {
+			glm::vec3(-1.0f,  t, 0.0f), glm::vec3( 1.0f,  t, 0.0f), glm::vec3(-1.0f, -t, 0.0f), glm::vec3( 1.0f, -t, 0.0f),
+			glm::vec3(0.0f, -1.0f,  t), glm::vec3(0.0f,  1.0f,  t), glm::vec3(0.0f, -1.0f, -t), glm::vec3(0.0f,  1.0f, -t),
+			glm::vec3( t, 0.0f, -1.0f), glm::vec3( t, 0.0f,  1.0f), glm::vec3(-t, 0.0f, -1.0f), glm::vec3(-t, 0.0f,  1.0f),
+		};
+		for (unsigned int i = 0; i < positions.size(); i++) {
+			positions[i] = glm::normalize(positions[i]);
+		}
+
+		indices = {
+			0, 11, 5,	0, 5, 1,	0, 1, 7,	0, 7, 10,	0, 10, 11,
+			1, 5, 9,	5, 11, 4,	11, 10, 2,	10, 7, 6,	7, 1, 8,
+			3, 9, 4,	3, 4, 2,	3, 2, 6,	3, 6, 8,	3, 8, 9,
+			4, 9, 5,	2, 4, 11,	6, 2, 10,	8, 6, 7,	9, 8, 1,
+		};
+
+		for (unsigned int s = 0; s < subdivisions; s++) {
+			std::map<std::pair<unsigned int, unsigned int>, unsigned int> cache;
+			std::vector<unsigned int> refined;
+			for (unsigned int i = 0; i < indices.size(); i += 3) {
+				unsigned int a = getMidpoint(positions, cache, indices[i], indices[i + 1]);
+				unsigned int b = getMidpoint(positions, cache, indices[i + 1], indices[i + 2]);
+				unsigned int c = getMidpoint(positions, cache, indices[i + 2], indices[i]);
+
+				refined.insert(refined.end(), { indices[i], a, c });
+				refined.insert(refined.end(), { indices[i + 1], b, a });
+				refined.insert(refined.end(), { indices[i + 2], c, b });
+				refined.insert(refined.end(), { a, b, c });
+			}
+			indices = refined;
+		}
+
+		for (unsigned int i = 0; i < positions.size(); i++) {
+			float u = 0.5f + atan2(positions[i].z, positions[i].x) / (2.0f * M_PI);
+			float v = acos(positions[i].y) / M_PI;
+			pushVertex(vertices, positions[i], u, -v);
+		}
+	}
+
+	// Radius in pixels of a unit sphere transformed by model, view and projection.
+	float getProjectedRadius(glm::mat4 model, glm::mat4 view, glm::mat4 projection, float viewportHeight) {
+		float radius = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		glm::vec4 clip = projection * view * model[3];
+
+		// Perspective: w is the view-space depth; orthogonal: w stays 1.
+		float w = glm::max(clip.w, 0.0001f);
+		return radius * projection[1][1] / w * viewportHeight * 0.5f;
+	}
+
+	// Pick the LOD for a sphere of the given projected radius.
+	unsigned int selectLOD(float projectedRadius) {
+		for (unsigned int i = 0; i < LOD_COUNT - 1; i++) {
+			if (projectedRadius > LOD_THRESHOLDS[i]) {
+				return i;
+			}
+		}
+		return LOD_COUNT - 1;
+	}
+}
+
+#endif // !SPHERE_H
@@ -0,0 +1,208 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "../Headers/logging.h"
+#include "../Headers/platform.h"
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+// Fixed-size binary record per frame, appended to a memory-mapped file.
+// Tools/telemetry2csv.cpp converts a recording to CSV.
+namespace telemetry {
+	const char MAGIC[4] = { 'H', 'W', 'T', 'L' };
+	const uint32_t VERSION = 1;
+
+	// Records the file grows by when it is full.
+	const uint64_t GROW_RECORDS = 65536;
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t recordSize;
+		uint64_t recordCount;
+		int64_t startTime;	// unix time
+	};
+
+	struct FrameRecord {
+		uint32_t frameIndex;
+		float deltaTime;	// ms
+		uint32_t drawCalls;
+		uint32_t triangles;
+		uint32_t instancesDrawn;
+		uint32_t instancesCulled;
+		float rovPosition[3];
+		float rovYaw;		// deg
+		uint8_t cameraMode;		// 0 => follow camera, 1 => ghost camera
+		uint8_t viewportMode;	// currentScreen
+		uint8_t projectionMode;	// 0 => orthogonal, 1 => perspective
+		uint8_t reserved;
+	};
+
+	static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed");
+	static_assert(sizeof(FrameRecord) == 44, "FrameRecord layout changed");
+
+	class Recorder {
+	public:
+		Recorder() : data(NULL), count(0), capacity(0), mappedBytes(0) {
+#ifdef _WIN32
+			file = INVALID_HANDLE_VALUE;
+			mapping = NULL;
+#else
+			file = -1;
+#endif
+		}
+
+		~Recorder() {
+			close();
+		}
+
+		bool open(const std::string& path) {
+			close();
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+#else
+			file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (file < 0) {
+#endif
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to open telemetry file: " + path);
+				return false;
+			}
+			Path = path;
+			count = 0;
+			if (!map(GROW_RECORDS)) {
+				close();
+				return false;
+			}
+
+			FileHeader* header = getHeader();
+			memcpy(header->magic, MAGIC, sizeof(MAGIC));
+			header->version = VERSION;
+			header->headerSize = sizeof(FileHeader);
+			header->recordSize = sizeof(FrameRecord);
+			header->recordCount = 0;
+			header->startTime = (int64_t)std::time(0);
+			logging::loggingMessage(logging::LogType::INFO, "Recording telemetry to " + path);
+			return true;
+		}
+
+		bool isOpen() const {
+			return data != NULL;
+		}
+
+		uint64_t getRecordCount() const {
+			return count;
+		}
+
+		// Copy one record into the mapping, the OS writes it back to disk.
+		void append(const FrameRecord& record) {
+			if (!data) {
+				return;
+			}
+			if (count == capacity && !map(capacity + GROW_RECORDS)) {
+				close();
+				return;
+			}
+			memcpy(data + sizeof(FileHeader) + count * sizeof(FrameRecord), &record, sizeof(FrameRecord));
+			count++;
+			getHeader()->recordCount = count;
+		}
+
+		// Unmap and cut the file down to the records actually written.
+		void close() {
+			if (!isOpen() && !isFileOpen()) {
+				return;
+			}
+			uint64_t size = sizeof(FileHeader) + count * sizeof(FrameRecord);
+			unmap();
+#ifdef _WIN32
+			LARGE_INTEGER end;
+			end.QuadPart = (LONGLONG)size;
+			SetFilePointerEx(file, end, NULL, FILE_BEGIN);
+			SetEndOfFile(file);
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (ftruncate(file, (off_t)size) != 0) {
+				logging::loggingMessage(logging::LogType::WARNING, "Failed to trim telemetry file: " + Path);
+			}
+			::close(file);
+			file = -1;
+#endif
+			capacity = 0;
+		}
+
+		std::string Path;
+
+	private:
+		char* data;
+		uint64_t count;
+		uint64_t capacity;
+		uint64_t mappedBytes;
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int file;
+#endif
+
+		FileHeader* getHeader() const {
+			return (FileHeader*)data;
+		}
+
+		bool isFileOpen() const {
+#ifdef _WIN32
+			return file != INVALID_HANDLE_VALUE;
+#else
+			return file >= 0;
+#endif
+		}
+
+		// (Re)map the file large enough for the given number of records, keeping its content.
+		bool map(uint64_t records) {
+			unmap();
+			uint64_t bytes = sizeof(FileHeader) + records * sizeof(FrameRecord);
+#ifdef _WIN32
+			mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)(bytes & 0xFFFFFFFF), NULL);
+			if (mapping) {
+				data = (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)bytes);
+			}
+#else
+			if (ftruncate(file, (off_t)bytes) == 0) {
+				void* address = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+				data = (address == MAP_FAILED) ? NULL : (char*)address;
+			}
+#endif
+			if (!data) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to map telemetry file: " + Path);
+				return false;
+			}
+			capacity = records;
+			mappedBytes = bytes;
+			return true;
+		}
+
+		void unmap() {
+			if (data) {
+#ifdef _WIN32
+				UnmapViewOfFile(data);
+#else
+				munmap(data, mappedBytes);
+#endif
+				data = NULL;
+			}
+#ifdef _WIN32
+			if (mapping) {
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+#endif
+		}
+	};
+}
+
+#endif // !TELEMETRY_H
@@ -0,0 +1,163 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/chunks.h"
+#include "../Headers/frustum.h"
+#include "../Headers/mesh.h"
+#include "../Headers/shader.h"
+
+#include <cfloat>
+#include <vector>
+
+// CDLOD seabed: every chunk is the root of a small quadtree (64 m, 32 m and 16 m nodes), a node is drawn with one
+// shared grid mesh and the vertex shader reads its heights from the streamer's heightmap. A node at level l is used
+// up to Ranges[l] from the camera, its vertices morph into the grid of level l + 1 before that, so neighbors of
+// different levels meet without cracks. The detail follows the distance, not the far plane.
+namespace terrain {
+	const int GRID_SIZE = 16;	// quads per node side
+	const int LEVELS = 3;		// 4 m, 2 m and 1 m between vertices
+	const float MORPH_START = 0.66f;	// part of a level's range before its vertices start to morph
+	const int HEIGHT_TEXTURE_UNIT = 5;
+
+	// A node or the quarter of one (drawn with the half grid).
+	struct Node {
+		glm::vec2 origin;
+		float spacing;		// meters between vertices
+		int level;
+		bool isQuarter;
+	};
+
+	class Terrain {
+	public:
+		float Ranges[LEVELS];
+
+		Terrain() : gridMesh(MeshRegistry::INVALID_MESH), quarterMesh(MeshRegistry::INVALID_MESH) {
+			// Each range has to exceed the previous one by a node diagonal of its level
+			Ranges[0] = 40.0f;
+			Ranges[1] = 100.0f;
+			Ranges[2] = FLT_MAX;
+		}
+
+		// Grid vertices sit on integer coordinates (0 - GRID_SIZE), the shader scales them by the node spacing.
+		void init(MeshRegistry& registry) {
+			gridMesh = addGrid(registry, "Terrain Grid", GRID_SIZE);
+			quarterMesh = addGrid(registry, "Terrain Quarter", GRID_SIZE / 2);
+		}
+
+		// Pick the nodes around camera (the LOD center) that are inside the view.
+		void select(const chunks::Streamer& streamer, const glm::vec3& camera, const frustum::Frustum& view) {
+			nodes.clear();
+			for (const chunks::Chunk& chunk : streamer.getChunks()) {
+				if (chunk.isSurrounded) {
+					glm::vec3 origin = chunk.getOrigin();
+					selectNode(glm::vec2(origin.x, origin.z), chunks::CHUNK_SIZE, LEVELS - 1, camera, view);
+				}
+			}
+		}
+
+		// Shader uniforms that do not change between frames are set by setConstants().
+		void draw(Shader& shader, MeshRegistry& registry, unsigned int heightTexture, const glm::vec3& camera) {
+			glActiveTexture(GL_TEXTURE0 + HEIGHT_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_2D, heightTexture);
+			shader.setBool("isTerrain", true);
+			shader.setVec3("terrainCamera", camera);
+			for (const Node& node : nodes) {
+				shader.setVec3("terrainNode", glm::vec3(node.origin, node.spacing));
+				shader.setVec2("terrainMorph", getMorphRange(node.level));
+				registry.draw(node.isQuarter ? quarterMesh : gridMesh);
+			}
+			shader.setBool("isTerrain", false);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		void setConstants(Shader& shader) {
+			shader.use();
+			shader.setInt("terrainHeights", HEIGHT_TEXTURE_UNIT);
+			shader.setFloat("terrainHeightmapSize", (float)chunks::HEIGHTMAP_SIZE);
+			shader.setVec2("terrainHeightRange", glm::vec2(chunks::HEIGHT_MIN, chunks::HEIGHT_MAX));
+			shader.setFloat("terrainTextureTile", chunks::TEXTURE_TILE);
+		}
+
+		const std::vector<Node>& getNodes() const {
+			return nodes;
+		}
+
+		unsigned int getTriangleCount() const {
+			unsigned int count = 0;
+			for (const Node& node : nodes) {
+				count += node.isQuarter ? GRID_SIZE * GRID_SIZE / 2 : GRID_SIZE * GRID_SIZE * 2;
+			}
+			return count;
+		}
+
+	private:
+		unsigned int gridMesh;
+		unsigned int quarterMesh;
+		std::vector<Node> nodes;
+
+		unsigned int addGrid(MeshRegistry& registry, const std::string& name, int size) {
+			std::vector<float> vertices;
+			std::vector<unsigned int> indices;
+			for (int row = 0; row <= size; row++) {
+				for (int column = 0; column <= size; column++) {
+					vertices.insert(vertices.end(), { (float)column, 0.0f, (float)row, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f });
+				}
+			}
+			for (int row = 0; row < size; row++) {
+				for (int column = 0; column < size; column++) {
+					unsigned int corner = row * (size + 1) + column;
+					indices.insert(indices.end(), { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 });
+				}
+			}
+			return registry.add(name, vertices, indices);
+		}
+
+		// Morphing starts at MORPH_START of the way from the previous range and is complete at the level's own range.
+		glm::vec2 getMorphRange(int level) const {
+			if (level == LEVELS - 1) {
+				return glm::vec2(FLT_MAX / 2.0f, FLT_MAX);
+			}
+			float previous = (level > 0) ? Ranges[level - 1] : 0.0f;
+			return glm::vec2(previous + (Ranges[level] - previous) * MORPH_START, Ranges[level]);
+		}
+
+		static bool isInRange(const glm::vec2& origin, float size, const glm::vec3& camera, float range) {
+			glm::vec3 low(origin.x, chunks::HEIGHT_MIN, origin.y);
+			glm::vec3 high(origin.x + size, chunks::HEIGHT_MAX, origin.y + size);
+			glm::vec3 closest = glm::clamp(camera, low, high);
+			return glm::length(camera - closest) <= range;
+		}
+
+		// Returns false when the node is out of its range, the parent then covers that area itself.
+		bool selectNode(const glm::vec2& origin, float size, int level, const glm::vec3& camera, const frustum::Frustum& view) {
+			if (!isInRange(origin, size, camera, Ranges[level])) {
+				return false;
+			}
+			glm::vec3 center(origin.x + size / 2.0f, chunks::SEABED_HEIGHT, origin.y + size / 2.0f);
+			float radius = glm::length(glm::vec3(size / 2.0f, chunks::SEABED_RELIEF, size / 2.0f));
+			if (!frustum::intersectsSphere(view, center, radius)) {
+				return true;
+			}
+
+			float spacing = size / GRID_SIZE;
+			if (level == 0 || !isInRange(origin, size, camera, Ranges[level - 1])) {
+				nodes.push_back({ origin, spacing, level, false });
+				return true;
+			}
+			float half = size / 2.0f;
+			for (int i = 0; i < 4; i++) {
+				glm::vec2 childOrigin = origin + glm::vec2((i & 1) * half, (i >> 1) * half);
+				if (!selectNode(childOrigin, half, level - 1, camera, view)) {
+					nodes.push_back({ childOrigin, spacing, level, true });
+				}
+			}
+			return true;
+		}
+	};
+}
+
+#endif // !TERRAIN_H
@@ -0,0 +1,210 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../Headers/logging.h"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records nested zones of every thread for a number of frames and writes them as a
+// chrome://tracing (also loadable by Perfetto) JSON file, to find single-frame hitches.
+namespace trace {
+	struct Event {
+		std::string name;
+		double start;		// us since the recorder was created
+		double duration;	// us
+	};
+
+	// Events of one thread, only that thread appends to it.
+	struct ThreadBuffer {
+		unsigned int id;
+		std::string name;
+		std::mutex lock;
+		std::vector<Event> events;
+	};
+
+	struct OpenZone {
+		std::string name;
+		double start;
+		bool recording;
+	};
+
+	class Recorder {
+	public:
+		Recorder() : capturing(false), framesLeft(0), frameIndex(0), frameStart(0.0), epoch(std::chrono::steady_clock::now()) {}
+
+		// Start recording, the capture stops by itself after the given number of frames (0: until stop()).
+		void start(int frames) {
+			std::lock_guard<std::mutex> guard(buffersLock);
+			for (ThreadBuffer* buffer : buffers) {
+				std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+				buffer->events.clear();
+			}
+			framesLeft = frames;
+			frameIndex = 0;
+			frameStart = now();
+			capturing = true;
+		}
+
+		// Stop recording and write the file, returns its path.
+		std::string stop() {
+			if (!capturing) {
+				return "";
+			}
+			capturing = false;
+			LastFile = "trace_" + std::to_string(std::time(0)) + ".json";
+			write(LastFile);
+			return LastFile;
+		}
+
+		bool isCapturing() const {
+			return capturing;
+		}
+
+		int getFramesLeft() const {
+			return framesLeft;
+		}
+
+		// Close the current frame, call once per frame from the main thread.
+		void endFrame() {
+			if (!capturing) {
+				return;
+			}
+			double time = now();
+			ThreadBuffer& buffer = getBuffer();
+			std::unique_lock<std::mutex> guard(buffer.lock);
+			buffer.events.push_back({ "Frame " + std::to_string(frameIndex), frameStart, time - frameStart });
+			frameStart = time;
+			frameIndex++;
+			guard.unlock();
+			if (framesLeft > 0 && --framesLeft == 0) {
+				stop();
+			}
+		}
+
+		void begin(const std::string& name) {
+			std::vector<OpenZone>& stack = getStack();
+			if (capturing) {
+				stack.push_back({ name, now(), true });
+			} else {
+				stack.push_back({ std::string(), 0.0, false });
+			}
+		}
+
+		void end() {
+			std::vector<OpenZone>& stack = getStack();
+			if (stack.empty()) {
+				return;
+			}
+			OpenZone& zone = stack.back();
+			// Zones opened before the capture started are dropped.
+			if (zone.recording && capturing) {
+				ThreadBuffer& buffer = getBuffer();
+				std::lock_guard<std::mutex> guard(buffer.lock);
+				buffer.events.push_back({ zone.name, zone.start, now() - zone.start });
+			}
+			stack.pop_back();
+		}
+
+		// Name the calling thread in the trace.
+		void setThreadName(const std::string& name) {
+			ThreadBuffer& buffer = getBuffer();
+			std::lock_guard<std::mutex> guard(buffer.lock);
+			buffer.name = name;
+		}
+
+		std::string LastFile;
+
+	private:
+		std::atomic<bool> capturing;
+		int framesLeft;
+		int frameIndex;
+		double frameStart;
+		std::chrono::steady_clock::time_point epoch;
+		std::mutex buffersLock;
+		std::vector<ThreadBuffer*> buffers;
+
+		double now() const {
+			return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+		}
+
+		std::vector<OpenZone>& getStack() {
+			thread_local std::vector<OpenZone> stack;
+			return stack;
+		}
+
+		// Buffers live until the program exits, so they outlive their threads.
+		ThreadBuffer& getBuffer() {
+			thread_local ThreadBuffer* buffer = NULL;
+			if (!buffer) {
+				std::lock_guard<std::mutex> guard(buffersLock);
+				buffer = new ThreadBuffer();
+				buffer->id = buffers.size();
+				buffer->name = "Thread " + std::to_string(buffer->id);
+				buffers.push_back(buffer);
+			}
+			return *buffer;
+		}
+
+		static std::string escape(const std::string& text) {
+			std::string result;
+			for (char c : text) {
+				if (c == '"' || c == '\\') {
+					result += '\\';
+				}
+				result += c;
+			}
+			return result;
+		}
+
+		void write(const std::string& path) {
+			std::ofstream file(path);
+			if (!file) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to write trace file: " + path);
+				return;
+			}
+
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			bool first = true;
+			std::lock_guard<std::mutex> guard(buffersLock);
+			for (ThreadBuffer* buffer : buffers) {
+				std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+				file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->id
+					<< ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << escape(buffer->name) << "\"}}";
+				first = false;
+				for (const Event& event : buffer->events) {
+					file << ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->id << ",\"name\":\"" << escape(event.name)
+						<< "\",\"ts\":" << std::fixed << event.start << ",\"dur\":" << event.duration << "}";
+				}
+				buffer->events.clear();
+			}
+			file << "\n]}\n";
+			logging::loggingMessage(logging::LogType::INFO, "Trace written to " + path);
+		}
+	};
+
+	// The single recorder of the program.
+	Recorder& get() {
+		static Recorder instance;
+		return instance;
+	}
+
+	// Records everything until the end of the enclosing scope.
+	class Scope {
+	public:
+		Scope(const std::string& name) {
+			get().begin(name);
+		}
+
+		~Scope() {
+			get().end();
+		}
+	};
+}
+
+#endif // !TRACE_H
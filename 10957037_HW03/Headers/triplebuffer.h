@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free single-producer / single-consumer hand-over of the latest value.
+// The producer fills its own slot and swaps it with the middle one, the consumer swaps
+// the middle one with its own slot when something new was published.
+// Neither side ever waits, the consumer just keeps the newest value it has seen.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : writeIndex(0), middle(1), readIndex(2) {}
+
+	// Producer: the slot to fill before publish().
+	T& write() {
+		return slots[writeIndex];
+	}
+
+	void publish() {
+		writeIndex = middle.exchange(writeIndex | DIRTY, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer: the newest published value, or the last one if nothing new arrived.
+	const T& read() {
+		if (middle.load(std::memory_order_relaxed) & DIRTY) {
+			readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX;
+		}
+		return slots[readIndex];
+	}
+
+private:
+	static const unsigned int INDEX = 3;
+	static const unsigned int DIRTY = 4;
+
+	T slots[3];
+	unsigned int writeIndex;
+	std::atomic<unsigned int> middle;
+	unsigned int readIndex;
+};
+
+#endif // !TRIPLEBUFFER_H
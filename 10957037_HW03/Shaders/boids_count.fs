@@ -0,0 +1,6 @@
+#version 330 core
+out float Count;
+
+void main() {
+	Count = 1.0;
+}
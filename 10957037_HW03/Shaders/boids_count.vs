@@ -0,0 +1,13 @@
+#version 330 core
+
+// One point per fish onto the texel of its grid cell, additive blending counts them.
+uniform sampler2D keys;
+uniform int stateWidth;
+uniform int cellWidth;
+uniform vec2 cellTextureSize;
+
+void main() {
+	int cell = int(texelFetch(keys, ivec2(gl_VertexID % stateWidth, gl_VertexID / stateWidth), 0).x);
+	vec2 texel = vec2(cell % cellWidth, cell / cellWidth) + 0.5;
+	gl_Position = vec4(texel / cellTextureSize * 2.0 - 1.0, 0.0, 1.0);
+}
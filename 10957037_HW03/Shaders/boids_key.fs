@@ -0,0 +1,22 @@
+#version 330 core
+out vec2 Key;
+
+// Sort key of every fish: (grid cell, fish index), padding sorts to the end.
+uniform sampler2D positions;
+uniform int stateWidth;
+uniform int count;
+uniform vec3 gridOrigin;
+uniform vec3 gridCells;
+uniform float cellSize;
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.y * stateWidth + texel.x;
+	if (index >= count) {
+		Key = vec2(1e30, float(index));
+		return;
+	}
+	ivec3 cells = ivec3(gridCells);
+	ivec3 cell = clamp(ivec3((texelFetch(positions, texel, 0).xyz - gridOrigin) / cellSize), ivec3(0), cells - 1);
+	Key = vec2(float((cell.z * cells.y + cell.y) * cells.x + cell.x), float(index));
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout(location = 0) out vec4 SortedPosition;
+layout(location = 1) out vec4 SortedVelocity;
+
+// Copy the fish into sorted order, so the fish of a cell are next to each other.
+uniform sampler2D keys;
+uniform sampler2D positions;
+uniform sampler2D velocities;
+uniform int stateWidth;
+uniform int count;
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.y * stateWidth + texel.x;
+	if (index >= count) {
+		SortedPosition = vec4(0.0);
+		SortedVelocity = vec4(0.0);
+		return;
+	}
+	int fish = int(texelFetch(keys, texel, 0).y);
+	ivec2 source = ivec2(fish % stateWidth, fish / stateWidth);
+	SortedPosition = texelFetch(positions, source, 0);
+	SortedVelocity = texelFetch(velocities, source, 0);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+out float Sum;
+
+// One step of an inclusive Hillis-Steele prefix sum over the cell counts.
+uniform sampler2D counts;
+uniform int cellWidth;
+uniform int offset;
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.y * cellWidth + texel.x;
+	Sum = texelFetch(counts, texel, 0).r;
+	if (index >= offset) {
+		int other = index - offset;
+		Sum += texelFetch(counts, ivec2(other % cellWidth, other / cellWidth), 0).r;
+	}
+}
@@ -0,0 +1,25 @@
+#version 330 core
+out vec2 Key;
+
+// One compare-exchange step of a bitonic sort over (cell, index) keys.
+uniform sampler2D keys;
+uniform int stateWidth;
+uniform int blockSize;	// k, size of the sequences being merged
+uniform int compareDistance;	// j, distance of the compared pair
+
+bool isLess(vec2 a, vec2 b) {
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.y * stateWidth + texel.x;
+	int partner = index ^ compareDistance;
+	vec2 self = texelFetch(keys, texel, 0).xy;
+	vec2 other = texelFetch(keys, ivec2(partner % stateWidth, partner / stateWidth), 0).xy;
+
+	bool ascending = (index & blockSize) == 0;
+	bool isLower = index < partner;
+	bool keepSmaller = (isLower == ascending);
+	Key = (isLess(self, other) == keepSmaller) ? self : other;
+}
@@ -0,0 +1,109 @@
+#version 330 core
+layout(location = 0) out vec4 Position;
+layout(location = 1) out vec4 Velocity;
+
+// Same rules as boids::Flock::steer(), neighbors come from the sorted copies and the cell prefix sums.
+uniform sampler2D positions;
+uniform sampler2D velocities;
+uniform sampler2D sortedPositions;
+uniform sampler2D sortedVelocities;
+uniform sampler2D cellEnds;		// inclusive prefix sum of the cell counts
+uniform int stateWidth;
+uniform int count;
+uniform int cellWidth;
+uniform vec3 gridOrigin;
+uniform vec3 gridCells;
+uniform float cellSize;
+
+uniform float deltaTime;
+uniform vec3 obstacle;
+uniform float neighborRadius;
+uniform float separationRadius;
+uniform float separationWeight;
+uniform float alignmentWeight;
+uniform float cohesionWeight;
+uniform float avoidRadius;
+uniform float avoidWeight;
+uniform float boundsWeight;
+uniform float minSpeed;
+uniform float maxSpeed;
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+
+int cellEnd(int cell) {
+	return int(texelFetch(cellEnds, ivec2(cell % cellWidth, cell / cellWidth), 0).r);
+}
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.y * stateWidth + texel.x;
+	if (index >= count) {
+		Position = vec4(0.0);
+		Velocity = vec4(0.0);
+		return;
+	}
+	vec3 position = texelFetch(positions, texel, 0).xyz;
+	vec3 velocity = texelFetch(velocities, texel, 0).xyz;
+
+	float radius2 = neighborRadius * neighborRadius;
+	float separation2 = separationRadius * separationRadius;
+	float neighbors = 0.0;
+	vec3 center = vec3(0.0);
+	vec3 heading = vec3(0.0);
+	vec3 separation = vec3(0.0);
+
+	// 3 x 3 rows of 3 cells, each row is one contiguous run of sorted fish
+	ivec3 cells = ivec3(gridCells);
+	ivec3 cell = clamp(ivec3((position - gridOrigin) / cellSize), ivec3(0), cells - 1);
+	int first = max(cell.x - 1, 0);
+	int last = min(cell.x + 1, cells.x - 1);
+	for (int z = max(cell.z - 1, 0); z <= min(cell.z + 1, cells.z - 1); z++) {
+		for (int y = max(cell.y - 1, 0); y <= min(cell.y + 1, cells.y - 1); y++) {
+			int row = (z * cells.y + y) * cells.x;
+			int begin = (row + first > 0) ? cellEnd(row + first - 1) : 0;
+			int end = cellEnd(row + last);
+			for (int j = begin; j < end; j++) {
+				ivec2 other = ivec2(j % stateWidth, j / stateWidth);
+				vec3 otherPosition = texelFetch(sortedPositions, other, 0).xyz;
+				vec3 offset = otherPosition - position;
+				float d2 = dot(offset, offset);
+				// distance 0 is the fish itself
+				if (d2 >= radius2 || d2 <= 0.0) {
+					continue;
+				}
+				neighbors += 1.0;
+				center += otherPosition;
+				heading += texelFetch(sortedVelocities, other, 0).xyz;
+				if (d2 < separation2) {
+					separation -= offset / max(d2, 1e-4);
+				}
+			}
+		}
+	}
+
+	vec3 acceleration = vec3(0.0);
+	if (neighbors > 0.0) {
+		acceleration += (center / neighbors - position) * cohesionWeight;
+		acceleration += (heading / neighbors - velocity) * alignmentWeight;
+		acceleration += separation * separationWeight;
+	}
+
+	vec3 away = position - obstacle;
+	float awayDistance = length(away);
+	if (awayDistance < avoidRadius && awayDistance > 1e-4) {
+		acceleration += away / awayDistance * (1.0 - awayDistance / avoidRadius) * avoidWeight;
+	}
+
+	// Push back towards the inside once a fish leaves the bounds
+	acceleration += (max(boundsMin - position, vec3(0.0)) - max(position - boundsMax, vec3(0.0))) * boundsWeight;
+
+	velocity += acceleration * deltaTime;
+	float speed = length(velocity);
+	if (speed > 1e-4) {
+		velocity *= clamp(speed, minSpeed, maxSpeed) / speed;
+	}
+	position += velocity * deltaTime;
+
+	Position = vec4(position, 1.0);
+	Velocity = vec4(velocity, 0.0);
+}
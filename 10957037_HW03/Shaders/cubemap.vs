@@ -6,9 +6,10 @@ out vec3 TexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool isReversedDepth;	// the far plane is at z = 0 instead of z = w (see reversez.h)
 
 void main() {
     TexCoords = aPos;    
     vec4 pos = projection * view * model * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+    gl_Position = vec4(pos.xy, isReversedDepth ? 0.0 : pos.w, pos.w);
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D screenTexture;
+uniform vec2 texelSize;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+
+const float FXAA_SPAN_MAX = 8.0;
+const float FXAA_REDUCE_MUL = 1.0 / 8.0;
+const float FXAA_REDUCE_MIN = 1.0 / 128.0;
+
+// Sample inside the region of the current view only
+vec3 fetch(vec2 uv) {
+	vec2 uvMin = uvOffset + texelSize * 0.5;
+	vec2 uvMax = uvOffset + uvScale - texelSize * 0.5;
+	return texture(screenTexture, clamp(uv, uvMin, uvMax)).rgb;
+}
+
+void main() {
+	vec2 uv = uvOffset + TexCoords * uvScale;
+	vec3 luma = vec3(0.299, 0.587, 0.114);
+	vec3 rgbNW = fetch(uv + vec2(-1.0, -1.0) * texelSize);
+	vec3 rgbNE = fetch(uv + vec2( 1.0, -1.0) * texelSize);
+	vec3 rgbSW = fetch(uv + vec2(-1.0,  1.0) * texelSize);
+	vec3 rgbSE = fetch(uv + vec2( 1.0,  1.0) * texelSize);
+	vec3 rgbM = fetch(uv);
+
+	float lumaNW = dot(rgbNW, luma);
+	float lumaNE = dot(rgbNE, luma);
+	float lumaSW = dot(rgbSW, luma);
+	float lumaSE = dot(rgbSE, luma);
+	float lumaM = dot(rgbM, luma);
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+	// Blur along the edge direction
+	vec2 dir;
+	dir.x = -((lumaNW + lumaNE) - (lumaSW + lumaSE));
+	dir.y = ((lumaNW + lumaSW) - (lumaNE + lumaSE));
+	float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25 * FXAA_REDUCE_MUL), FXAA_REDUCE_MIN);
+	float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+	dir = clamp(dir * rcpDirMin, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * texelSize;
+
+	vec3 rgbA = 0.5 * (
+		fetch(uv + dir * (1.0 / 3.0 - 0.5)) +
+		fetch(uv + dir * (2.0 / 3.0 - 0.5)));
+	vec3 rgbB = rgbA * 0.5 + 0.25 * (
+		fetch(uv + dir * -0.5) +
+		fetch(uv + dir * 0.5));
+
+	// Fall back to the narrower blur if the wide one leaves the local luma range
+	float lumaB = dot(rgbB, luma);
+	if (lumaB < lumaMin || lumaB > lumaMax) {
+		FragColor = vec4(rgbA, 1.0);
+	} else {
+		FragColor = vec4(rgbB, 1.0);
+	}
+}
\ No newline at end of file
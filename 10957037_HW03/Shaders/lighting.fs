@@ -29,31 +29,129 @@ uniform bool enableTexture;
 uniform float alpha;
 uniform vec3 color;
 uniform vec3 viewPos;
+uniform vec3 sunDirection;	// unit vector towards the sun, light.position is the sun marker near the ROV
 uniform Material material;
 uniform Light light;
 
 uniform bool isCubeMap;
 uniform samplerCube skybox;
 
+// Diffuse sky light as 9 spherical harmonics (see skylight.h)
+uniform bool useSkyAmbient;
+uniform vec3 skyIrradiance[9];
+
+vec3 getSkyAmbient(vec3 n) {
+	return skyIrradiance[0] * 0.282095
+		+ skyIrradiance[1] * 0.488603 * n.y
+		+ skyIrradiance[2] * 0.488603 * n.z
+		+ skyIrradiance[3] * 0.488603 * n.x
+		+ skyIrradiance[4] * 1.092548 * n.x * n.y
+		+ skyIrradiance[5] * 1.092548 * n.y * n.z
+		+ skyIrradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ skyIrradiance[7] * 1.092548 * n.x * n.z
+		+ skyIrradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Sun shadows from cascaded maps (see shadows.h), the first cascade whose map covers the point is used
+uniform bool useShadows;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform float shadowTexelSizes[4];	// meters, the point is pushed this far out along its normal (times 1.5)
+
+float getShadow(vec3 position, vec3 normal) {
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	for (int i = 0; i < 4; i++) {
+		vec4 coords = shadowMatrices[i] * vec4(position + normal * shadowTexelSizes[i] * 1.5, 1.0);
+		if (all(greaterThan(coords.xy, texel)) && all(lessThan(coords.xy, 1.0 - texel)) && coords.z < 1.0) {
+			// 4 bilinear comparisons, a 3 x 3 texel footprint
+			float lit = texture(shadowMap, vec4(coords.xy + vec2(-0.5, -0.5) * texel, i, coords.z))
+				+ texture(shadowMap, vec4(coords.xy + vec2(0.5, -0.5) * texel, i, coords.z))
+				+ texture(shadowMap, vec4(coords.xy + vec2(-0.5, 0.5) * texel, i, coords.z))
+				+ texture(shadowMap, vec4(coords.xy + vec2(0.5, 0.5) * texel, i, coords.z));
+			return lit / 4.0;
+		}
+	}
+	return 1.0;
+}
+
+// Point and spot lights binned into clusters of the view (see clusters.h), only the lights of the fragment's cluster are looped
+uniform bool useClusteredLights;
+uniform bool showClusterHeat;
+uniform samplerBuffer clusterLights;	// 3 texels per light: position and range, color and inner cone cos, direction and outer cone cos
+uniform usamplerBuffer clusterRanges;	// first index and count of every cluster
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterGrid;
+uniform vec3 clusterDepths;	// end of the first slice, slices per log depth, end of the last slice
+uniform mat4 view;
+uniform mat4 projection;
+
+int getCluster(vec3 position) {
+	vec4 viewPosition = view * vec4(position, 1.0);
+	float depth = -viewPosition.z;
+	if (depth > clusterDepths.z) {
+		return -1;
+	}
+	vec4 clip = projection * viewPosition;
+	ivec2 tile = ivec2(clamp(clip.xy / clip.w * 0.5 + 0.5, 0.0, 0.9999) * clusterGrid.xy);
+	int slice = (depth < clusterDepths.x) ? 0 : min(1 + int(log(depth / clusterDepths.x) * clusterDepths.y), int(clusterGrid.z) - 1);
+	return (slice * int(clusterGrid.y) + tile.y) * int(clusterGrid.x) + tile.x;
+}
+
+// Diffuse and specular of the cluster lights, count is how many were looped
+vec3 getClusteredLight(vec3 position, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, out int count) {
+	count = 0;
+	int cluster = getCluster(position);
+	if (cluster < 0) {
+		return vec3(0.0);
+	}
+	uvec2 range = texelFetch(clusterRanges, cluster).xy;
+	count = int(range.y);
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < count; i++) {
+		int light = int(texelFetch(clusterIndices, int(range.x) + i).x) * 3;
+		vec4 positionRange = texelFetch(clusterLights, light);
+		vec3 toLight = positionRange.xyz - position;
+		float distanceSquared = dot(toLight, toLight);
+		if (distanceSquared >= positionRange.w * positionRange.w) {
+			continue;
+		}
+		vec4 colorInner = texelFetch(clusterLights, light + 1);
+		vec4 directionOuter = texelFetch(clusterLights, light + 2);
+		vec3 lightDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+
+		// Inverse square falloff windowed to reach zero at the range
+		float window = clamp(1.0 - pow(distanceSquared / (positionRange.w * positionRange.w), 2.0), 0.0, 1.0);
+		float attenuation = window * window / (1.0 + distanceSquared);
+		attenuation *= smoothstep(directionOuter.w, colorInner.w, dot(-lightDir, directionOuter.xyz));
+
+		float diff = max(dot(normal, lightDir), 0.0);
+		float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), material.shininess);
+		result += colorInner.rgb * attenuation * (diff * albedo + spec * specularColor);
+	}
+	return result;
+}
+
 void main() {
 	
 	vec4 texture_diffuse;
 	vec4 texture_specular;
 
+	// The sky is not lit, only dimmed by the height of the sun: one sample and done
 	if (isCubeMap) {
-		// ĥ cubemap
-        texture_diffuse = texture(skybox, normalize(NaviePos));
-        texture_specular = texture(skybox, normalize(NaviePos));
+		float height = max(dot(vec3(0.0, 1.0, 0.0), sunDirection), 0.1);
+		vec4 sky = texture(skybox, normalize(NaviePos));
+		FragColor = vec4(height * sky.rgb, sky.a);
+		return;
+	}
+
+	if (enableTexture) {
+		// ϥΧø
+		texture_diffuse = texture(material.diffuse, TextureCoords);
+		texture_specular = texture(material.specular, TextureCoords);
 	} else {
-		if (enableTexture) {
-			// ϥΧø
-			texture_diffuse = texture(material.diffuse, TextureCoords);
-			texture_specular = texture(material.specular, TextureCoords);
-		} else {
-			// ¦
-			texture_diffuse = vec4(color, alpha);
-			texture_specular = vec4(color, alpha);
-		}
+		// ¦
+		texture_diffuse = vec4(color, alpha);
+		texture_specular = vec4(color, alpha);
 	}
 
 	FragColor = texture_diffuse;
@@ -91,19 +189,26 @@ void main() {
 		float distance = length(light.position - FragPos);
 		float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-		vec3 sunDir = normalize(vec3(light.position.x, light.position.y, light.position.z));
-		float t = max(dot(vec3(0.0, 1.0, 0.0), sunDir), 0.1);
-		if (!isCubeMap) {
-			ambient = vec3(t, t, t) * temp.rgb;
-			diffuse *= attenuation;
-			specular *= attenuation;
-        } else {
-			ambient = vec3(t, t, t) * temp.rgb;
-			diffuse *= 0.0;
-			specular *= 0.0;
-        }
+		float t = max(dot(vec3(0.0, 1.0, 0.0), sunDirection), 0.1);
+		ambient = useSkyAmbient ? t * getSkyAmbient(norm) * temp.rgb : vec3(t, t, t) * temp.rgb;
+		diffuse *= attenuation;
+		specular *= attenuation;
+		if (useShadows) {
+			float shadow = getShadow(FragPos, norm);
+			diffuse *= shadow;
+			specular *= shadow;
+		}
 
 		vec3 result = ambient + diffuse + specular;
+		if (useClusteredLights) {
+			int count;
+			result += getClusteredLight(FragPos, norm, viewDir, temp.rgb, texture_specular.rgb, count);
+			if (showClusterHeat) {
+				// Blue for a few lights up to red for 32 or more
+				float heat = clamp(float(count) / 32.0, 0.0, 1.0);
+				result = mix(result, vec3(heat, 1.0 - abs(heat * 2.0 - 1.0), 1.0 - heat), 0.5);
+			}
+		}
 		FragColor = vec4(result, temp.a);
 	}
 }
\ No newline at end of file
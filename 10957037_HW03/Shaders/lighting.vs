@@ -9,21 +9,104 @@ out vec3 Normal;
 out vec2 TextureCoords;
 
 uniform mat4 model;
+uniform mat3 normalMatrix;
 uniform mat4 view;
 uniform mat4 projection;
 uniform bool isCubeMap;
+uniform bool isReversedDepth;	// the far plane is at z = 0 instead of z = w (see reversez.h)
+
+// Fish simulated on the GPU (boids::GpuFlock), one instance per texel of the state textures
+uniform bool isFishInstanced;
+uniform sampler2D fishPositions;
+uniform sampler2D fishPreviousPositions;	// before the last fixed step
+uniform sampler2D fishVelocities;
+uniform int fishStateWidth;
+uniform float fishAlpha;	// how far the frame is between the last two steps
+
+// Same transform as the CPU fish: face the velocity, scale (1, 0.5, 0.5), centered quad.
+void getFishTransform(out vec3 position, out mat3 rotation) {
+	ivec2 texel = ivec2(gl_InstanceID % fishStateWidth, gl_InstanceID / fishStateWidth);
+	position = mix(texelFetch(fishPreviousPositions, texel, 0).xyz, texelFetch(fishPositions, texel, 0).xyz, fishAlpha);
+	vec3 velocity = texelFetch(fishVelocities, texel, 0).xyz;
+	float yaw = atan(-velocity.z, velocity.x);
+	float pitch = asin(clamp(velocity.y / max(length(velocity), 1e-4), -1.0, 1.0));
+	mat3 yawRotation = mat3(cos(yaw), 0.0, -sin(yaw), 0.0, 1.0, 0.0, sin(yaw), 0.0, cos(yaw));
+	mat3 pitchRotation = mat3(cos(pitch), sin(pitch), 0.0, -sin(pitch), cos(pitch), 0.0, 0.0, 0.0, 1.0);
+	rotation = yawRotation * pitchRotation;
+}
+
+// CDLOD seabed (terrain::Terrain), aPosition.xz is the integer grid position inside the node
+uniform bool isTerrain;
+uniform sampler2D terrainHeights;	// 16-bit, toroidal, texel x holds the height at world meter x
+uniform float terrainHeightmapSize;
+uniform vec2 terrainHeightRange;	// heights of texel values 0 and 1
+uniform float terrainTextureTile;
+uniform vec3 terrainNode;			// node origin (x, z) and meters between vertices
+uniform vec2 terrainMorph;			// camera distance where morphing starts and where it is complete
+uniform vec3 terrainCamera;
+
+// Scene file instances (scene::GpuScene), texel sceneFirstInstance + gl_InstanceID holds position and uniform scale
+uniform bool isSceneInstanced;
+uniform samplerBuffer sceneInstances;
+uniform int sceneFirstInstance;
+
+// Shadow casters (shadows::CasterBatches), texels 4 * (matrixFirstInstance + gl_InstanceID) onward hold the model matrix
+uniform bool isMatrixInstanced;
+uniform samplerBuffer matrixInstances;
+uniform int matrixFirstInstance;
+
+float getTerrainHeight(vec2 position) {
+	return mix(terrainHeightRange.x, terrainHeightRange.y, texture(terrainHeights, (position + 0.5) / terrainHeightmapSize).r);
+}
+
+// Odd grid vertices slide onto the next coarser grid as the camera moves away.
+void getTerrainVertex(out vec3 position, out vec3 normal) {
+	vec2 grid = aPosition.xz;
+	vec2 world = terrainNode.xy + grid * terrainNode.z;
+	float distanceToCamera = length(vec3(world.x, getTerrainHeight(world), world.y) - terrainCamera);
+	float morph = clamp((distanceToCamera - terrainMorph.x) / (terrainMorph.y - terrainMorph.x), 0.0, 1.0);
+	world -= fract(grid * 0.5) * 2.0 * terrainNode.z * morph;
+	position = vec3(world.x, getTerrainHeight(world), world.y);
+
+	float left = getTerrainHeight(world - vec2(1.0, 0.0));
+	float right = getTerrainHeight(world + vec2(1.0, 0.0));
+	float back = getTerrainHeight(world - vec2(0.0, 1.0));
+	float front = getTerrainHeight(world + vec2(0.0, 1.0));
+	normal = normalize(vec3(left - right, 2.0, back - front));
+}
 
 void main() {
 	NaviePos = aPosition;
-	FragPos =  vec3(model * vec4(aPosition, 1.0));
-	Normal = mat3(transpose(inverse(model))) * aNormal;
 	TextureCoords = aTextureCoords;
+	if (isFishInstanced) {
+		vec3 position;
+		mat3 rotation;
+		getFishTransform(position, rotation);
+		FragPos = position + rotation * ((aPosition - vec3(0.5, 0.5, 0.0)) * vec3(1.0, 0.5, 0.5));
+		Normal = rotation * (aNormal * vec3(1.0, 2.0, 2.0));
+	} else if (isTerrain) {
+		getTerrainVertex(FragPos, Normal);
+		TextureCoords = FragPos.xz / terrainTextureTile;
+	} else if (isSceneInstanced) {
+		vec4 instance = texelFetch(sceneInstances, sceneFirstInstance + gl_InstanceID);
+		FragPos = instance.xyz + aPosition * instance.w;
+		Normal = aNormal;
+	} else if (isMatrixInstanced) {
+		int texel = (matrixFirstInstance + gl_InstanceID) * 4;
+		mat4 instanceModel = mat4(texelFetch(matrixInstances, texel), texelFetch(matrixInstances, texel + 1),
+			texelFetch(matrixInstances, texel + 2), texelFetch(matrixInstances, texel + 3));
+		FragPos = vec3(instanceModel * vec4(aPosition, 1.0));
+		Normal = mat3(instanceModel) * aNormal;
+	} else {
+		FragPos =  vec3(model * vec4(aPosition, 1.0));
+		Normal = normalMatrix * aNormal;
+	}
 
 	if (isCubeMap) {
 		// øsѪŲ
 		mat4 view_new = mat4(mat3(view));
 		vec4 pos = projection * view_new * vec4(FragPos, 1.0);
-		gl_Position = pos.xyww;
+		gl_Position = vec4(pos.xy, isReversedDepth ? 0.0 : pos.w, pos.w);
 	} else {
 		gl_Position = projection * view * vec4(FragPos, 1.0);
 	}
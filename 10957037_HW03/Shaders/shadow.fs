@@ -0,0 +1,13 @@
+#version 330 core
+
+// Depth only (shadows::CascadedShadows), textured casters are cut out where they are transparent
+in vec2 TextureCoords;
+
+uniform bool enableTexture;
+uniform sampler2D diffuseTexture;
+
+void main() {
+	if (enableTexture && texture(diffuseTexture, TextureCoords).a < 0.1) {
+		discard;
+	}
+}
\ No newline at end of file
@@ -1,2 +1,6 @@
+// SSE2 is picked up on x86 by itself, NEON has to be asked for
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define STBI_NEON
+#endif
 #define STB_IMAGE_IMPLEMENTATION
-#include "../Headers/stb_image.h"
\ No newline at end of file
+#include "../Headers/stb_image.h"
@@ -17,12 +17,44 @@
 #include "../Headers/shader.h"
 #include "../Headers/camera.h"
 #include "../Headers/followcamera.h"
+#include "../Headers/sphere.h"
+#include "../Headers/mesh.h"
+#include "../Headers/antialiasing.h"
+#include "../Headers/dynamicresolution.h"
+#include "../Headers/profiler.h"
+#include "../Headers/trace.h"
+#include "../Headers/telemetry.h"
+#include "../Headers/fixedtimestep.h"
+#include "../Headers/triplebuffer.h"
+#include "../Headers/jobs.h"
+#include "../Headers/frustum.h"
+#include "../Headers/reversez.h"
+#include "../Headers/boids.h"
+#include "../Headers/collision.h"
+#include "../Headers/chunks.h"
+#include "../Headers/terrain.h"
+#include "../Headers/gpuboids.h"
+#include "../Headers/scene.h"
+#include "../Headers/cookedtexture.h"
+#include "../Headers/assets.h"
+#include "../Headers/mipchain.h"
+#include "../Headers/skylight.h"
+#include "../Headers/shadows.h"
+#include "../Headers/clusters.h"
 
 #include <vector>
 #include <iostream>
 #include <cmath>
 #include <ctime>
 #include <random>
+#include <cfloat>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
 
 enum ROV_Movement {
 	ROV_FORWARD,
@@ -42,6 +74,89 @@ enum Monitor {
 	Monitor_Result,
 };
 
+// Render passes timed by the profiler
+enum Pass {
+	PASS_SIMULATION,
+	PASS_FISH_UPDATE,
+	PASS_INSTANCE_MATRICES,
+	PASS_CULLING,
+	PASS_CHUNK_STREAMING,
+	PASS_SHADOWS,
+	PASS_LIGHTS,
+	PASS_VIEW_SETUP,
+	PASS_AXES,
+	PASS_SKYBOX,
+	PASS_SEA_SAND,
+	PASS_GRASS,
+	PASS_FISH,
+	PASS_BOXES,
+	PASS_SCENE,
+	PASS_GLOW,
+	PASS_ROV,
+	PASS_CAMERA,
+	PASS_VIEW_VOLUME,
+	PASS_SUN,
+	PASS_PRESENT,
+	PASS_IMGUI,
+	PASS_COUNT,
+};
+const char* const PASS_NAMES[PASS_COUNT] = {
+	"Simulation", "Fish Update", "Instance Matrices", "Culling", "Chunk Streaming", "Shadows", "Lights", "View Setup", "Axes", "Skybox", "Sea / Sand", "Grass", "Fish", "Boxes", "Scene", "Glow Props", "ROV", "Camera", "View Volume", "Sun", "Present", "ImGui",
+};
+
+// Everything the fixed-timestep simulation advances, rendering interpolates between two of these.
+struct SimState {
+	float time;
+	glm::vec3 rovPosition;
+	float rovYaw;
+	float rovEngineAngle;
+	glm::vec3 rovFront;
+	glm::vec3 rovRight;
+	glm::vec3 cameraPosition;
+	glm::vec3 sunPosition;	// where the sun marker is drawn, follows the ROV
+	glm::vec3 sunDirection;	// unit vector towards the sun, for the lighting and the shadows
+};
+
+// Input sampled on the main thread (GLFW only allows polling there) for the simulation thread.
+struct SimInput {
+	bool isGhost;
+	unsigned int keys;	// bit per ROV_Movement, or per Camera_Movement in ghost mode
+	float rovSpeed;
+	float cameraSpeed;
+	glm::vec3 cameraFront;
+	glm::vec3 cameraRight;
+	bool isFishSimulated;	// the CPU flock steps with the simulation, off while the GPU flock runs
+	int fishCount;
+	boids::Params fishSettings;	// bounds are set around the ROV by the simulation
+};
+
+// Published by the simulation thread after every batch of steps.
+struct WorldSnapshot {
+	SimState previous;
+	SimState current;
+	double stepTime;	// glfwGetTime() at which current is reached
+	unsigned int steps;
+	float stepCost;		// ms of the last step
+	float collisionCost;	// us spent resolving ROV collisions in the last step
+	unsigned int collisionCandidates;
+	unsigned int collisionBoxes;
+	// CPU fish in slot order at previous and at current, empty while the GPU flock runs
+	std::vector<glm::vec3> fishPrevious;
+	std::vector<glm::vec3> fishCurrent;
+	std::vector<glm::vec3> fishVelocities;
+	float flockGridTime;	// ms
+	float flockSteerTime;	// ms
+};
+
+// Many copies of one mesh, their model matrices are built and culled on the job system.
+struct InstanceGroup {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::mat4> matrices;
+	std::vector<unsigned char> visible;
+	glm::vec3 boundCenter;	// model space bounding sphere of the mesh
+	float boundRadius;
+};
+
 void showUI();
 void setViewMatrix(int type);
 void setProjectionMatrix(int type);
@@ -58,20 +173,39 @@ void drawBox();
 void drawROV(Shader shader);
 void drawCamera(Shader shader);
 void drawAxis(Shader shader);
-void processROV(ROV_Movement direction, float deltaTime);
-void checkNoGetOut();
+void processROV(ROV_Movement direction, float speed, float deltaTime);
 void updateROVFront();
+SimState captureSimState(float time);
+float interpolateAngle(float previous, float current, float alpha);
+SimState interpolateSimState(const SimState& previous, const SimState& current, float alpha);
+void buildInstanceMatrices(float time);
+unsigned int cullInstances(const glm::mat4& viewProjection);
+void renderShadows(Shader& shader);
+void drawGpuFish(Shader& shader);
+void updateLights(float time);
+void drawGlowProps(Shader& shader);
 void drawSphere();
+void setModelMatrix(Shader& shader, glm::mat4 matrix);
 void setFullScreen();
 void frameBufferSizeCallback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+void gatherChunkInstances();
+void updateCollisionWorld(const glm::vec3& center);
+boids::Params getSchoolSettings(boids::Params settings, const glm::vec3& center);
+void simulate(const SimInput& input, float step, float time);
+void simulationLoop();
+void buildDemoScene(scene::Writer& writer, unsigned int count);
+void benchmarkScene(unsigned int count);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void scrollCallback(GLFWwindow* window, double xpos, double ypos);
 void errorCallback(int error, const char* description);
 unsigned int loadTexture(char const* path);
+bool loadCookedTexture(GLenum target, const std::string& source, bool isMipmapped, int& channels);
+bool isTextureFormatSupported(GLenum format);
 unsigned int loadCubemap(std::vector<std::string> faces);
+void uploadMipChain(GLenum target, const mipchain::Chain& chain);
 glm::mat4 GetPerspectiveProjMatrix(float fovy, float ascept, float znear, float zfar);
 glm::mat4 GetOrthoProjMatrix(float left, float right, float bottom, float top, float near, float far);
 
@@ -97,6 +231,61 @@ glm::mat4 projection = glm::mat4(1.0f);
 // Time parameters
 float deltaTime = 0.0f;
 float lastTime = 0.0f;
+const int FRAME_HISTORY = 120;
+float frameTimeHistory[FRAME_HISTORY] = { 0.0f };
+int frameTimeOffset = 0;
+float modeFrameTime[antialiasing::MODE_COUNT] = { 0.0f };
+int traceFrames = 120;
+
+// Simulation thread (fixed 120 Hz steps), it owns the ROV state and simCameraPosition.
+// Input goes in and world snapshots come out through lock-free triple buffers.
+const float SIM_RATE = 120.0f;
+const unsigned int SIM_JOB_QUEUE = 1;	// its flock jobs do not go onto the main thread's queue
+std::atomic<bool> simRunning(false);
+TripleBuffer<SimInput> simInputBuffer;
+TripleBuffer<WorldSnapshot> worldBuffer;
+glm::vec3 simCameraPosition;
+const WorldSnapshot* world = NULL;	// newest snapshot, valid until the next read
+SimState renderState;
+float simAlpha = 0.0f;
+
+// Telemetry (one binary record per frame)
+telemetry::Recorder telemetryRecorder;
+unsigned int frameIndex = 0;
+unsigned int instancesDrawn = 0;
+unsigned int instancesCulled = 0;
+
+// Instanced scene objects (the plane mesh spans [0, 1] x [0, 1], the cube +-0.5)
+const unsigned int INSTANCE_GRAIN = 64;
+InstanceGroup grassInstances{ {}, {}, {}, glm::vec3(0.5f, 0.5f, 0.0f), 0.71f };
+InstanceGroup fishInstances{ {}, {}, {}, glm::vec3(0.5f, 0.5f, 0.0f), 0.71f };
+InstanceGroup boxInstances{ {}, {}, {}, glm::vec3(0.0f), 0.87f };
+
+// Fish school (boids), simulated by the job system (CPU) or by shader passes (GPU)
+enum FishBackend {
+	FISH_CPU,
+	FISH_GPU,
+};
+boids::Flock flock;	// stepped by the simulation thread
+boids::GpuFlock gpuFlock;
+FixedTimestep gpuFlockClock(SIM_RATE, 4);	// main thread, the GPU flock steps at the simulation rate too
+boids::Params fishSettings;
+boids::Flock fishTransfer;	// main thread, fish on their way to or from the GPU
+std::mutex fishHandoffLock;
+boids::Flock fishHandoff;	// GPU fish for the simulation thread after switching back to the CPU
+bool hasFishHandoff = false;
+std::vector<glm::vec3> simFishPrevious;	// simulation thread, the fish before the last step
+int fishCount = 300;
+int fishBackend = FishBackend::FISH_CPU;
+int activeFishBackend = FishBackend::FISH_CPU;
+bool validateGpuFlock = false;
+float gpuFlockError = -1.0f;
+
+// Anti-aliasing and render scale
+antialiasing::RenderTarget renderTarget;
+static int aaMode = antialiasing::AntiAliasingMode::AA_OFF;
+static float renderScale = 1.0f;
+DynamicResolution dynamicResolution;
 
 // ROV Parameter
 static float ROVMovementSpeed = 5.0f;
@@ -107,6 +296,34 @@ glm::vec3 FollowCamearaPosition = glm::vec3(0.0f, 0.0f, 6.0f);
 glm::vec3 ROVFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 ROVRight = glm::vec3(1.0f, 0.0f, 0.0f);
 
+// Streamed seabed, drawn as CDLOD terrain over the chunks whose neighbors are loaded too,
+// the grass and box instances are gathered from the same chunks
+const int STREAM_RADIUS = 3;
+const unsigned int GRASS_PER_CHUNK = 96;
+chunks::Streamer seabedStreamer;
+terrain::Terrain seabedTerrain;
+unsigned int gatheredChunkVersion = 0xFFFFFFFF;
+
+// ROV collision against the boxes and the seabed, the simulation thread owns the world and
+// rebuilds it from the chunks around the ROV (same scatter as the streamer, so it matches what is drawn).
+// The ROV is a chain of spheres along its body plus one on the hand.
+collision::World collisionWorld;
+int collisionChunkX = 0x7FFFFFFF;
+int collisionChunkZ = 0x7FFFFFFF;
+std::vector<collision::Sphere> ROVShape = {
+	{ glm::vec3(0.0f, -0.1f, -0.5f), 0.5f },
+	{ glm::vec3(0.0f, -0.1f, 0.0f), 0.5f },
+	{ glm::vec3(0.0f, -0.1f, 0.5f), 0.5f },
+	{ glm::vec3(0.0f, -0.8f, -1.3f), 0.15f },
+};
+int boxCount = 20;
+float collisionCost = 0.0f;
+
+// Content from a binary scene file ("--scene FILE"), drawn next to the built-in objects.
+// "--export-scene FILE N" writes a demo scene of N instances spread over +-SCENE_EXTENT meters.
+const float SCENE_EXTENT = 1000.0f;
+scene::GpuScene loadedScene;
+
 // Camera parameter
 bool isGhost = false;
 Camera camera(glm::vec3(0.0f, 2.0f, 10.0f));
@@ -129,54 +346,179 @@ static float global_bottom = 0.0f;
 static float global_top = 0.0f;
 static float global_near = 0.1f;
 static float global_far = 250.0f;
+const float MAX_FAR = 250.0f;
+const float MAX_REVERSED_FAR = 5000.0f;
 std::vector <glm::vec4> nearPlaneVertex;
 std::vector <glm::vec4> farPlaneVertex;
 
 // 0 => x-ortho, 1 => y-ortho, 2 => z-ortho, 3 => main-camera(perspective), 4 => all
 static int currentScreen = 4;
 static float distanceOrthoCamera = 5.0;
+unsigned int viewportHeight = SCR_HEIGHT;
 
 // Light Parameters
 glm::vec3 lightPosition = glm::vec3(90.0f, 0.0f, 0.0f);
+glm::vec3 sunDirection = glm::vec3(1.0f, 0.0f, 0.0f);
+
+// Object Data (every mesh lives in the arena of meshRegistry)
+MeshRegistry meshRegistry;
 
-// Object Data
 std::vector<float> cubeVertices;
-std::vector<int> cubeIndices;
-unsigned int cubeVAO, cubeVBO, cubeEBO;
+std::vector<unsigned int> cubeIndices;
+unsigned int cubeMesh;
 
 std::vector<float> floorVertices;
 std::vector<unsigned int> floorIndices;
-unsigned int floorVAO, floorVBO, floorEBO;
+unsigned int floorMesh;
 
 std::vector<float> planeVertices;
-unsigned int planeVAO, planeVBO;
+unsigned int planeMesh;
 
-std::vector<float> sphereVertices;
-std::vector<unsigned int> sphereIndices;
-unsigned int sphereVAO, sphereVBO, sphereEBO;
+// Sphere LODs of each sphere::SphereType (index 0 is the finest)
+unsigned int sphereMesh[2][sphere::LOD_COUNT];
+static int sphereType = sphere::SphereType::UV_SPHERE;
+static bool enableSphereLOD = true;
+unsigned int sphereTriangles = 0;
 
 std::vector<float> viewVolumeVertices;
-std::vector<int> viewVolumeIndices;
-unsigned int viewVolumeVAO, viewVolumeVBO, viewVolumeEBO;
+std::vector<unsigned int> viewVolumeIndices;
+unsigned int viewVolumeMesh;
 
 // Texture parameter
 unsigned int rovTexture, seaTexture, sandTexture, grassTexture, boxTexture, fishTexture, skyTexture;
+const std::vector<std::string> TEXTURE_FILES{
+	"Resources/Textures/metal.png",
+	"Resources/Textures/sea.jpg",
+	"Resources/Textures/sand.jpg",
+	"Resources/Textures/grass.png",
+	"Resources/Textures/container2.png",
+	"Resources/Textures/fish.png",
+	"Resources/Textures/sky.jpg",
+};
+const std::vector<std::string> SKYBOX_FACES{
+	"Resources/Textures/skybox/right.jpg",
+	"Resources/Textures/skybox/left.jpg",
+	"Resources/Textures/skybox/top.jpg",
+	"Resources/Textures/skybox/bottom.jpg",
+	"Resources/Textures/skybox/front.jpg",
+	"Resources/Textures/skybox/back.jpg",
+};
 
-int main() {
+// Images decoded and mipmapped on the job pool while the textures before them are uploaded
+mipchain::Batch textureBatch;
+
+// Ambient light from the skybox (9 spherical harmonics), instead of a gray ambient scaled by the sun height
+skylight::Irradiance skyIrradiance;
+bool useSkyAmbient = false;
+
+// Cascaded sun shadows, the instanced casters of every cascade share one upload per frame
+shadows::CascadedShadows sunShadows;
+shadows::CasterBatches shadowCasters;
+static int shadowSize = 1;
+
+// Point and spot lights binned per view into clusters: the ROV searchlights and a light in every glowing prop.
+// The props come with the seabed chunks, they are drawn as instanced spheres grouped by palette color.
+const unsigned int GLOW_PER_CHUNK = 64;
+const int GLOW_PALETTE_SIZE = 4;
+const glm::vec3 GLOW_PALETTE[GLOW_PALETTE_SIZE] = {
+	glm::vec3(0.2f, 0.9f, 1.0f),
+	glm::vec3(0.3f, 1.0f, 0.4f),
+	glm::vec3(0.25f, 0.4f, 1.0f),
+	glm::vec3(0.9f, 0.3f, 1.0f),
+};
+const float GLOW_LIGHT_RANGE = 6.0f;
+clusters::LightGrid lightGrid;
+int glowPerChunk = 40;
+bool rovSearchlights = true;
+bool showClusterHeat = false;
+std::vector<glm::vec4> glowProps;	// position and radius, grouped by palette color
+std::vector<float> glowPhases;
+unsigned int glowPaletteFirst[GLOW_PALETTE_SIZE + 1] = { 0 };
+unsigned int glowPropBuffer = 0, glowPropTexture = 0;
+
+// Textures, shaders and meshes by content, shared between the built-in objects and scene files
+assets::Cache assetCache(loadTexture, loadCubemap);
+
+int main(int argc, char** argv) {
+
+	// "--trace N" records startup and the first N frames into a chrome://tracing file
+	trace::get().setThreadName("Main");
+	bool benchmarkBoids = false;
+	bool benchmarkImages = false;
+	std::string scenePath, exportScenePath;
+	unsigned int exportSceneInstances = 100000;
+	unsigned int benchmarkSceneInstances = 0;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+			trace::get().start(std::max(1, atoi(argv[i + 1])));
+		}
+		// "--telemetry FILE" records per-frame counters from the first frame on
+		if (std::string(argv[i]) == "--telemetry" && i + 1 < argc) {
+			telemetryRecorder.open(argv[i + 1]);
+		}
+		// "--bench-boids" times the flock update for growing fish counts and exits
+		if (std::string(argv[i]) == "--bench-boids") {
+			benchmarkBoids = true;
+		}
+		// "--bench-images" times decoding and mip generation of the textures and exits
+		if (std::string(argv[i]) == "--bench-images") {
+			benchmarkImages = true;
+		}
+		// "--boxes N" scatters N boxes on every chunk
+		if (std::string(argv[i]) == "--boxes" && i + 1 < argc) {
+			boxCount = std::max(0, atoi(argv[i + 1]));
+		}
+		// "--scene FILE" maps a binary scene file and draws its instances
+		if (std::string(argv[i]) == "--scene" && i + 1 < argc) {
+			scenePath = argv[i + 1];
+		}
+		// "--export-scene FILE [N]" writes a demo scene of N instances and exits
+		if (std::string(argv[i]) == "--export-scene" && i + 1 < argc) {
+			exportScenePath = argv[i + 1];
+			if (i + 2 < argc && argv[i + 2][0] != '-') {
+				exportSceneInstances = std::max(1, atoi(argv[i + 2]));
+			}
+		}
+		// "--bench-scene N" times writing, mapping and uploading a scene of N instances and exits
+		if (std::string(argv[i]) == "--bench-scene" && i + 1 < argc) {
+			benchmarkSceneInstances = std::max(1, atoi(argv[i + 1]));
+		}
+	}
+	trace::get().begin("Startup");
+
+	// Worker threads, leaving a core each for the main and simulation threads
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	jobs::get().init(hardwareThreads > 2 ? hardwareThreads - 2 : 1, 1);
+	logging::loggingMessage(logging::LogType::INFO, "Job system started with " + std::to_string(jobs::get().getWorkerCount()) + " workers.");
+
+	if (benchmarkBoids || benchmarkImages) {
+		if (benchmarkBoids) {
+			boids::benchmark({ 1000, 5000, 10000, 25000, 50000, 100000 }, 60);
+		}
+		if (benchmarkImages) {
+			std::vector<std::string> images = TEXTURE_FILES;
+			images.insert(images.end(), SKYBOX_FACES.begin(), SKYBOX_FACES.end());
+			mipchain::benchmark(images, 5);
+		}
+		jobs::get().release();
+		trace::get().end();
+		trace::get().stop();
+		return 0;
+	}
 
 	// Initialize GLFW
+	trace::get().begin("GLFW Init");
 	if (!glfwInit()) {
 		logging::loggingMessage(logging::LogType::ERROR, "Failed to initialize GLFW.");
 		glfwTerminate();
 		return -1;
 	}
 	else {
-		logging::loggingMessage(logging::LogType::DEBUG, "Initialize GLFW successful.");
+		LOGGING_MESSAGE(logging::LogType::DEBUG, "Initialize GLFW successful.");
 	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_SAMPLES, 32);
 
 	window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, WINDOW_TITLE.c_str(), NULL, NULL);
 	if (!window) {
@@ -185,9 +527,11 @@ int main() {
 		return -1;
 	}
 	else {
-		logging::loggingMessage(logging::LogType::DEBUG, "Create GLFW window successful.");
+		LOGGING_MESSAGE(logging::LogType::DEBUG, "Create GLFW window successful.");
 	}
 
+	trace::get().end();
+
 	// Register callbacks
 	glfwMakeContextCurrent(window);
 	glfwSetErrorCallback(errorCallback);
@@ -198,16 +542,20 @@ int main() {
 	glfwSetScrollCallback(window, scrollCallback);
 
 	// Initialize GLAD (Must behind the create window)
+	trace::get().begin("GLAD Init");
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		logging::loggingMessage(logging::LogType::ERROR, "Failed to initialize GLAD.");
 		glfwTerminate();
 		return -1;
 	}
 	else {
-		logging::loggingMessage(logging::LogType::DEBUG, "Initialize GLAD successful.");
+		LOGGING_MESSAGE(logging::LogType::DEBUG, "Initialize GLAD successful.");
 	}
+	reversez::get().init((GLADloadproc)glfwGetProcAddress);
+	trace::get().end();
 
 	// Initialize ImGui and bind to GLFW and OpenGL3(glad)
+	trace::get().begin("ImGui Init");
 	std::string glsl_version = "#version 330";
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -215,6 +563,7 @@ int main() {
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init(glsl_version.c_str());
 	ImGui::StyleColorsDark();
+	trace::get().end();
 
 	// Show version info
 	const GLubyte* renderer = glGetString(GL_RENDERER);
@@ -224,83 +573,264 @@ int main() {
 	// Setting OpenGL
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	reversez::get().apply();
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// Profiler zones, registered in the order of Pass
+	for (int i = 0; i < Pass::PASS_COUNT; i++) {
+		profiler::get().registerZone(PASS_NAMES[i]);
+	}
+
+	// Offscreen render target (anti-aliasing mode and render scale)
+	trace::get().begin("Render Target Init");
+	renderTarget.IsFloatDepth = reversez::get().isReversed();
+	renderTarget.init(SCR_WIDTH, SCR_HEIGHT);
+	trace::get().end();
+
 	// Create shader program
-	Shader myShader("Shaders/lighting.vs", "Shaders/lighting.fs");
+	Shader& myShader = *assetCache.acquireShader("Shaders/lighting.vs", "Shaders/lighting.fs");
 	// Shader textureShader("Shaders\\texture.vs", "Shaders\\texture.fs");
-	Shader cubemapShader("Shaders/cubemap.vs", "Shaders/cubemap.fs");
+	// The sky is drawn by myShader (isCubeMap), so cubemap.vs / cubemap.fs are not loaded
+	// Shader& cubemapShader = *assetCache.acquireShader("Shaders/cubemap.vs", "Shaders/cubemap.fs");
+	Shader& shadowShader = *assetCache.acquireShader("Shaders/lighting.vs", "Shaders/shadow.fs");
 	
 	// Create object data
 	geneObejectData();
 
-	// Setting amount of fishes, boxed and grass. 
-	std::default_random_engine generator(time(NULL));
-	std::uniform_real_distribution<float> unif_g(-80.0, 80.0);
-	std::uniform_real_distribution<float> unif_f(-60.0, 60.0);
-	std::uniform_real_distribution<float> unif_b(-30.0, 30.0);
-
-	std::vector<glm::vec3> boxposition;
-	for (int i = 0; i < 20; i++) {
-		boxposition.push_back(glm::vec3(unif_b(generator), 0.0f, unif_b(generator)));
+	// Scene export and benchmark only need the meshes and a context
+	if (!exportScenePath.empty() || benchmarkSceneInstances > 0) {
+		if (!exportScenePath.empty()) {
+			scene::Writer writer;
+			buildDemoScene(writer, exportSceneInstances);
+			if (writer.write(exportScenePath)) {
+				logging::loggingMessage(logging::LogType::INFO, "Wrote scene " + exportScenePath + " with " + std::to_string(writer.getInstanceCount()) + " instances.");
+			}
+		}
+		if (benchmarkSceneInstances > 0) {
+			benchmarkScene(benchmarkSceneInstances);
+		}
+		assetCache.releaseAll();
+		meshRegistry.release();
+		renderTarget.release();
+		jobs::get().release();
+		trace::get().end();
+		trace::get().stop();
+		ImGui_ImplOpenGL3_Shutdown();
+		ImGui_ImplGlfw_Shutdown();
+		ImGui::DestroyContext();
+		glfwTerminate();
+		return 0;
 	}
 
-	std::vector<glm::vec3> grassposition;
-	for (int i = 0; i < 600; i++) {
-		grassposition.push_back(glm::vec3(unif_g(generator), 0.0f, unif_g(generator)));
-	}
+	// Setting amount of fishes, the boxes and grass come with the seabed chunks
+	seabedStreamer.init(STREAM_RADIUS, boxCount, GRASS_PER_CHUNK, GLOW_PER_CHUNK, Pass::PASS_CHUNK_STREAMING);
+	seabedStreamer.update(ROVPosition, true);
+	seabedTerrain.init(meshRegistry);
+	gatherChunkInstances();
 
-	std::vector<glm::vec3> fishposition;
-	for (int i = 0; i < 300; i++) {
-		fishposition.push_back(glm::vec3(unif_f(generator), 0.0f, unif_f(generator)));
-	}
+	flock.Settings = getSchoolSettings(fishSettings, ROVPosition);
+	flock.resize(fishCount);
 
-	// Loading textures
-	rovTexture = loadTexture("Resources\\Textures\\metal.png");
-	seaTexture = loadTexture("Resources\\Textures\\sea.jpg");
-	sandTexture = loadTexture("Resources\\Textures\\sand.jpg");
-	grassTexture = loadTexture("Resources\\Textures\\grass.png");
-	boxTexture = loadTexture("Resources\\Textures\\container2.png");
-	fishTexture = loadTexture("Resources\\Textures\\fish.png");
-	skyTexture = loadTexture("Resources\\Textures\\sky.jpg");
+	// Loading textures, the ones without a cooked file are decoded on the job pool first
+	trace::get().begin("Load Textures");
+	for (const std::string& path : TEXTURE_FILES) {
+		if (!std::ifstream(cooked::getCookedPath(path)).good()) {
+			textureBatch.add(path, true);
+		}
+	}
+	for (const std::string& path : SKYBOX_FACES) {
+		if (!std::ifstream(cooked::getCookedPath(path)).good()) {
+			textureBatch.add(path, true);
+		}
+	}
+	rovTexture = assetCache.acquireTexture(TEXTURE_FILES[0]);
+	seaTexture = assetCache.acquireTexture(TEXTURE_FILES[1]);
+	sandTexture = assetCache.acquireTexture(TEXTURE_FILES[2]);
+	grassTexture = assetCache.acquireTexture(TEXTURE_FILES[3]);
+	boxTexture = assetCache.acquireTexture(TEXTURE_FILES[4]);
+	fishTexture = assetCache.acquireTexture(TEXTURE_FILES[5]);
+	skyTexture = assetCache.acquireTexture(TEXTURE_FILES[6]);
 
 	// Loading Cubemap
-	std::vector<std::string> faces{
-		"Resources/Textures/skybox/right.jpg",
-		"Resources/Textures/skybox/left.jpg",
-		"Resources/Textures/skybox/top.jpg",
-		"Resources/Textures/skybox/bottom.jpg",
-		"Resources/Textures/skybox/front.jpg",
-		"Resources/Textures/skybox/back.jpg",
-	};
-	unsigned int cubemapTexture = loadCubemap(faces);
+	unsigned int cubemapTexture = assetCache.acquireCubemap(SKYBOX_FACES);
+	textureBatch.clear();
+	skyIrradiance = skylight::project(cubemapTexture);
+	trace::get().end();
 
 	// binding texture to shader
 	myShader.use();
 	myShader.setInt("material.diffuse", 0);
+	// No texture has a specular map, the specular term is tinted by the diffuse texture on purpose
 	myShader.setInt("material.specular", 0);
 	myShader.setFloat("material.shininess", 64.0f);
 	myShader.setInt("skybox", 2);
+	skylight::setUniforms(myShader, skyIrradiance);
+	myShader.setInt("fishPositions", 3);
+	myShader.setInt("fishPreviousPositions", 12);
+	myShader.setInt("fishVelocities", 4);
+	myShader.setInt("fishStateWidth", boids::STATE_WIDTH);
+	myShader.setInt("sceneInstances", scene::INSTANCE_TEXTURE_UNIT);
+	seabedTerrain.setConstants(myShader);
+	sunShadows.setConstants(myShader);
+	shadowCasters.setConstants(myShader);
+	lightGrid.init(Pass::PASS_LIGHTS);
+	lightGrid.setConstants(myShader);
+
+	// The shadow pass runs the same vertex shader
+	shadowShader.use();
+	shadowShader.setInt("diffuseTexture", 0);
+	shadowShader.setInt("fishPositions", 3);
+	shadowShader.setInt("fishPreviousPositions", 12);
+	shadowShader.setInt("fishVelocities", 4);
+	shadowShader.setInt("fishStateWidth", boids::STATE_WIDTH);
+	shadowShader.setInt("sceneInstances", scene::INSTANCE_TEXTURE_UNIT);
+	seabedTerrain.setConstants(shadowShader);
+	shadowCasters.setConstants(shadowShader);
+	sunShadows.Size = shadows::SIZES[shadowSize];
+	sunShadows.init();
+	gpuFlock.init();
+
+	// The mapping is released once its sections are on the GPU
+	if (!scenePath.empty()) {
+		trace::Scope scope("Load Scene");
+		scene::Scene sceneFile;
+		if (sceneFile.load(scenePath) && loadedScene.upload(sceneFile, meshRegistry, assetCache)) {
+			logging::loggingMessage(logging::LogType::INFO, "Loaded scene " + scenePath + ": " + std::to_string(loadedScene.getInstanceCount()) + " instances in "
+				+ std::to_string(loadedScene.getGroups().size()) + " groups.");
+		}
+	}
+
+	trace::get().end();
+
+	// Initial simulation state, then hand the world over to the simulation thread
+	simCameraPosition = camera.Position;
+	processInput(window);
+	WorldSnapshot& initial = worldBuffer.write();
+	initial.current = captureSimState(0.0f);
+	initial.previous = initial.current;
+	initial.stepTime = glfwGetTime();
+	initial.steps = 0;
+	initial.stepCost = 0.0f;
+	initial.collisionCost = 0.0f;
+	initial.collisionCandidates = 0;
+	initial.collisionBoxes = 0;
+	flock.copyPositions(initial.fishCurrent);
+	flock.copyVelocities(initial.fishVelocities);
+	initial.fishPrevious = initial.fishCurrent;
+	initial.flockGridTime = 0.0f;
+	initial.flockSteerTime = 0.0f;
+	worldBuffer.publish();
+	simRunning = true;
+	std::thread simThread(simulationLoop);
 
 	// The main loop
 	while (!glfwWindowShouldClose(window)) {
 		
+		// Publish the timings of the previous frame
+		profiler::get().beginFrame();
+
 		// Calculate the deltaFrame
 		float currentTime = (float)glfwGetTime();
 		deltaTime = currentTime - lastTime;
 		lastTime = currentTime;
+		frameTimeHistory[frameTimeOffset] = deltaTime * 1000.0f;
+		frameTimeOffset = (frameTimeOffset + 1) % FRAME_HISTORY;
+		modeFrameTime[renderTarget.Mode] = glm::mix(modeFrameTime[renderTarget.Mode], deltaTime * 1000.0f, 0.05f);
+
+		// Dynamic resolution: main view and ortho monitors are scaled independently
+		// currentScreen 0-3 shows a single monitor, 4 shows all of them
+		dynamicResolution.update(deltaTime * 1000.0f, currentScreen == Monitor::Monitor_Result || currentScreen == 4, currentScreen != Monitor::Monitor_Result);
+		renderTarget.ViewScale[Monitor::Monitor_X] = dynamicResolution.OrthoScale;
+		renderTarget.ViewScale[Monitor::Monitor_Y] = dynamicResolution.OrthoScale;
+		renderTarget.ViewScale[Monitor::Monitor_Z] = dynamicResolution.OrthoScale;
+		renderTarget.ViewScale[Monitor::Monitor_Result] = dynamicResolution.MainScale;
+
+		// Hand the input to the simulation thread and pick up its newest snapshot
+		profiler::get().beginZone(Pass::PASS_SIMULATION);
+		processInput(window);
+		world = &worldBuffer.read();
+
+		// Render between the last two states, so motion is smooth at any frame rate
+		simAlpha = glm::clamp((float)((glfwGetTime() - world->stepTime) * SIM_RATE), 0.0f, 1.0f);
+		renderState = interpolateSimState(world->previous, world->current, simAlpha);
+		camera.Position = renderState.cameraPosition;
+		followCamera.updateTargetPosition(renderState.rovPosition);
+		lightPosition = renderState.sunPosition;
+		sunDirection = renderState.sunDirection;
+		profiler::get().endZone();
+
+		float daytime = sin(renderState.time / 10) / 2 + 0.5;
+
+		// Stream the seabed around whatever the view follows
+		profiler::get().beginZone(Pass::PASS_CHUNK_STREAMING);
+		seabedStreamer.update(isGhost ? renderState.cameraPosition : renderState.rovPosition);
+		if (seabedStreamer.getVersion() != gatheredChunkVersion) {
+			gatherChunkInstances();
+		}
+		profiler::get().endZone();
+
+		// Move the GPU school, the CPU school is stepped by the simulation thread (see simulate())
+		profiler::get().beginZone(Pass::PASS_FISH_UPDATE);
+		if (fishBackend == FishBackend::FISH_GPU) {
+			// The fish only come back to the CPU when the backend or the count changes
+			if (activeFishBackend != FishBackend::FISH_GPU || (int)gpuFlock.size() != fishCount) {
+				fishTransfer.Settings = getSchoolSettings(fishSettings, renderState.rovPosition);
+				if (activeFishBackend == FishBackend::FISH_GPU) {
+					gpuFlock.download(fishTransfer);
+				} else {
+					fishTransfer.resize(world->fishCurrent.size());
+					for (unsigned int i = 0; i < fishTransfer.size(); i++) {
+						fishTransfer.setFish(i, world->fishCurrent[i], world->fishVelocities[i]);
+					}
+				}
+				fishTransfer.resize(fishCount);
+				gpuFlock.upload(fishTransfer);
+			}
+			// Whole fixed steps like the CPU flock, the draw interpolates between the last two
+			gpuFlock.Settings = getSchoolSettings(fishSettings, renderState.rovPosition);
+			int steps = gpuFlockClock.advance(deltaTime);
+			for (int i = 0; i < steps; i++) {
+				gpuFlock.update(gpuFlockClock.Step, renderState.rovPosition);
+			}
+		} else if (activeFishBackend == FishBackend::FISH_GPU) {
+			// The simulation thread takes the fish over before its next fish step
+			gpuFlock.download(fishTransfer);
+			std::lock_guard<std::mutex> guard(fishHandoffLock);
+			fishHandoff = fishTransfer;
+			hasFishHandoff = true;
+		}
+		activeFishBackend = fishBackend;
+		if (validateGpuFlock) {
+			gpuFlockError = boids::validateGpu(512, 4, fishSettings);
+			validateGpuFlock = false;
+		}
+		profiler::get().endZone();
 
-		float daytime = sin(currentTime / 10) / 2 + 0.5;
+		// Model matrices of all instances, once per frame for every view
+		profiler::get().beginZone(Pass::PASS_INSTANCE_MATRICES);
+		buildInstanceMatrices(renderState.time);
+		profiler::get().endZone();
 
-		// Process Input (Moving camera)
-		processInput(window);
+		// Lights of this frame, every view bins them into its own clusters
+		profiler::get().beginZone(Pass::PASS_LIGHTS);
+		updateLights(renderState.time);
+		profiler::get().endZone();
+
+		// Update the view volume, the shadow cascades are fitted to it
+		updateViewVolumeData();
+		meshRegistry.update(viewVolumeMesh, viewVolumeVertices);
+
+		// Sun shadow maps, before the views that sample them
+		profiler::get().beginZone(Pass::PASS_SHADOWS);
+		renderShadows(shadowShader);
+		myShader.use();
+		sunShadows.setUniforms(myShader);
+		profiler::get().endZone();
 
 		// Clear the buffer
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Update the view volume
-		updateViewVolumeData();
+		renderTarget.begin();
 
 		// feed inputs to dear imgui start new frame;
 		ImGui_ImplOpenGL3_NewFrame();
@@ -308,6 +838,9 @@ int main() {
 		ImGui::NewFrame();
 		showUI();
 		// ImGui::ShowDemoWindow();
+		sphereTriangles = 0;
+		instancesDrawn = 0;
+		instancesCulled = 0;
 
 		// ù
 		int scr_start = 0, scr_end = 3;
@@ -330,118 +863,159 @@ int main() {
 			setProjectionMatrix(i);
 			setViewport(i);
 
+			// Skip the instances outside this view
+			profiler::get().beginZone(Pass::PASS_CULLING);
+			instancesDrawn += cullInstances(projection * view);
+			profiler::get().endZone();
+
+			profiler::get().beginZone(Pass::PASS_LIGHTS);
+			lightGrid.build(view, projection, (i == Monitor::Monitor_Result) ? global_far : MAX_FAR);
+			profiler::get().endZone();
+
 			// Enable Shader and setting view & projection matrix
+			profiler::get().beginZone(Pass::PASS_VIEW_SETUP);
 			myShader.use();
 			myShader.setMat4("view", view);
 			myShader.setMat4("projection", projection);
 
 			myShader.setBool("isCubeMap", false);
+			myShader.setBool("isReversedDepth", reversez::get().isReversed());
 			myShader.setBool("isGlowObj", false);
 			myShader.setFloat("alpha", 1.0f);
 			myShader.setVec3("color", glm::vec3(1.0f, 0.0f, 0.0f));
 			myShader.setVec3("viewPos", (isGhost) ? camera.Position: followCamera.Position);
 			
 			myShader.setVec3("light.position", lightPosition);
+			myShader.setVec3("sunDirection", sunDirection);
 			myShader.setVec3("light.ambient", glm::vec3(0.2f, 0.2, 0.2f));
+			myShader.setBool("useSkyAmbient", useSkyAmbient);
+			lightGrid.setUniforms(myShader);
+			myShader.setBool("showClusterHeat", showClusterHeat);
 			myShader.setVec3("light.diffuse", glm::vec3(0.9f, 0.9f, 0.9f));
 			myShader.setVec3("light.specular", glm::vec3(0.4f, 0.4f, 0.4f));
 			myShader.setFloat("light.constant", 1.0f);
 			myShader.setFloat("light.linear", 0.007f);
 			myShader.setFloat("light.quadratic", 0.0002f);
+			profiler::get().endZone();
 
 			// Render on the screen;
 
 			// Draw origin and 3 axes 
 			if (showAxis) {
+				profiler::get().beginZone(Pass::PASS_AXES);
 				myShader.setBool("enableTexture", false);
 				modelMatrix.push();
 					modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.2f)));
 					myShader.setVec3("color", glm::vec3(0.1, 0.1, 0.1));
-					myShader.setMat4("model", modelMatrix.top());
+					setModelMatrix(myShader, modelMatrix.top());
 					drawSphere();
 				modelMatrix.pop();
 				drawAxis(myShader);
+				profiler::get().endZone();
 			}
 
 			// Draw Skybox (Using Cubemap)
-			glDepthFunc(GL_LEQUAL);
+			profiler::get().beginZone(Pass::PASS_SKYBOX);
+			glDepthFunc(reversez::get().getDepthFunc(true));
 			myShader.setBool("isCubeMap", true);
 			modelMatrix.push();
 				glActiveTexture(GL_TEXTURE2);
 				glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 				modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(distanceOrthoCamera * 5.34)));
 				// myShader.setVec3("color", glm::vec3(0.294117647 * daytime, 0.623529412 * daytime, 0.949019608 * daytime));
-				myShader.setMat4("model", modelMatrix.top());
+				setModelMatrix(myShader, modelMatrix.top());
 				drawCube();
 			modelMatrix.pop();
 			myShader.setBool("isCubeMap", false);
-			glDepthFunc(GL_LESS);
+			glDepthFunc(reversez::get().getDepthFunc(false));
+			profiler::get().endZone();
 
 			// Draw Sea
+			profiler::get().beginZone(Pass::PASS_SEA_SAND);
 			myShader.use();
 			glActiveTexture(GL_TEXTURE0);
 			glBindTexture(GL_TEXTURE_2D, seaTexture);
 			myShader.setBool("enableTexture", true);
-			myShader.setMat4("model", modelMatrix.top());
-			drawFloor();
+			modelMatrix.push();
+				// The surface follows the ROV, snapped to whole texture repeats so it does not swim
+				glm::vec3 seaOffset = glm::floor(glm::vec3(renderState.rovPosition.x, 0.0f, renderState.rovPosition.z) / chunks::TEXTURE_TILE) * chunks::TEXTURE_TILE;
+				modelMatrix.save(glm::translate(modelMatrix.top(), seaOffset));
+				setModelMatrix(myShader, modelMatrix.top());
+				drawFloor();
+			modelMatrix.pop();
 
-			// Draw Seabed (Sand)
+			// Draw Seabed (Sand), the LOD follows the main camera in every view
 			modelMatrix.push();
 				// draw sand
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -5.0f, 0.0f)));
-				myShader.setMat4("model", modelMatrix.top());
 				glBindTexture(GL_TEXTURE_2D, sandTexture);
-				drawFloor();
+				glm::vec3 lodCenter = (isGhost) ? camera.Position : followCamera.Position;
+				seabedTerrain.select(seabedStreamer, lodCenter, frustum::extract(projection * view, reversez::get().isReversed()));
+				seabedTerrain.draw(myShader, meshRegistry, seabedStreamer.getHeightTexture(), lodCenter);
+				profiler::get().endZone();
 
 				// draw grass
-				for (unsigned int i = 0; i < grassposition.size(); i++) {
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), grassposition[i]));
-						myShader.setMat4("model", modelMatrix.top());
+				profiler::get().beginZone(Pass::PASS_GRASS);
+				for (unsigned int i = 0; i < grassInstances.matrices.size(); i++) {
+					if (grassInstances.visible[i]) {
+						setModelMatrix(myShader, grassInstances.matrices[i]);
 						drawGrass();
-					modelMatrix.pop();
+					}
 				}
+				profiler::get().endZone();
 			modelMatrix.pop();
 
 			// Draw fishes
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -2.5f, 0.0f)));
-				for (unsigned int i = 0; i < fishposition.size(); i++) {
-					modelMatrix.push();
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(-sin(currentTime), 0.0f, 0.0f)));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(currentTime * 5), glm::vec3(0.0, 1.0, 0.0)));
-					modelMatrix.save(glm::translate(modelMatrix.top(), fishposition[i]));
-					modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.5f, 0.5f)));
-					myShader.setMat4("model", modelMatrix.top());
-					drawFish();
-					modelMatrix.pop();
+			profiler::get().beginZone(Pass::PASS_FISH);
+			if (activeFishBackend == FishBackend::FISH_GPU) {
+				drawGpuFish(myShader);
+				instancesDrawn += gpuFlock.size();
+			} else {
+				for (unsigned int i = 0; i < fishInstances.matrices.size(); i++) {
+					if (fishInstances.visible[i]) {
+						setModelMatrix(myShader, fishInstances.matrices[i]);
+						drawFish();
+					}
 				}
-			modelMatrix.pop();
+			}
+			profiler::get().endZone();
 
 			// Draw obstacles
-			modelMatrix.push();
-				for (unsigned int i = 0; i < boxposition.size(); i++) {
-					modelMatrix.push();
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(boxposition[i].x, sin(currentTime * 3 + boxposition[i].z) / 4, boxposition[i].z)));
-					myShader.setMat4("model", modelMatrix.top());
+			profiler::get().beginZone(Pass::PASS_BOXES);
+			for (unsigned int i = 0; i < boxInstances.matrices.size(); i++) {
+				if (boxInstances.visible[i]) {
+					setModelMatrix(myShader, boxInstances.matrices[i]);
 					drawBox();
-					modelMatrix.pop();
 				}
-			modelMatrix.pop();
+			}
+			profiler::get().endZone();
+
+			// Draw the scene file, culled per group
+			profiler::get().beginZone(Pass::PASS_SCENE);
+			loadedScene.draw(myShader, meshRegistry, frustum::extract(projection * view, reversez::get().isReversed()));
+			instancesDrawn += loadedScene.getInstancesDrawn();
+			profiler::get().endZone();
+
+			// Draw the glowing props
+			profiler::get().beginZone(Pass::PASS_GLOW);
+			drawGlowProps(myShader);
+			profiler::get().endZone();
 
 			// Draw ROV
+			profiler::get().beginZone(Pass::PASS_ROV);
 			myShader.setBool("enableTexture", false);
 			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), ROVPosition));
-				modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(ROVYaw), glm::vec3(0.0, 1.0, 0.0)));
-				myShader.setMat4("model", modelMatrix.top());
+				modelMatrix.save(glm::translate(modelMatrix.top(), renderState.rovPosition));
+				modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(renderState.rovYaw), glm::vec3(0.0, 1.0, 0.0)));
+				setModelMatrix(myShader, modelMatrix.top());
 				if (showAxis) {
 					drawAxis(myShader);
 				}
 				drawROV(myShader);
 			modelMatrix.pop();
+			profiler::get().endZone();
 
 			// Draw Camera
+			profiler::get().beginZone(Pass::PASS_CAMERA);
 			modelMatrix.push();
 				if(isGhost) {
 					glm::vec3 location = camera.Front * -1.4f + camera.Position;
@@ -459,57 +1033,93 @@ int main() {
 					drawAxis(myShader);
 				}
 			modelMatrix.pop();
-
-			// Update View Volume
-			glBindVertexArray(viewVolumeVAO);
-			glBindBuffer(GL_ARRAY_BUFFER, viewVolumeVBO);
-			glBufferData(GL_ARRAY_BUFFER, viewVolumeVertices.size() * sizeof(float), viewVolumeVertices.data(), GL_STATIC_DRAW);
-			glBindVertexArray(0);
+			profiler::get().endZone();
 
 			// Draw View Volume
+			profiler::get().beginZone(Pass::PASS_VIEW_VOLUME);
 			modelMatrix.push();
 				myShader.setVec3("color", glm::vec3(0.6, 0.6, 0.6));
-				myShader.setMat4("model", modelMatrix.top());
+				setModelMatrix(myShader, modelMatrix.top());
 				myShader.setFloat("alpha", 0.6f);
-				glBindVertexArray(viewVolumeVAO);
-					glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-				glBindVertexArray(0);
+				meshRegistry.draw(viewVolumeMesh);
 				myShader.setFloat("alpha", 1.0f);
 			modelMatrix.pop();
+			profiler::get().endZone();
 
 			// draw sun
+			profiler::get().beginZone(Pass::PASS_SUN);
 			myShader.setBool("isGlowObj", true);
 			modelMatrix.push();
-				lightPosition = glm::vec3(cos(currentTime / 10) * 90.0f, sin(currentTime / 10) * 90.0f, 0.0f);
 				modelMatrix.save(glm::translate(modelMatrix.top(), lightPosition));
 				myShader.setVec3("color", glm::vec3(1.0, 1.0, 1.0));
-				myShader.setMat4("model", modelMatrix.top());
+				setModelMatrix(myShader, modelMatrix.top());
 				drawSphere();
 			modelMatrix.pop();
 			myShader.setBool("isGlowObj", false);
+			profiler::get().endZone();
 		}
 
+		// Resolve the offscreen target onto the window
+		profiler::get().beginZone(Pass::PASS_PRESENT);
+		renderTarget.end();
+		profiler::get().endZone();
+
 		// render on the screen
+		profiler::get().beginZone(Pass::PASS_IMGUI);
 		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		ImDrawData* drawData = ImGui::GetDrawData();
+		ImGui_ImplOpenGL3_RenderDrawData(drawData);
+		for (int i = 0; i < drawData->CmdListsCount; i++) {
+			for (int j = 0; j < drawData->CmdLists[i]->CmdBuffer.Size; j++) {
+				profiler::countDrawCall(drawData->CmdLists[i]->CmdBuffer[j].ElemCount / 3);
+			}
+		}
+		profiler::get().endZone();
+
+		// Append this frame to the telemetry file
+		if (telemetryRecorder.isOpen()) {
+			telemetry::FrameRecord record = {};
+			record.frameIndex = frameIndex;
+			record.deltaTime = deltaTime * 1000.0f;
+			for (const profiler::Zone& zone : profiler::get().Zones) {
+				record.drawCalls += zone.drawCalls;
+				record.triangles += zone.triangles;
+			}
+			record.instancesDrawn = instancesDrawn;
+			record.instancesCulled = instancesCulled;
+			record.rovPosition[0] = world->current.rovPosition.x;
+			record.rovPosition[1] = world->current.rovPosition.y;
+			record.rovPosition[2] = world->current.rovPosition.z;
+			record.rovYaw = world->current.rovYaw;
+			record.cameraMode = isGhost ? 1 : 0;
+			record.viewportMode = currentScreen;
+			record.projectionMode = isPerspective ? 1 : 0;
+			telemetryRecorder.append(record);
+		}
+		frameIndex++;
 
 		// Swap Buffers and Trigger event
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
-	glDeleteVertexArrays(1, &floorVAO);
-	glDeleteBuffers(1, &floorVBO);
-
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteBuffers(1, &cubeEBO);
-
-	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteBuffers(1, &planeVBO);
-
-	glDeleteVertexArrays(1, &viewVolumeVAO);
-	glDeleteBuffers(1, &viewVolumeVBO);
-	glDeleteBuffers(1, &viewVolumeEBO);
+	simRunning = false;
+	simThread.join();
+
+	seabedStreamer.release();
+	jobs::get().release();
+	loadedScene.release();
+	shadowCasters.release();
+	sunShadows.release();
+	lightGrid.release();
+	glDeleteTextures(1, &glowPropTexture);
+	glDeleteBuffers(1, &glowPropBuffer);
+	assetCache.releaseAll();
+	meshRegistry.release();
+	renderTarget.release();
+	gpuFlock.release();
+	profiler::get().release();
+	trace::get().stop();
+	telemetryRecorder.close();
 
 	// Release the resources.
 	ImGui_ImplOpenGL3_Shutdown();
@@ -524,10 +1134,10 @@ void showUI() {
 	ImGuiTabBarFlags tab_bar_flags = ImGuiBackendFlags_None;
 	if (ImGui::BeginTabBar("MyTabBar", tab_bar_flags)) {
 		if (ImGui::BeginTabItem("ROV")) {
-			ImGui::Text("Position = (%.2f, %.2f, %.2f)", ROVPosition.x, ROVPosition.y, ROVPosition.z);
-			ImGui::Text("Front = (%.2f, %.2f, %.2f)", ROVFront.x, ROVFront.y, ROVFront.z);
-			ImGui::Text("Right = (%.2f, %.2f, %.2f)", ROVRight.x, ROVRight.y, ROVRight.z);
-			ImGui::Text("Pitch = %.2f deg", ROVYaw);
+			ImGui::Text("Position = (%.2f, %.2f, %.2f)", world->current.rovPosition.x, world->current.rovPosition.y, world->current.rovPosition.z);
+			ImGui::Text("Front = (%.2f, %.2f, %.2f)", world->current.rovFront.x, world->current.rovFront.y, world->current.rovFront.z);
+			ImGui::Text("Right = (%.2f, %.2f, %.2f)", world->current.rovRight.x, world->current.rovRight.y, world->current.rovRight.z);
+			ImGui::Text("Pitch = %.2f deg", world->current.rovYaw);
 			ImGui::SliderFloat("Speed", &ROVMovementSpeed, 1, 20);
 			ImGui::EndTabItem();
 		}
@@ -560,7 +1170,19 @@ void showUI() {
 			ImGui::BulletText("left: %.2f, right: %.2f ", global_left, global_right);
 			ImGui::BulletText("bottom: %.2f, top: %.2f ", global_bottom, global_top);
 			ImGui::SliderFloat("Near", &global_near, 0.1, 10);
-			ImGui::SliderFloat("Far", &global_far, 10, 250);
+			// Reversed float depth keeps its precision out to kilometers
+			float maxFar = reversez::get().isReversed() ? MAX_REVERSED_FAR : MAX_FAR;
+			global_far = std::min(global_far, maxFar);
+			ImGui::SliderFloat((reversez::get().IsInfinite) ? "Far (view volume only)" : "Far", &global_far, 10, maxFar);
+			if (reversez::get().isSupported()) {
+				if (ImGui::Checkbox("Reversed Depth", &reversez::get().IsReversed)) {
+					reversez::get().apply();
+					renderTarget.setFloatDepth(reversez::get().isReversed());
+				}
+			} else {
+				ImGui::Text("Reversed Depth: needs GL 4.5 or ARB_clip_control");
+			}
+			ImGui::Checkbox("Infinite Far Plane", &reversez::get().IsInfinite);
 			ImGui::Spacing();
 
 			if (ImGui::TreeNode("Projection Matrix")) {
@@ -597,6 +1219,239 @@ void showUI() {
 
 			ImGui::EndTabItem();
 		}
+		if (ImGui::BeginTabItem("Rendering")) {
+			float averageFrameTime = 0.0f;
+			for (int i = 0; i < FRAME_HISTORY; i++) {
+				averageFrameTime += frameTimeHistory[i] / FRAME_HISTORY;
+			}
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Anti-Aliasing");
+			if (ImGui::Combo("Mode", &aaMode, antialiasing::MODE_NAMES, antialiasing::MODE_COUNT)) {
+				renderTarget.setMode(aaMode);
+			}
+			if (ImGui::SliderFloat("Render Scale", &renderScale, antialiasing::MIN_SCALE, antialiasing::MAX_SCALE)) {
+				renderTarget.setScale(renderScale);
+			}
+			ImGui::Text("Render Target: %d x %d, Samples: %d (max %d)", renderTarget.Width, renderTarget.Height, renderTarget.getSamples(), renderTarget.getMaxSamples());
+			ImGui::Text("Frame Time: %.2f ms (%.1f FPS)", averageFrameTime, 1000.0f / glm::max(averageFrameTime, 0.001f));
+			ImGui::PlotLines("##FrameTime", frameTimeHistory, FRAME_HISTORY, frameTimeOffset, "Frame Time (ms)", 0.0f, 50.0f, ImVec2(0, 60));
+			ImGui::Checkbox("Dynamic Resolution", &dynamicResolution.Enabled);
+			if (dynamicResolution.Enabled) {
+				ImGui::SliderFloat("Target Frame Time (ms)", &dynamicResolution.TargetFrameTime, 4.0f, 50.0f);
+				ImGui::SliderFloat("Min View Scale", &dynamicResolution.MinScale, 0.25f, 1.0f);
+				ImGui::Text("Main View Scale: %.2f, Ortho Monitors Scale: %.2f", dynamicResolution.MainScale, dynamicResolution.OrthoScale);
+			}
+			if (ImGui::TreeNode("Frame Time per Mode")) {
+				for (int i = 0; i < antialiasing::MODE_COUNT; i++) {
+					ImGui::BulletText("%s: %.2f ms", antialiasing::MODE_NAMES[i], modeFrameTime[i]);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Sky");
+			ImGui::Checkbox("Ambient from Sky (SH)", &useSkyAmbient);
+			glm::vec3 skyUp = skylight::evaluate(skyIrradiance, glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::vec3 skyDown = skylight::evaluate(skyIrradiance, glm::vec3(0.0f, -1.0f, 0.0f));
+			ImGui::Text("Sky light up: %.2f %.2f %.2f, down: %.2f %.2f %.2f", skyUp.x, skyUp.y, skyUp.z, skyDown.x, skyDown.y, skyDown.z);
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Shadows");
+			ImGui::Checkbox("Sun Shadows", &sunShadows.IsEnabled);
+			if (ImGui::Combo("Map Size", &shadowSize, shadows::SIZE_NAMES, shadows::SIZE_COUNT)) {
+				sunShadows.Size = shadows::SIZES[shadowSize];
+			}
+			ImGui::SliderFloat("Shadow Distance", &sunShadows.Distance, 20.0f, 500.0f);
+			ImGui::SliderFloat("Split Lambda", &sunShadows.SplitLambda, 0.0f, 1.0f);
+			ImGui::SliderFloat("Sun Threshold (deg)", &sunShadows.SunThreshold, 0.1f, 10.0f);
+			ImGui::SliderInt("Cached Updates per Frame", &sunShadows.CachedUpdatesPerFrame, 1, shadows::CASCADE_COUNT - shadows::FIRST_CACHED_CASCADE);
+			const profiler::Zone& shadowZone = profiler::get().Zones[Pass::PASS_SHADOWS];
+			ImGui::Text("Cascades drawn: %u, casters: %u in %u batches, CPU %.2f ms, GPU %.2f ms", sunShadows.getCascadesDrawn(), shadowCasters.getInstanceCount(),
+				shadowCasters.getBatchCount(), shadowZone.lastCpuTime, shadowZone.lastGpuTime);
+			if (ImGui::TreeNode("Cascades")) {
+				for (int i = 0; i < shadows::CASCADE_COUNT; i++) {
+					const shadows::Cascade& cascade = sunShadows.getCascade(i);
+					ImGui::BulletText("%d (%s): %.1f - %.1f m, map %.1f m wide, %.1f cm texels, drawn %u frames ago", i, (i < shadows::FIRST_CACHED_CASCADE) ? "every frame" : "cached",
+						cascade.splitNear, cascade.splitFar, cascade.radius * 2.0f, cascade.texelSize * 100.0f, sunShadows.getFrame() - cascade.renderedFrame);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Lights");
+			ImGui::Checkbox("Clustered Lights", &lightGrid.IsEnabled);
+			ImGui::Checkbox("ROV Searchlights", &rovSearchlights);
+			if (ImGui::SliderInt("Glow Props per Chunk", &glowPerChunk, 0, GLOW_PER_CHUNK)) {
+				gatheredChunkVersion = 0xFFFFFFFF;
+			}
+			ImGui::SliderFloat("Light Distance", &lightGrid.MaxDistance, 20.0f, 500.0f);
+			ImGui::Checkbox("Show Lights per Cluster", &showClusterHeat);
+			const profiler::Zone& lightZone = profiler::get().Zones[Pass::PASS_LIGHTS];
+			ImGui::Text("Lights: %u, %d x %d x %d clusters, %u light references, max %u per cluster (%u full)", lightGrid.getLightCount(), clusters::GRID_X, clusters::GRID_Y,
+				clusters::GRID_Z, lightGrid.getReferenceCount(), lightGrid.getMaxClusterLights(), lightGrid.getFullClusters());
+			ImGui::Text("Binning: %.2f ms last view, CPU %.2f ms, GPU %.2f ms per frame", lightGrid.getBuildTime(), lightZone.lastCpuTime, lightZone.lastGpuTime);
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Sphere LOD");
+			ImGui::RadioButton("UV Sphere", &sphereType, sphere::SphereType::UV_SPHERE);
+			ImGui::SameLine();
+			ImGui::RadioButton("Icosphere", &sphereType, sphere::SphereType::ICO_SPHERE);
+			ImGui::Checkbox("Select LOD by screen size", &enableSphereLOD);
+			ImGui::Text("Sphere triangles: %u", sphereTriangles);
+			if (ImGui::TreeNode("LOD Triangles")) {
+				for (unsigned int i = 0; i < sphere::LOD_COUNT; i++) {
+					ImGui::BulletText("LOD %u: %d", i, meshRegistry.get(sphereMesh[sphereType][i]).indexCount / 3);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Asset Cache");
+			const assets::Stats& assetStats = assetCache.getStats();
+			int assetBudget = (int)(assetCache.Budget >> 20);
+			if (ImGui::SliderInt("Budget (MB)", &assetBudget, 16, 1024)) {
+				assetCache.Budget = (uint64_t)assetBudget << 20;
+				assetCache.trim();
+			}
+			ImGui::Text("Resident: %.1f MB, %u textures, %u meshes, %u shaders", assetStats.residentBytes / (1024.0f * 1024.0f),
+				assetStats.counts[assets::KIND_TEXTURE], assetStats.counts[assets::KIND_MESH], assetStats.counts[assets::KIND_SHADER]);
+			ImGui::Text("Hits: %llu, misses: %llu, evictions: %llu", (unsigned long long)assetStats.hits, (unsigned long long)assetStats.misses,
+				(unsigned long long)assetStats.evictions);
+			if (ImGui::TreeNode("Resident Assets")) {
+				for (const std::pair<const assets::Hash, assets::Entry>& entry : assetCache.getEntries()) {
+					ImGui::BulletText("%s %s: %.1f KB, %d refs", assets::KIND_NAMES[entry.second.kind], entry.second.name.c_str(), entry.second.bytes / 1024.0f, entry.second.refs);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::Spacing();
+
+			ImGui::TextColored(ImVec4(1.0f, 0.5f, 1.0f, 1.0f), "Mesh Arena");
+			ImGui::Text("Used: %.1f KB / %.1f KB", meshRegistry.getUsedBytes() / 1024.0f, meshRegistry.getCapacity() / 1024.0f);
+			if (ImGui::TreeNode("Memory per Mesh")) {
+				for (const Mesh& mesh : meshRegistry.getMeshes()) {
+					ImGui::BulletText("%s: %d verts, %d indices (%s), %.1f KB", mesh.name.c_str(), mesh.vertexCount, mesh.indexCount,
+						(mesh.indexType == GL_UNSIGNED_SHORT) ? "16-bit" : "32-bit", (mesh.vertexBytes + mesh.indexBytes) / 1024.0f);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::Spacing();
+
+			ImGui::EndTabItem();
+		}
+		if (ImGui::BeginTabItem("Performance")) {
+			profiler::Profiler& perf = profiler::get();
+			ImGui::Checkbox("GPU Timer Queries", &perf.EnableGPU);
+			ImGui::TextDisabled("GPU times are read back %d frames late and only cover outermost zones.", profiler::QUERY_LATENCY);
+			ImGui::Text("Simulation thread: %.0f Hz, %u steps, last step %.3f ms, interpolation %.2f", SIM_RATE, world->steps, world->stepCost, simAlpha);
+			ImGui::Text("ROV collision: %.2f us, %u boxes tested of %u", world->collisionCost, world->collisionCandidates, world->collisionBoxes);
+			ImGui::Text("Seabed chunks: %u resident, %u loading, %u of %u chunks used, %u uploads", seabedStreamer.getCount(chunks::ChunkState::CHUNK_RESIDENT),
+				seabedStreamer.getCount(chunks::ChunkState::CHUNK_LOADING), (unsigned int)seabedStreamer.getChunks().size() - seabedStreamer.getCount(chunks::ChunkState::CHUNK_FREE),
+				(unsigned int)seabedStreamer.getChunks().size(), seabedStreamer.getLastUploads());
+			ImGui::Text("Seabed terrain: %u nodes, %u triangles (last view)", (unsigned int)seabedTerrain.getNodes().size(), seabedTerrain.getTriangleCount());
+			if (loadedScene.getInstanceCount() > 0) {
+				ImGui::Text("Scene file: %u of %u groups, %u of %u instances (last view)", loadedScene.getGroupsDrawn(), (unsigned int)loadedScene.getGroups().size(),
+					loadedScene.getInstancesDrawn(), loadedScene.getInstanceCount());
+			}
+			bool recordTelemetry = telemetryRecorder.isOpen();
+			if (ImGui::Checkbox("Record Telemetry", &recordTelemetry)) {
+				if (recordTelemetry) {
+					telemetryRecorder.open("telemetry_" + std::to_string(std::time(0)) + ".bin");
+				} else {
+					telemetryRecorder.close();
+				}
+			}
+			if (telemetryRecorder.isOpen()) {
+				ImGui::SameLine();
+				ImGui::Text("%s: %llu frames", telemetryRecorder.Path.c_str(), (unsigned long long)telemetryRecorder.getRecordCount());
+			}
+			if (trace::get().isCapturing()) {
+				ImGui::Text("Capturing trace, %d frames left...", trace::get().getFramesLeft());
+			} else {
+				ImGui::SliderInt("Trace Frames", &traceFrames, 1, 1000);
+				if (ImGui::Button("Capture Trace")) {
+					trace::get().start(traceFrames);
+				}
+				if (!trace::get().LastFile.empty()) {
+					ImGui::SameLine();
+					ImGui::Text("Last: %s", trace::get().LastFile.c_str());
+				}
+			}
+
+			ImGui::Text("Job workers: %u, instances drawn: %u, culled: %u", jobs::get().getWorkerCount(), instancesDrawn, instancesCulled);
+			ImGui::SliderInt("Fish", &fishCount, 0, 100000);
+			ImGui::RadioButton("CPU Fish", &fishBackend, FishBackend::FISH_CPU);
+			ImGui::SameLine();
+			ImGui::RadioButton("GPU Fish", &fishBackend, FishBackend::FISH_GPU);
+			if (activeFishBackend == FishBackend::FISH_CPU) {
+				ImGui::Text("Flock grid %.3f ms, steering %.3f ms per step", world->flockGridTime, world->flockSteerTime);
+			} else {
+				ImGui::Text("GPU flock, see the GPU time of Fish Update");
+			}
+			if (ImGui::Button("Validate GPU Fish")) {
+				validateGpuFlock = true;
+			}
+			if (gpuFlockError >= 0.0f) {
+				ImGui::SameLine();
+				ImGui::Text("512 fish, 4 steps, max difference %.6f", gpuFlockError);
+			}
+			if (ImGui::TreeNode("Flocking")) {
+				ImGui::SliderFloat("Neighbor Radius", &fishSettings.neighborRadius, 0.5f, 5.0f);
+				ImGui::SliderFloat("Separation Radius", &fishSettings.separationRadius, 0.1f, 2.0f);
+				ImGui::SliderFloat("Separation", &fishSettings.separationWeight, 0.0f, 20.0f);
+				ImGui::SliderFloat("Alignment", &fishSettings.alignmentWeight, 0.0f, 5.0f);
+				ImGui::SliderFloat("Cohesion", &fishSettings.cohesionWeight, 0.0f, 5.0f);
+				ImGui::SliderFloat("ROV Avoidance", &fishSettings.avoidWeight, 0.0f, 100.0f);
+				ImGui::SliderFloat("Min Speed", &fishSettings.minSpeed, 0.0f, fishSettings.maxSpeed);
+				ImGui::SliderFloat("Max Speed", &fishSettings.maxSpeed, fishSettings.minSpeed, 20.0f);
+				ImGui::TreePop();
+			}
+
+			float totalCpu = 0.0f, totalGpu = 0.0f, totalJob = 0.0f;
+			unsigned int totalDrawCalls = 0, totalTriangles = 0, totalUniforms = 0;
+			ImGui::Columns(7, "PassTable");
+			ImGui::Text("Pass"); ImGui::NextColumn();
+			ImGui::Text("CPU ms"); ImGui::NextColumn();
+			ImGui::Text("GPU ms"); ImGui::NextColumn();
+			ImGui::Text("Job ms"); ImGui::NextColumn();
+			ImGui::Text("Draws"); ImGui::NextColumn();
+			ImGui::Text("Tris"); ImGui::NextColumn();
+			ImGui::Text("Uniforms"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (const profiler::Zone& zone : perf.Zones) {
+				ImGui::Text("%s", zone.name.c_str()); ImGui::NextColumn();
+				ImGui::Text("%.3f", zone.lastCpuTime); ImGui::NextColumn();
+				ImGui::Text("%.3f", zone.lastGpuTime); ImGui::NextColumn();
+				ImGui::Text("%.3f", zone.lastJobTime); ImGui::NextColumn();
+				ImGui::Text("%u", zone.lastDrawCalls); ImGui::NextColumn();
+				ImGui::Text("%u", zone.lastTriangles); ImGui::NextColumn();
+				ImGui::Text("%u", zone.lastUniforms); ImGui::NextColumn();
+				totalCpu += zone.lastCpuTime;
+				totalGpu += zone.lastGpuTime;
+				totalJob += zone.lastJobTime;
+				totalDrawCalls += zone.lastDrawCalls;
+				totalTriangles += zone.lastTriangles;
+				totalUniforms += zone.lastUniforms;
+			}
+			ImGui::Separator();
+			ImGui::Text("Total"); ImGui::NextColumn();
+			ImGui::Text("%.3f", totalCpu); ImGui::NextColumn();
+			ImGui::Text("%.3f", totalGpu); ImGui::NextColumn();
+			ImGui::Text("%.3f", totalJob); ImGui::NextColumn();
+			ImGui::Text("%u", totalDrawCalls); ImGui::NextColumn();
+			ImGui::Text("%u", totalTriangles); ImGui::NextColumn();
+			ImGui::Text("%u", totalUniforms); ImGui::NextColumn();
+			ImGui::Columns(1);
+			ImGui::Spacing();
+
+			if (ImGui::TreeNode("History per Pass")) {
+				for (const profiler::Zone& zone : perf.Zones) {
+					ImGui::PlotLines((zone.name + " CPU").c_str(), zone.cpuHistory, profiler::HISTORY, perf.HistoryOffset, NULL, 0.0f, FLT_MAX, ImVec2(0, 30));
+					ImGui::PlotLines((zone.name + " GPU").c_str(), zone.gpuHistory, profiler::HISTORY, perf.HistoryOffset, NULL, 0.0f, FLT_MAX, ImVec2(0, 30));
+				}
+				ImGui::TreePop();
+			}
+
+			ImGui::EndTabItem();
+		}
 		if (ImGui::BeginTabItem("Illustration")) {
 
 			ImGui::Text("Current Screen: %d", currentScreen + 1);
@@ -733,24 +1588,28 @@ void setViewport(int type) {
 	if(currentScreen == 4) {
 		switch (type) {
 			case Monitor::Monitor_X:
-				glViewport(0, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
+				renderTarget.setViewport(type, 0, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 				break;
 			case Monitor::Monitor_Y:
-				glViewport(SCR_WIDTH / 2, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
+				renderTarget.setViewport(type, SCR_WIDTH / 2, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 				break;
 			case Monitor::Monitor_Z:
-				glViewport(0, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
+				renderTarget.setViewport(type, 0, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 				break;
 			case Monitor::Monitor_Result:
-				glViewport(SCR_WIDTH / 2, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
+				renderTarget.setViewport(type, SCR_WIDTH / 2, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 				break;
 		}
 	} else {
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+		renderTarget.setViewport(type, 0, 0, SCR_WIDTH, SCR_HEIGHT);
 	}
+	viewportHeight = renderTarget.getRegion(type).renderHeight;
 }
 
 void geneObejectData() {
+	trace::Scope scope("geneObejectData");
+	meshRegistry.init(65536, 512 * 1024);
+
 	// ========== Generate Cube vertex data ==========
 	cubeVertices = {
 		// Positions			// Normals 			// Texture coords
@@ -803,21 +1662,7 @@ void geneObejectData() {
 		20, 21, 23,
 		21, 22, 23,
 	};
-	glGenVertexArrays(1, &cubeVAO);
-	glGenBuffers(1, &cubeVBO);
-	glGenBuffers(1, &cubeEBO);
-	glBindVertexArray(cubeVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-		glBufferData(GL_ARRAY_BUFFER, cubeVertices.size() * sizeof(float), cubeVertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, cubeIndices.size() * sizeof(unsigned int), cubeIndices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	cubeMesh = assetCache.acquireMesh(meshRegistry, "Cube", cubeVertices, cubeIndices);
 	// ==================================================
 
 
@@ -833,21 +1678,7 @@ void geneObejectData() {
 		0, 1, 2,
 		0, 2, 3,
 	};
-	glGenVertexArrays(1, &floorVAO);
-	glGenBuffers(1, &floorVBO);
-	glGenBuffers(1, &floorEBO);
-	glBindVertexArray(floorVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
-		glBufferData(GL_ARRAY_BUFFER, floorVertices.size() * sizeof(float), floorVertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, floorEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, floorIndices.size() * sizeof(unsigned int), floorIndices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	floorMesh = assetCache.acquireMesh(meshRegistry, "Floor", floorVertices, floorIndices);
 	// ==================================================
 
 
@@ -862,18 +1693,7 @@ void geneObejectData() {
 		 1.0,  0.0, 0.0,	0.0, 0.0, 1.0,		1.0, 1.0,
 		 1.0,  1.0, 0.0,	0.0, 0.0, 1.0,		1.0, 0.0,
 	};
-	glGenVertexArrays(1, &planeVAO);
-	glGenBuffers(1, &planeVBO);
-	glBindVertexArray(planeVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-		glBufferData(GL_ARRAY_BUFFER, planeVertices.size() * sizeof(float), planeVertices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	planeMesh = assetCache.acquireMesh(meshRegistry, "Plane", planeVertices, {});
 	// ==================================================
 	
 	// ========== Generate View Volume vertex data ==========
@@ -928,21 +1748,7 @@ void geneObejectData() {
 		20, 21, 23,
 		21, 22, 23,
 	};
-	glGenVertexArrays(1, &viewVolumeVAO);
-	glGenBuffers(1, &viewVolumeVBO);
-	glGenBuffers(1, &viewVolumeEBO);
-	glBindVertexArray(viewVolumeVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, viewVolumeVBO);
-		glBufferData(GL_ARRAY_BUFFER, viewVolumeVertices.size() * sizeof(float), viewVolumeVertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, viewVolumeEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, viewVolumeIndices.size() * sizeof(unsigned int), viewVolumeIndices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	viewVolumeMesh = meshRegistry.add("View Volume", viewVolumeVertices, viewVolumeIndices);
 	// ==================================================
 
 	// ========== Generate sphere vertex data ==========
@@ -951,72 +1757,19 @@ void geneObejectData() {
 }
 
 void geneSphereData() {
-	float radius = 1.0f;
-	unsigned int latitude = 30;
-	unsigned int longitude = 30;
-
-	for (int i = 0; i <= latitude; i++) {
-		float theta = i * M_PI / latitude;
-		float sinTheta = sin(theta);
-		float cosTheta = cos(theta);
-		for (int j = 0; j <= longitude; j++) {
-			float phi = j * 2.0f * M_PI / longitude;
-			float sinPhi = sin(phi);
-			float cosPhi = cos(phi);
-
-			float x = cosPhi * sinTheta;
-			float y = cosTheta;
-			float z = sinPhi * sinTheta;
-
-			sphereVertices.push_back(radius * x);
-			sphereVertices.push_back(radius * y);
-			sphereVertices.push_back(radius * z);
-
-			// Generate normal vectors
-			glm::vec3 normal = glm::vec3(2 * radius * x, 2 * radius * y, 2 * radius * z);
-			normal = glm::normalize(normal);
-			sphereVertices.push_back(normal.x);
-			sphereVertices.push_back(normal.y);
-			sphereVertices.push_back(normal.z);
-
-			// Generate texture coordinate
-			float u = 1 - (j / longitude);
-			float v = 1 - (i / latitude);
-			sphereVertices.push_back(u);
-			sphereVertices.push_back(-v);
-		}
-	}
-
-	for (int i = 0; i < latitude; i++) {
-		for (int j = 0; j < longitude; j++) {
-			int first = (i * (longitude + 1)) + j;
-			int second = first + longitude + 1;
-
-			sphereIndices.push_back(first);
-			sphereIndices.push_back(second);
-			sphereIndices.push_back(first + 1);
-
-			sphereIndices.push_back(second);
-			sphereIndices.push_back(second + 1);
-			sphereIndices.push_back(first + 1);
-		}
-	}
-
-	glGenVertexArrays(1, &sphereVAO);
-	glGenBuffers(1, &sphereVBO);
-	glGenBuffers(1, &sphereEBO);
-	glBindVertexArray(sphereVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-		glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), sphereIndices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+
+	for (int type = 0; type < 2; type++) {
+		for (unsigned int lod = 0; lod < sphere::LOD_COUNT; lod++) {
+			if (type == sphere::SphereType::UV_SPHERE) {
+				sphere::geneUVSphere(sphere::UV_SEGMENTS[lod], sphere::UV_SEGMENTS[lod], vertices, indices);
+			} else {
+				sphere::geneIcosphere(sphere::ICO_SUBDIVISIONS[lod], vertices, indices);
+			}
+			sphereMesh[type][lod] = assetCache.acquireMesh(meshRegistry, (type == sphere::SphereType::UV_SPHERE ? "UV Sphere LOD " : "Icosphere LOD ") + std::to_string(lod), vertices, indices);
+		}
+	}
 }
 
 void updateViewVolumeData() {
@@ -1030,6 +1783,7 @@ void updateViewVolumeData() {
 		float p_rn = p_tn * aspect_wh;
 		float p_ln = -p_rn;
 
+		// An infinite far plane has no far corners, the volume is closed at Far to show the view direction
 		float p_tf = p_tn * global_far / global_near;
 		float p_bf = -p_tf;
 		float p_rf = p_rn * global_far / global_near;
@@ -1149,25 +1903,19 @@ void updateViewVolumeData() {
 
 void drawFloor() {
 	modelMatrix.push();
-	glBindVertexArray(floorVAO);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	meshRegistry.draw(floorMesh);
 	modelMatrix.pop();
 }
 
 void drawCube() {
 	modelMatrix.push();
-	glBindVertexArray(cubeVAO);
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	meshRegistry.draw(cubeMesh);
 	modelMatrix.pop();
 }
 
 void drawPlane() {
 	modelMatrix.push();
-	glBindVertexArray(planeVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
+	meshRegistry.draw(planeMesh);
 	modelMatrix.pop();
 }
 
@@ -1191,7 +1939,7 @@ void drawROV(Shader shader) {
 	// Head
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.6f, 2.0f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(1.0f, 0.956862745f, 0.580392157f));
 	drawCube();
 	modelMatrix.pop();
@@ -1201,7 +1949,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.5f, 0.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.8f, 0.4f, 1.6f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.611764706f, 0.611764706f, 0.611764706f));
 	drawCube();
 	modelMatrix.pop();
@@ -1210,7 +1958,7 @@ void drawROV(Shader shader) {
 	modelMatrix.push();
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.95f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.3f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.1f, 0.1f, 0.1f));
 	drawCube();
 	modelMatrix.pop();
@@ -1220,7 +1968,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.2f, -0.4f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.2f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.4f, 0.4f, 0.4f));
 	drawSphere();
 	modelMatrix.pop();
@@ -1229,7 +1977,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.3f, 0.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.6f, 0.05f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1237,7 +1985,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.3f, 0.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.15f, 0.15f, 0.15f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.4f, 0.4f, 0.4f));
 	drawSphere();
 	modelMatrix.pop();
@@ -1246,7 +1994,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.5f)));
 	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 1.0f, 0.05f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1254,7 +2002,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -1.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 0.1f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.4f, 0.4f, 0.4f));
 	drawSphere();
 	modelMatrix.pop();
@@ -1264,7 +2012,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(-0.05f, 0.0f, 0.0f)));
 	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.2f, 0.2f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1273,7 +2021,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.05f, 0.0f, 0.0f)));
 	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.2f, 0.2f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1286,17 +2034,17 @@ void drawROV(Shader shader) {
 	//modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 0.6f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
 
 	modelMatrix.push();
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, 0.3f)));
-	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(ROVEngineAngle), glm::vec3(0.0f, 0.0f, 1.0f)));
+	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(renderState.rovEngineAngle), glm::vec3(0.0f, 0.0f, 1.0f)));
 	modelMatrix.push();
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.1f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.4f, 0.4f, 0.4f));
 	drawSphere();
 	modelMatrix.pop();
@@ -1304,7 +2052,7 @@ void drawROV(Shader shader) {
 	modelMatrix.push();
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1313,7 +2061,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(120.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1322,7 +2070,7 @@ void drawROV(Shader shader) {
 	modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(240.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
 	drawCube();
 	modelMatrix.pop();
@@ -1341,14 +2089,14 @@ void drawCamera(Shader shader) {
 	modelMatrix.push();
 		modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.8f, 1.8f)));
 		shader.setVec3("color", glm::vec3(0.2f, 0.2f, 0.2f));
-		shader.setMat4("model", modelMatrix.top());
+		setModelMatrix(shader, modelMatrix.top());
 		drawCube();
 
 		modelMatrix.push();
 			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.2f)));
 			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.6f, 0.6f, 1.2f)));
 			shader.setVec3("color", glm::vec3(0.25f, 0.25f, 0.25f));
-			shader.setMat4("model", modelMatrix.top());
+			setModelMatrix(shader, modelMatrix.top());
 			drawCube();
 		modelMatrix.pop();
 	modelMatrix.pop();
@@ -1361,7 +2109,7 @@ void drawAxis(Shader shader) {
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(1.5f, 0.0f, 0.0f)));
 	// modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(currentTime * 5), glm::vec3(0.0, 1.0, 0.0)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(3.0f, 0.1f, 0.1f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(1.0f, 0.0f, 0.0f));
 	drawCube();
 	modelMatrix.pop();
@@ -1370,7 +2118,7 @@ void drawAxis(Shader shader) {
 	modelMatrix.push();
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 1.5f, 0.0f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 3.0f, 0.1f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.0f, 1.0f, 0.0f));
 	drawCube();
 	modelMatrix.pop();
@@ -1378,7 +2126,7 @@ void drawAxis(Shader shader) {
 	modelMatrix.push();
 	modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, 1.5f)));
 	modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 3.0f)));
-	shader.setMat4("model", modelMatrix.top());
+	setModelMatrix(shader, modelMatrix.top());
 	shader.setVec3("color", glm::vec3(0.0f, 0.0f, 1.0f));
 	drawCube();
 	modelMatrix.pop();
@@ -1386,35 +2134,27 @@ void drawAxis(Shader shader) {
 	shader.setBool("isGlowObj", false);
 }
 
-void processROV(ROV_Movement direction, float deltaTime) {
-	float velocity = ROVMovementSpeed * deltaTime;
+void processROV(ROV_Movement direction, float speed, float deltaTime) {
+	float velocity = speed * deltaTime;
 	if (direction == ROV_Movement::ROV_FORWARD) {
 		ROVPosition += ROVFront * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
-		ROVEngineAngle += ROVMovementSpeed * 40 * velocity;
+		ROVEngineAngle += speed * 40 * velocity;
 		if (ROVEngineAngle > 360) {
 			ROVEngineAngle -= 360;
 		}
 	}
 	if (direction == ROV_Movement::ROV_BACKWARD) {
 		ROVPosition -= ROVFront * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
-		ROVEngineAngle -= ROVMovementSpeed * 40 * velocity;
+		ROVEngineAngle -= speed * 40 * velocity;
 		if (ROVEngineAngle < -360) {
 			ROVEngineAngle += 360;
 		}
 	}
 	if (direction == ROV_Movement::ROV_LEFT) {
 		ROVPosition -= ROVRight * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
 	}
 	if (direction == ROV_Movement::ROV_RIGHT) {
 		ROVPosition += ROVRight * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
 	}
 	if (direction == ROV_Movement::ROV_TURNLEFT) {
 		ROVYaw += 8 * velocity;
@@ -1431,59 +2171,311 @@ void processROV(ROV_Movement direction, float deltaTime) {
 		updateROVFront();
 	}
 	if (direction == ROV_Movement::ROV_UP) {
-		if (ROVPosition.y >= -3.0f && ROVPosition.y <= 0.7f) {
-			ROVPosition += glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
-			followCamera.updateTargetPosition(ROVPosition);
-		}
+		ROVPosition += glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
 		if (ROVPosition.y > 0.7f) {
 			ROVPosition.y = 0.7f;
 		}
 	}
+	// The seabed stops it now (see simulate)
 	if (direction == ROV_Movement::ROV_DOWN) {
-		if (ROVPosition.y >= -3.0f && ROVPosition.y <= 0.7f) {
-			ROVPosition -= glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
-			followCamera.updateTargetPosition(ROVPosition);
+		ROVPosition -= glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
+	}
+}
+
+void updateROVFront() {
+	glm::mat4 rotatematrix = glm::rotate(glm::mat4(1.0f), glm::radians(ROVYaw), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec4 front = rotatematrix * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+	ROVFront = glm::vec3(front.x, front.y, front.z);
+
+	ROVRight = glm::normalize(glm::cross(ROVFront, glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+SimState captureSimState(float time) {
+	SimState state;
+	state.time = time;
+	state.rovPosition = ROVPosition;
+	state.rovYaw = ROVYaw;
+	state.rovEngineAngle = ROVEngineAngle;
+	state.rovFront = ROVFront;
+	state.rovRight = ROVRight;
+	state.cameraPosition = simCameraPosition;
+	glm::vec3 orbit = glm::vec3(cos(time / 10) * 90.0f, sin(time / 10) * 90.0f, 0.0f);
+	state.sunPosition = glm::vec3(ROVPosition.x, 0.0f, ROVPosition.z) + orbit;
+	state.sunDirection = glm::normalize(orbit);
+	return state;
+}
+
+// Blend two angles (deg) the short way round, the ROV angles wrap at 360.
+float interpolateAngle(float previous, float current, float alpha) {
+	float difference = current - previous;
+	while (difference > 180.0f) {
+		difference -= 360.0f;
+	}
+	while (difference < -180.0f) {
+		difference += 360.0f;
+	}
+	return previous + difference * alpha;
+}
+
+SimState interpolateSimState(const SimState& previous, const SimState& current, float alpha) {
+	SimState state;
+	state.time = glm::mix(previous.time, current.time, alpha);
+	state.rovPosition = glm::mix(previous.rovPosition, current.rovPosition, alpha);
+	state.rovYaw = interpolateAngle(previous.rovYaw, current.rovYaw, alpha);
+	state.rovEngineAngle = interpolateAngle(previous.rovEngineAngle, current.rovEngineAngle, alpha);
+	state.rovFront = current.rovFront;
+	state.rovRight = current.rovRight;
+	state.cameraPosition = glm::mix(previous.cameraPosition, current.cameraPosition, alpha);
+	state.sunPosition = glm::mix(previous.sunPosition, current.sunPosition, alpha);
+	state.sunDirection = glm::normalize(glm::mix(previous.sunDirection, current.sunDirection, alpha));
+	return state;
+}
+
+// Model matrices of grass, fish and boxes for this frame, split into ranges over the job system.
+void buildInstanceMatrices(float time) {
+	jobs::Counter counter(0);
+
+	grassInstances.matrices.resize(grassInstances.positions.size());
+	jobs::get().parallelFor(grassInstances.positions.size(), INSTANCE_GRAIN, [](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			grassInstances.matrices[i] = glm::translate(glm::mat4(1.0f), grassInstances.positions[i]);
 		}
-		if (ROVPosition.y < -3.0f) {
-			ROVPosition.y = -3.0f;
+	}, counter, Pass::PASS_INSTANCE_MATRICES);
+
+	// Each fish faces where it swims, the quad is centered on its position between the last two simulation steps.
+	// GPU fish build their matrices in the vertex shader.
+	fishInstances.matrices.resize((activeFishBackend == FishBackend::FISH_CPU) ? world->fishCurrent.size() : 0);
+	jobs::get().parallelFor(fishInstances.matrices.size(), INSTANCE_GRAIN, [](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			// A fish the last step added has no previous position
+			glm::vec3 position = world->fishCurrent[i];
+			if (i < world->fishPrevious.size()) {
+				position = glm::mix(world->fishPrevious[i], position, simAlpha);
+			}
+			glm::vec3 velocity = world->fishVelocities[i];
+			float speed = std::max(glm::length(velocity), 1e-4f);
+			glm::mat4 matrix = glm::translate(glm::mat4(1.0f), position);
+			matrix = glm::rotate(matrix, atan2(-velocity.z, velocity.x), glm::vec3(0.0f, 1.0f, 0.0f));
+			matrix = glm::rotate(matrix, asin(glm::clamp(velocity.y / speed, -1.0f, 1.0f)), glm::vec3(0.0f, 0.0f, 1.0f));
+			matrix = glm::scale(matrix, glm::vec3(1.0f, 0.5f, 0.5f));
+			fishInstances.matrices[i] = glm::translate(matrix, glm::vec3(-0.5f, -0.5f, 0.0f));
 		}
-	}
+	}, counter, Pass::PASS_INSTANCE_MATRICES);
+
+	boxInstances.matrices.resize(boxInstances.positions.size());
+	jobs::get().parallelFor(boxInstances.positions.size(), INSTANCE_GRAIN, [time](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			const glm::vec3& position = boxInstances.positions[i];
+			boxInstances.matrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3(position.x, sin(time * 3 + position.z) / 4, position.z));
+		}
+	}, counter, Pass::PASS_INSTANCE_MATRICES);
+
+	jobs::get().wait(counter);
 }
 
-void checkNoGetOut() {
-	if (ROVPosition.x > 98.0f) {
-		ROVPosition.x = 98.0f;
+// Mark the instances whose bounding sphere touches the view frustum, returns how many are visible.
+unsigned int cullInstances(const glm::mat4& viewProjection) {
+	frustum::Frustum viewFrustum = frustum::extract(viewProjection, reversez::get().isReversed());
+	InstanceGroup* groups[] = { &grassInstances, &fishInstances, &boxInstances };
+	std::atomic<unsigned int> visibleCount(0);
+	jobs::Counter counter(0);
+	for (InstanceGroup* group : groups) {
+		group->visible.resize(group->matrices.size());
+		jobs::get().parallelFor(group->matrices.size(), INSTANCE_GRAIN, [group, &viewFrustum, &visibleCount](unsigned int begin, unsigned int end) {
+			unsigned int visible = 0;
+			for (unsigned int i = begin; i < end; i++) {
+				glm::vec3 center;
+				float radius;
+				frustum::transformSphere(group->matrices[i], group->boundCenter, group->boundRadius, center, radius);
+				group->visible[i] = frustum::intersectsSphere(viewFrustum, center, radius);
+				visible += group->visible[i];
+			}
+			visibleCount.fetch_add(visible, std::memory_order_relaxed);
+		}, counter, Pass::PASS_CULLING);
 	}
+	jobs::get().wait(counter);
+
+	unsigned int total = grassInstances.matrices.size() + fishInstances.matrices.size() + boxInstances.matrices.size();
+	instancesCulled += total - visibleCount;
+	return visibleCount;
+}
 
-	if (ROVPosition.x < -98.0f) {
-		ROVPosition.x = -98.0f;
+// Draw the shadow cascades that are due this frame. The ones drawn every frame get all casters,
+// the cached ones only the static casters: seabed, grass, boxes and the scene file.
+void renderShadows(Shader& shader) {
+	glm::vec3 lodCenter = (isGhost) ? camera.Position : followCamera.Position;
+	sunShadows.update(nearPlaneVertex, farPlaneVertex, global_near, global_far, sunDirection, seabedStreamer.getVersion());
+	if (!sunShadows.isShadowing()) {
+		return;
 	}
 
-	if (ROVPosition.z > 98.0f) {
-		ROVPosition.z = 98.0f;
+	// Instances inside each due cascade, one upload for all of them
+	InstanceGroup* groups[] = { &grassInstances, &boxInstances, &fishInstances };
+	unsigned int meshes[] = { planeMesh, cubeMesh, planeMesh };
+	unsigned int textures[] = { grassTexture, 0, fishTexture };
+	frustum::Frustum cascadeFrustums[shadows::CASCADE_COUNT];
+	shadowCasters.clear();
+	for (int i = 0; i < shadows::CASCADE_COUNT; i++) {
+		if (!sunShadows.getCascade(i).isDue) {
+			continue;
+		}
+		cascadeFrustums[i] = sunShadows.getFrustum(i);
+		int groupCount = (i < shadows::FIRST_CACHED_CASCADE) ? 3 : 2;
+		for (int j = 0; j < groupCount; j++) {
+			shadowCasters.begin(i, meshes[j], textures[j]);
+			for (const glm::mat4& matrix : groups[j]->matrices) {
+				glm::vec3 center;
+				float radius;
+				frustum::transformSphere(matrix, groups[j]->boundCenter, groups[j]->boundRadius, center, radius);
+				if (frustum::intersectsSphere(cascadeFrustums[i], center, radius)) {
+					shadowCasters.add(matrix);
+				}
+			}
+		}
 	}
+	shadowCasters.upload();
+
+	shader.use();
+	shader.setBool("isCubeMap", false);
+	sunShadows.begin();
+	for (int i = 0; i < shadows::CASCADE_COUNT; i++) {
+		const shadows::Cascade& cascade = sunShadows.getCascade(i);
+		if (!cascade.isDue) {
+			continue;
+		}
+		sunShadows.beginCascade(i);
+
+		// drawSphere() picks its LOD with these
+		view = cascade.view;
+		projection = cascade.projection;
+		viewportHeight = sunShadows.Size;
+		shader.setMat4("view", view);
+		shader.setMat4("projection", projection);
+		shader.setBool("enableTexture", false);
+
+		seabedTerrain.select(seabedStreamer, lodCenter, cascadeFrustums[i]);
+		seabedTerrain.draw(shader, meshRegistry, seabedStreamer.getHeightTexture(), lodCenter);
+		shadowCasters.draw(shader, meshRegistry, i);
+		loadedScene.draw(shader, meshRegistry, cascadeFrustums[i]);
+		shader.setBool("enableTexture", false);
+		if (i >= shadows::FIRST_CACHED_CASCADE) {
+			continue;
+		}
 
-	if (ROVPosition.z < -98.0f) {
-		ROVPosition.z = -98.0f;
+		if (activeFishBackend == FishBackend::FISH_GPU) {
+			shader.setBool("enableTexture", true);
+			drawGpuFish(shader);
+			shader.setBool("enableTexture", false);
+		}
+		modelMatrix.push();
+			modelMatrix.save(glm::translate(modelMatrix.top(), renderState.rovPosition));
+			modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(renderState.rovYaw), glm::vec3(0.0, 1.0, 0.0)));
+			setModelMatrix(shader, modelMatrix.top());
+			drawROV(shader);
+		modelMatrix.pop();
 	}
+	sunShadows.end();
 }
 
-void updateROVFront() {
-	glm::mat4 rotatematrix = glm::rotate(glm::mat4(1.0f), glm::radians(ROVYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::vec4 front = rotatematrix * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
-	ROVFront = glm::vec3(front.x, front.y, front.z);
+// The whole school in one draw, straight from the GPU state (no culling, the CPU never sees the positions).
+void drawGpuFish(Shader& shader) {
+	shader.setBool("isFishInstanced", true);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, gpuFlock.getPositionTexture());
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, gpuFlock.getVelocityTexture());
+	glActiveTexture(GL_TEXTURE12);
+	glBindTexture(GL_TEXTURE_2D, gpuFlock.getPreviousPositionTexture());
+	shader.setFloat("fishAlpha", gpuFlockClock.getAlpha());
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fishTexture);
+	meshRegistry.drawInstanced(planeMesh, gpuFlock.size());
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE12);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	shader.setBool("isFishInstanced", false);
+}
 
-	ROVRight = glm::normalize(glm::cross(ROVFront, glm::vec3(0.0f, 1.0f, 0.0f)));
+// Two searchlights under the front of the ROV and one pulsing light in every glowing prop.
+void updateLights(float time) {
+	lightGrid.clear();
+	if (rovSearchlights) {
+		glm::vec3 direction = glm::normalize(renderState.rovFront + glm::vec3(0.0f, -0.35f, 0.0f));
+		for (float side = -1.0f; side <= 1.0f; side += 2.0f) {
+			glm::vec3 position = renderState.rovPosition + renderState.rovFront * 1.05f + renderState.rovRight * (0.35f * side) + glm::vec3(0.0f, -0.3f, 0.0f);
+			lightGrid.add(clusters::makeSpot(position, direction, glm::vec3(1.0f, 0.95f, 0.85f) * 40.0f, 45.0f, 12.0f, 22.0f));
+		}
+	}
+	for (int color = 0; color < GLOW_PALETTE_SIZE; color++) {
+		for (unsigned int i = glowPaletteFirst[color]; i < glowPaletteFirst[color + 1]; i++) {
+			float pulse = 1.4f + 0.6f * sin(time * 1.7f + glowPhases[i]);
+			lightGrid.add(clusters::makePoint(glm::vec3(glowProps[i]), GLOW_PALETTE[color] * pulse, GLOW_LIGHT_RANGE));
+		}
+	}
+	lightGrid.upload();
+}
+
+// One instanced draw per palette color through the scene instance path (position and scale per texel).
+void drawGlowProps(Shader& shader) {
+	if (glowProps.empty()) {
+		return;
+	}
+	glActiveTexture(GL_TEXTURE0 + scene::INSTANCE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, glowPropTexture);
+	glActiveTexture(GL_TEXTURE0);
+	shader.setBool("isSceneInstanced", true);
+	shader.setBool("isGlowObj", true);
+	shader.setBool("enableTexture", false);
+	unsigned int mesh = sphereMesh[sphereType][sphere::LOD_COUNT - 2];
+	for (int color = 0; color < GLOW_PALETTE_SIZE; color++) {
+		shader.setVec3("color", GLOW_PALETTE[color]);
+		shader.setInt("sceneFirstInstance", glowPaletteFirst[color]);
+		meshRegistry.drawInstanced(mesh, glowPaletteFirst[color + 1] - glowPaletteFirst[color]);
+	}
+	instancesDrawn += glowProps.size();
+	shader.setBool("isSceneInstanced", false);
+	shader.setBool("isGlowObj", false);
+	glActiveTexture(GL_TEXTURE0 + scene::INSTANCE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
 }
 
+// Draw a unit sphere with modelMatrix.top(), the LOD is picked from its size on the current viewport.
 void drawSphere() {
 	modelMatrix.push();
-	glBindVertexArray(sphereVAO);
-	glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	unsigned int lod = 0;
+	if (enableSphereLOD) {
+		lod = sphere::selectLOD(sphere::getProjectedRadius(modelMatrix.top(), view, projection, (float)viewportHeight));
+	}
+	sphereTriangles += meshRegistry.get(sphereMesh[sphereType][lod]).indexCount / 3;
+	meshRegistry.draw(sphereMesh[sphereType][lod]);
 	modelMatrix.pop();
 }
 
+// Upload the model matrix with its normal matrix (computed once per object rather than per vertex;
+// on llvmpipe this measured within noise, so it is a tidy-up rather than a speed-up).
+void setModelMatrix(Shader& shader, glm::mat4 matrix) {
+	shader.setMat4("model", matrix);
+
+	// Rotation with a uniform scale keeps normals parallel (the fragment shader normalizes them),
+	// only non-uniform scale needs the inverse transpose.
+	glm::mat3 linear = glm::mat3(matrix);
+	float xx = glm::dot(linear[0], linear[0]);
+	float yy = glm::dot(linear[1], linear[1]);
+	float zz = glm::dot(linear[2], linear[2]);
+	float epsilon = 1e-4f * glm::max(xx, glm::max(yy, zz));
+	bool isUniform = glm::abs(xx - yy) < epsilon && glm::abs(yy - zz) < epsilon
+		&& glm::abs(glm::dot(linear[0], linear[1])) < epsilon
+		&& glm::abs(glm::dot(linear[1], linear[2])) < epsilon
+		&& glm::abs(glm::dot(linear[0], linear[2])) < epsilon;
+
+	shader.setMat3("normalMatrix", isUniform ? linear : glm::transpose(glm::inverse(linear)));
+}
+
 void setFullScreen() {
 	// Create Window
 	if (isfullscreen) {
@@ -1507,28 +2499,37 @@ void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
 
 	// Reset projection matrix and viewport
 	if (isGhost) {
-		projection = GetPerspectiveProjMatrix(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 250.0f);
+		projection = GetPerspectiveProjMatrix(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, global_near, global_far);
 	} else {
-		projection = GetPerspectiveProjMatrix(glm::radians(followCamera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 250.0f);
+		projection = GetPerspectiveProjMatrix(glm::radians(followCamera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, global_near, global_far);
 	}
 	glViewport(0, 0, width, height);
+
+	// Minimized window reports a zero size
+	if (width > 0 && height > 0) {
+		renderTarget.resize(width, height);
+	}
 }
 
-// Handle the input which in the main loop
+// Handle the input which in the main loop, the simulation thread applies it
 void processInput(GLFWwindow* window) {
+	SimInput& input = simInputBuffer.write();
+	input.isGhost = isGhost;
+	input.keys = 0;
+	input.rovSpeed = ROVMovementSpeed;
 	if (isGhost) {
 		// like ghost, u can go any where.
 		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::FORWARD, deltaTime);
+			input.keys |= 1 << Camera_Movement::FORWARD;
 		}
 		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::BACKWARD, deltaTime);
+			input.keys |= 1 << Camera_Movement::BACKWARD;
 		}
 		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::LEFT, deltaTime);
+			input.keys |= 1 << Camera_Movement::LEFT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::RIGHT, deltaTime);
+			input.keys |= 1 << Camera_Movement::RIGHT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
 			camera.MovementSpeed = 25.0f;
@@ -1539,28 +2540,28 @@ void processInput(GLFWwindow* window) {
 	} else {
 		// Oh~ poor guy, u only can move the ROV.
 		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_FORWARD, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_FORWARD;
 		}
 		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_BACKWARD, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_BACKWARD;
 		}
 		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_LEFT, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_LEFT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_RIGHT, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_RIGHT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_TURNLEFT, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_TURNLEFT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_TURNRIGHT, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_TURNRIGHT;
 		}
 		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_UP, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_UP;
 		}
 		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_DOWN, deltaTime);
+			input.keys |= 1 << ROV_Movement::ROV_DOWN;
 		}
 		if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
 			followCamera.AdjustDistance(-0.5);
@@ -1569,6 +2570,301 @@ void processInput(GLFWwindow* window) {
 			followCamera.AdjustDistance(0.5);
 		}
 	}
+	input.cameraSpeed = camera.MovementSpeed;
+	input.cameraFront = camera.Front;
+	input.cameraRight = camera.Right;
+	input.isFishSimulated = activeFishBackend == FishBackend::FISH_CPU;
+	input.fishCount = fishCount;
+	input.fishSettings = fishSettings;
+	simInputBuffer.publish();
+}
+
+// Grass and box positions of every resident chunk (main thread, whenever the resident set changes)
+void gatherChunkInstances() {
+	grassInstances.positions.clear();
+	boxInstances.positions.clear();
+	std::vector<glm::vec3> glow;
+	for (const chunks::Chunk& chunk : seabedStreamer.getChunks()) {
+		if (chunk.isSurrounded) {
+			grassInstances.positions.insert(grassInstances.positions.end(), chunk.grass.begin(), chunk.grass.end());
+			boxInstances.positions.insert(boxInstances.positions.end(), chunk.boxes.begin(), chunk.boxes.end());
+			glow.insert(glow.end(), chunk.glow.begin(), chunk.glow.begin() + std::min<size_t>(glowPerChunk, chunk.glow.size()));
+		}
+	}
+	gatheredChunkVersion = seabedStreamer.getVersion();
+
+	// Color, size and pulse phase of a prop come from its position, props of one color are drawn together
+	glowProps.clear();
+	glowPhases.clear();
+	for (int color = 0; color < GLOW_PALETTE_SIZE; color++) {
+		glowPaletteFirst[color] = glowProps.size();
+		for (const glm::vec3& position : glow) {
+			uint32_t hash = chunks::hashCoords((int)floor(position.x * 64.0f), (int)floor(position.z * 64.0f), chunks::Scatter::SCATTER_GLOW);
+			if ((int)(hash % GLOW_PALETTE_SIZE) == color) {
+				glowProps.push_back(glm::vec4(position, 0.1f + 0.15f * ((hash >> 8) & 255) / 255.0f));
+				glowPhases.push_back(((hash >> 16) & 255) / 255.0f * 6.2831853f);
+			}
+		}
+	}
+	glowPaletteFirst[GLOW_PALETTE_SIZE] = glowProps.size();
+
+	// The props stay put, one upload per gather
+	if (!glowPropBuffer) {
+		glGenBuffers(1, &glowPropBuffer);
+		glGenTextures(1, &glowPropTexture);
+		glBindBuffer(GL_TEXTURE_BUFFER, glowPropBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, glowPropTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, glowPropBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, glowPropBuffer);
+	// Never a zero sized buffer, an empty vector has no data to read from
+	glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(glowProps.size(), 1) * sizeof(glm::vec4), glowProps.empty() ? NULL : glowProps.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Boxes of the 3 x 3 chunks around the position (simulation thread), rebuilt when it enters another chunk.
+// Boxes bob like in buildInstanceMatrices, y = sin(time * 3 + z) / 4
+void updateCollisionWorld(const glm::vec3& center) {
+	int chunkX = chunks::getChunkCoord(center.x);
+	int chunkZ = chunks::getChunkCoord(center.z);
+	if (chunkX == collisionChunkX && chunkZ == collisionChunkZ) {
+		return;
+	}
+	collisionChunkX = chunkX;
+	collisionChunkZ = chunkZ;
+
+	std::vector<glm::vec3> positions;
+	for (int z = chunkZ - 1; z <= chunkZ + 1; z++) {
+		for (int x = chunkX - 1; x <= chunkX + 1; x++) {
+			chunks::scatter(x, z, chunks::Scatter::SCATTER_BOXES, boxCount, positions);
+		}
+	}
+	std::vector<collision::Obstacle> obstacles;
+	for (const glm::vec3& position : positions) {
+		collision::Obstacle obstacle;
+		obstacle.box.center = glm::vec3(position.x, 0.0f, position.z);
+		obstacle.box.halfExtents = glm::vec3(0.5f);
+		obstacle.box.axes = glm::mat3(1.0f);
+		obstacle.bobAmplitude = 0.25f;
+		obstacle.bobFrequency = 3.0f;
+		obstacle.bobPhase = position.z;
+		obstacles.push_back(obstacle);
+	}
+	collisionWorld.SeabedHeight = chunks::getSeabedHeight;
+	collisionWorld.build(obstacles, 4.0f);
+}
+
+// The school stays around the ROV wherever it goes.
+boids::Params getSchoolSettings(boids::Params settings, const glm::vec3& center) {
+	glm::vec3 schoolCenter = glm::vec3(center.x, 0.0f, center.z);
+	settings.boundsMin = schoolCenter + glm::vec3(-60.0f, -4.0f, -60.0f);
+	settings.boundsMax = schoolCenter + glm::vec3(60.0f, 8.0f, 60.0f);
+	return settings;
+}
+
+// Advance the world by one fixed step (simulation thread), time is the simulation time at the end of the step
+void simulate(const SimInput& input, float step, float time) {
+	if (input.isGhost) {
+		float velocity = input.cameraSpeed * step;
+		if (input.keys & (1 << Camera_Movement::FORWARD)) {
+			simCameraPosition += input.cameraFront * velocity;
+		}
+		if (input.keys & (1 << Camera_Movement::BACKWARD)) {
+			simCameraPosition -= input.cameraFront * velocity;
+		}
+		if (input.keys & (1 << Camera_Movement::LEFT)) {
+			simCameraPosition -= input.cameraRight * velocity;
+		}
+		if (input.keys & (1 << Camera_Movement::RIGHT)) {
+			simCameraPosition += input.cameraRight * velocity;
+		}
+	} else {
+		// Same order the keys were handled in before
+		const ROV_Movement order[] = { ROV_FORWARD, ROV_BACKWARD, ROV_LEFT, ROV_RIGHT, ROV_TURNLEFT, ROV_TURNRIGHT, ROV_UP, ROV_DOWN };
+		glm::vec3 start = ROVPosition;
+		updateCollisionWorld(start);
+		for (ROV_Movement direction : order) {
+			if (input.keys & (1 << direction)) {
+				processROV(direction, input.rovSpeed, step);
+			}
+		}
+		// Sweep from where the step started to where the keys took it, the boxes stand where they are at the end of the step
+		std::chrono::high_resolution_clock::time_point collisionStart = std::chrono::high_resolution_clock::now();
+		ROVPosition = collisionWorld.move(ROVShape, ROVYaw, start, ROVPosition, time);
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - collisionStart;
+		collisionCost = (float)elapsed.count();
+	}
+
+	// The ROV scares the fish away
+	if (input.isFishSimulated) {
+		{
+			std::lock_guard<std::mutex> guard(fishHandoffLock);
+			if (hasFishHandoff) {
+				flock = fishHandoff;
+				hasFishHandoff = false;
+			}
+		}
+		flock.Settings = getSchoolSettings(input.fishSettings, ROVPosition);
+		if ((int)flock.size() != input.fishCount) {
+			flock.resize(input.fishCount);
+		}
+		flock.copyPositions(simFishPrevious);
+		flock.update(step, ROVPosition, Pass::PASS_FISH_UPDATE);
+	}
+}
+
+// Runs the fixed steps until simRunning is cleared, vsync waits of the main thread never hold it up.
+void simulationLoop() {
+	trace::get().setThreadName("Simulation");
+	jobs::get().attach(SIM_JOB_QUEUE);
+	FixedTimestep clock(SIM_RATE);
+	SimState previous = captureSimState(0.0f);
+	SimState current = previous;
+	unsigned int steps = 0;
+	float stepCost = 0.0f;
+	bool isFishSimulated = false;
+	double lastTime = glfwGetTime();
+	while (simRunning) {
+		double now = glfwGetTime();
+		int count = clock.advance((float)(now - lastTime));
+		lastTime = now;
+		for (int i = 0; i < count; i++) {
+			trace::Scope scope("Simulation Step");
+			double start = glfwGetTime();
+			previous = current;
+			const SimInput& input = simInputBuffer.read();
+			simulate(input, clock.Step, previous.time + clock.Step);
+			isFishSimulated = input.isFishSimulated;
+			current = captureSimState(previous.time + clock.Step);
+			stepCost = (float)((glfwGetTime() - start) * 1000.0);
+			steps++;
+		}
+		if (count > 0) {
+			WorldSnapshot& snapshot = worldBuffer.write();
+			snapshot.previous = previous;
+			snapshot.current = current;
+			snapshot.stepTime = now - clock.getAlpha() * clock.Step;
+			snapshot.steps = steps;
+			snapshot.stepCost = stepCost;
+			snapshot.collisionCost = collisionCost;
+			snapshot.collisionCandidates = collisionWorld.LastCandidates;
+			snapshot.collisionBoxes = collisionWorld.size();
+			if (isFishSimulated) {
+				// simFishPrevious is refilled by every step, the swap only reuses the slot's memory
+				snapshot.fishPrevious.swap(simFishPrevious);
+				flock.copyPositions(snapshot.fishCurrent);
+				flock.copyVelocities(snapshot.fishVelocities);
+			} else {
+				snapshot.fishPrevious.clear();
+				snapshot.fishCurrent.clear();
+				snapshot.fishVelocities.clear();
+			}
+			snapshot.flockGridTime = flock.LastGridTime;
+			snapshot.flockSteerTime = flock.LastSteerTime;
+			worldBuffer.publish();
+		}
+		// Sleep until the next step is due
+		std::this_thread::sleep_for(std::chrono::duration<double>((1.0f - clock.getAlpha()) * clock.Step));
+	}
+}
+
+// Demo content: textured crates and plain boulders resting on the seabed, one group per chunk.
+void buildDemoScene(scene::Writer& writer, unsigned int count) {
+	std::vector<PackedVertex> vertices;
+	std::vector<unsigned char> indices;
+	const Mesh& cube = meshRegistry.get(cubeMesh);
+	meshRegistry.read(cubeMesh, vertices, indices);
+	unsigned int crateMesh = writer.addMesh("Cube", vertices.data(), vertices.size(), indices.data(), cube.indexType, cube.indexCount);
+	const Mesh& sphere = meshRegistry.get(sphereMesh[sphere::SphereType::ICO_SPHERE][2]);
+	meshRegistry.read(sphereMesh[sphere::SphereType::ICO_SPHERE][2], vertices, indices);
+	unsigned int boulderMesh = writer.addMesh("Icosphere", vertices.data(), vertices.size(), indices.data(), sphere.indexType, sphere.indexCount);
+	unsigned int crateMaterial = writer.addMaterial("Resources\\Textures\\container2.png", glm::vec3(1.0f), 64.0f);
+	unsigned int boulderMaterial = writer.addMaterial("", glm::vec3(0.45f, 0.42f, 0.38f), 16.0f);
+
+	std::mt19937 generator(43);
+	std::uniform_real_distribution<float> position(-SCENE_EXTENT, SCENE_EXTENT);
+	std::uniform_real_distribution<float> scale(0.5f, 2.5f);
+	std::vector<scene::Instance> crates, boulders;
+	for (unsigned int i = 0; i < count; i++) {
+		float x = position(generator);
+		float z = position(generator);
+		float s = scale(generator);
+		if (i % 2 == 0) {
+			crates.push_back({ { x, chunks::getSeabedHeight(x, z) + s * 0.5f, z }, s });
+		} else {
+			boulders.push_back({ { x, chunks::getSeabedHeight(x, z) + s * 0.3f, z }, s });
+		}
+	}
+	writer.addGroups("Crates", crateMesh, crateMaterial, crates, chunks::CHUNK_SIZE, 0.87f);
+	writer.addGroups("Boulders", boulderMesh, boulderMaterial, boulders, chunks::CHUNK_SIZE, 1.0f);
+}
+
+// Writes a demo scene, then loads it twice: mapped and handed to GL as it is, and read into memory with
+// the instances copied out before the upload (what a parsing loader does). A first untimed upload puts the
+// material textures into the asset cache, so neither side includes texture loading.
+void benchmarkScene(unsigned int count) {
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+	const std::string path = "scene_benchmark.bin";
+
+	scene::Writer writer;
+	buildDemoScene(writer, count);
+	Clock::time_point start = Clock::now();
+	if (!writer.write(path)) {
+		std::remove(path.c_str());
+		return;
+	}
+	double writeTime = Milliseconds(Clock::now() - start).count();
+
+	scene::Scene mapped;
+	scene::GpuScene gpuScene;
+	if (mapped.load(path) && gpuScene.upload(mapped, meshRegistry, assetCache)) {
+		gpuScene.release();
+	}
+	start = Clock::now();
+	if (!mapped.load(path)) {
+		std::remove(path.c_str());
+		return;
+	}
+	double mapTime = Milliseconds(Clock::now() - start).count();
+	start = Clock::now();
+	gpuScene.upload(mapped, meshRegistry, assetCache);
+	glFinish();
+	double mapUploadTime = Milliseconds(Clock::now() - start).count();
+	uint64_t fileSize = mapped.getFileSize();
+	gpuScene.release();
+	mapped.close();
+
+	start = Clock::now();
+	std::ifstream file(path, std::ios::binary);
+	std::vector<char> bytes((size_t)fileSize);
+	file.read(bytes.data(), bytes.size());
+	file.close();
+	const scene::Section* sections = (const scene::Section*)(bytes.data() + sizeof(scene::FileHeader));
+	const scene::Section& instanceSection = sections[scene::SectionType::SECTION_INSTANCES];
+	const scene::Instance* first = (const scene::Instance*)(bytes.data() + instanceSection.offset);
+	std::vector<scene::Instance> instances(first, first + instanceSection.count);
+	double readTime = Milliseconds(Clock::now() - start).count();
+	start = Clock::now();
+	unsigned int buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(scene::Instance), instances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glFinish();
+	double readUploadTime = Milliseconds(Clock::now() - start).count();
+	glDeleteBuffers(1, &buffer);
+	// Only the numbers are kept
+	std::remove(path.c_str());
+
+	char line[256];
+	snprintf(line, sizeof(line), "Scene of %u instances (%.1f MB): write %.1f ms", count, fileSize / (1024.0 * 1024.0), writeTime);
+	logging::loggingMessage(logging::LogType::INFO, line);
+	snprintf(line, sizeof(line), "  mapped: open + validate %.2f ms, upload %.2f ms, total %.2f ms", mapTime, mapUploadTime, mapTime + mapUploadTime);
+	logging::loggingMessage(logging::LogType::INFO, line);
+	snprintf(line, sizeof(line), "  read + copy: %.2f ms, upload %.2f ms, total %.2f ms", readTime, readUploadTime, readTime + readUploadTime);
+	logging::loggingMessage(logging::LogType::INFO, line);
 }
 
 // Handle the key callback
@@ -1706,39 +3002,86 @@ void errorCallback(int error, const char* description) {
 	logging::loggingMessage(logging::LogType::ERROR, description);
 }
 
+// Upload the cooked version of source (see Tools/texturecooker.cpp) to the texture bound to target, straight from
+// the mapped file. False when there is none or the driver cannot sample its format, the caller decodes the source then.
+bool loadCookedTexture(GLenum target, const std::string& source, bool isMipmapped, int& channels) {
+	std::string path = cooked::getCookedPath(source);
+	if (!std::ifstream(path).good()) {
+		return false;
+	}
+	scene::MappedFile file;
+	if (!file.open(path)) {
+		return false;
+	}
+	const cooked::FileHeader* header = cooked::validate(file.getData(), file.getSize());
+	if (!header) {
+		logging::loggingMessage(logging::LogType::WARNING, "Invalid cooked texture, loading the source instead: " + path);
+		return false;
+	}
+	if (!isTextureFormatSupported(header->glInternalFormat)) {
+		logging::loggingMessage(logging::LogType::WARNING, std::string("No ") + cooked::FORMAT_NAMES[header->format] + " support, loading the source instead: " + path);
+		return false;
+	}
+
+	const cooked::Level* levels = (const cooked::Level*)(file.getData() + sizeof(cooked::FileHeader));
+	GLint levelCount = isMipmapped ? header->levelCount : 1;
+	for (GLint i = 0; i < levelCount; i++) {
+		GLsizei width = std::max(1, (int)(header->width >> i));
+		GLsizei height = std::max(1, (int)(header->height >> i));
+		const char* data = file.getData() + levels[i].offset;
+		if (header->format == cooked::FORMAT_RGBA8) {
+			glTexImage2D(target, i, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		} else {
+			glCompressedTexImage2D(target, i, header->glInternalFormat, width, height, 0, (GLsizei)levels[i].size, data);
+		}
+	}
+	glTexParameteri(target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	channels = header->channels;
+	return true;
+}
+
+// Compressed formats the driver reports, uncompressed ones are always there.
+bool isTextureFormatSupported(GLenum format) {
+	static std::vector<GLint> compressedFormats;
+	if (compressedFormats.empty()) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+		compressedFormats.resize(count + 1, 0);
+		glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, compressedFormats.data());
+	}
+	return format == GL_RGBA8 || std::find(compressedFormats.begin(), compressedFormats.end(), (GLint)format) != compressedFormats.end();
+}
+
 // Loading Texture
 unsigned int loadTexture(char const* path) {
+	trace::Scope scope(std::string("Load Texture ") + path);
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data) {
-		GLenum format;
-		if (nrComponents == 1) {
-			format = GL_RED;
-		}
-		else if (nrComponents == 3) {
-			format = GL_RGB;
-		}
-		else if (nrComponents == 4) {
-			format = GL_RGBA;
-		}
+	// A cooked version comes with its mip chain, nothing to decode or generate
+	int cookedChannels;
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	if (loadCookedTexture(GL_TEXTURE_2D, path, true, cookedChannels)) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, cookedChannels == 4 ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, cookedChannels == 4 ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return textureID;
+	}
 
+	// Mip chain built on the CPU (by textureBatch ahead of time, or now)
+	mipchain::Chain chain;
+	if (textureBatch.take(path, chain) || mipchain::load(path, chain, true)) {
 		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		uploadMipChain(GL_TEXTURE_2D, chain);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, chain.channels == 4 ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, chain.channels == 4 ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
 	}
 	else {
 		std::cout << "Failed to load texture at path:" << path << std::endl;
-		stbi_image_free(data);
 	}
 
 	return textureID;
@@ -1746,24 +3089,29 @@ unsigned int loadTexture(char const* path) {
 
 // Loading Cubemap
 unsigned int loadCubemap(std::vector<std::string> faces) {
+	trace::Scope scope("Load Cubemap");
 
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++) {
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
+	// Cooked faces only if every face has one, the faces of a cube map must share their format
+	bool isCooked = true;
+	for (unsigned int i = 0; i < faces.size() && isCooked; i++) {
+		int cookedChannels;
+		isCooked = loadCookedTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i], true, cookedChannels);
+	}
+
+	for (unsigned int i = 0; i < faces.size() && !isCooked; i++) {
+		mipchain::Chain chain;
+		if (textureBatch.take(faces[i], chain) || mipchain::load(faces[i], chain, true)) {
+			uploadMipChain(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, chain);
 		}
 		else {
 			std::cout << "Failed to load Cubemap texture at path:" << faces[i] << std::endl;
-			stbi_image_free(data);
 		}
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -1772,6 +3120,17 @@ unsigned int loadCubemap(std::vector<std::string> faces) {
 	return textureID;
 }
 
+// Upload every level of the chain, its rows are tightly packed.
+void uploadMipChain(GLenum target, const mipchain::Chain& chain) {
+	const GLenum FORMATS[] = { GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	GLenum format = FORMATS[chain.channels];
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (unsigned int level = 0; level < chain.levels.size(); level++) {
+		glTexImage2D(target, level, format, chain.levels[level].width, chain.levels[level].height, 0, format, GL_UNSIGNED_BYTE, chain.levels[level].pixels.data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
 glm::mat4 GetPerspectiveProjMatrix(float fovy, float ascept, float znear, float zfar) {
 
 	glm::mat4 proj = glm::mat4(1.0f);
@@ -1786,10 +3145,16 @@ glm::mat4 GetPerspectiveProjMatrix(float fovy, float ascept, float znear, float
 	proj[2][1] = 0;
 	proj[3][1] = 0;
 
+	// Depth: near to -1 and far to 1, or near to 1 and far to 0 when reversed; an infinite far plane is the limit of zfar
 	proj[0][2] = 0;
 	proj[1][2] = 0;
-	proj[2][2] = -(zfar + znear) / (zfar - znear);
-	proj[3][2] = (-2 * zfar * znear) / (zfar - znear);
+	if (reversez::get().isReversed()) {
+		proj[2][2] = (reversez::get().IsInfinite) ? 0.0f : znear / (zfar - znear);
+		proj[3][2] = (reversez::get().IsInfinite) ? znear : zfar * znear / (zfar - znear);
+	} else {
+		proj[2][2] = (reversez::get().IsInfinite) ? -1.0f : -(zfar + znear) / (zfar - znear);
+		proj[3][2] = (reversez::get().IsInfinite) ? -2 * znear : (-2 * zfar * znear) / (zfar - znear);
+	}
 
 	proj[0][3] = 0;
 	proj[1][3] = 0;
@@ -1812,10 +3177,16 @@ glm::mat4 GetOrthoProjMatrix(float left, float right, float bottom, float top, f
 	proj[2][1] = 0;
 	proj[3][1] = -(top + bottom) / (top - bottom);
 
+	// Depth is linear here, reversed maps near to 1 and far to 0 (there is no infinite orthogonal projection)
 	proj[0][2] = 0;
 	proj[1][2] = 0;
-	proj[2][2] = -2 / (far - near);
-	proj[3][2] = -(far + near) / (far - near);
+	if (reversez::get().isReversed()) {
+		proj[2][2] = 1 / (far - near);
+		proj[3][2] = far / (far - near);
+	} else {
+		proj[2][2] = -2 / (far - near);
+		proj[3][2] = -(far + near) / (far - near);
+	}
 
 	proj[0][3] = 0;
 	proj[1][3] = 0;
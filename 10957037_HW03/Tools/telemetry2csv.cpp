@@ -0,0 +1,60 @@
+// Converts a telemetry recording (see Headers/telemetry.h) to CSV.
+// Build: cl /EHsc telemetry2csv.cpp  or  g++ -std=c++11 -o telemetry2csv telemetry2csv.cpp
+// Usage: telemetry2csv <input.bin> [output.csv]   (writes to stdout without an output file)
+
+#include "../Headers/telemetry.h"
+
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "Usage: %s <input.bin> [output.csv]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* input = std::fopen(argv[1], "rb");
+	if (!input) {
+		std::fprintf(stderr, "Failed to open %s\n", argv[1]);
+		return 1;
+	}
+
+	telemetry::FileHeader header;
+	if (std::fread(&header, sizeof(header), 1, input) != 1 || std::memcmp(header.magic, telemetry::MAGIC, sizeof(telemetry::MAGIC)) != 0) {
+		std::fprintf(stderr, "%s is not a telemetry file\n", argv[1]);
+		std::fclose(input);
+		return 1;
+	}
+	if (header.version != telemetry::VERSION || header.recordSize != sizeof(telemetry::FrameRecord)) {
+		std::fprintf(stderr, "Unsupported telemetry version %u (record size %u)\n", header.version, header.recordSize);
+		std::fclose(input);
+		return 1;
+	}
+	std::fseek(input, header.headerSize, SEEK_SET);
+
+	FILE* output = (argc > 2) ? std::fopen(argv[2], "w") : stdout;
+	if (!output) {
+		std::fprintf(stderr, "Failed to open %s\n", argv[2]);
+		std::fclose(input);
+		return 1;
+	}
+
+	std::fprintf(output, "frame,dt_ms,draw_calls,triangles,instances_drawn,instances_culled,rov_x,rov_y,rov_z,rov_yaw,camera_mode,viewport_mode,projection_mode\n");
+	telemetry::FrameRecord record;
+	unsigned long long count = 0;
+	// A recording that was not closed cleanly still has its count in the header, extra zeroed records are skipped.
+	while (count < header.recordCount && std::fread(&record, sizeof(record), 1, input) == 1) {
+		std::fprintf(output, "%u,%.4f,%u,%u,%u,%u,%.4f,%.4f,%.4f,%.3f,%u,%u,%u\n",
+			record.frameIndex, record.deltaTime, record.drawCalls, record.triangles, record.instancesDrawn, record.instancesCulled,
+			record.rovPosition[0], record.rovPosition[1], record.rovPosition[2], record.rovYaw,
+			record.cameraMode, record.viewportMode, record.projectionMode);
+		count++;
+	}
+
+	std::fclose(input);
+	if (output != stdout) {
+		std::fclose(output);
+	}
+	std::fprintf(stderr, "Converted %llu records\n", count);
+	return 0;
+}
@@ -0,0 +1,101 @@
+// Cooks textures (see Headers/cookedtexture.h): full mip chain, BC1 for opaque images and BC3 for images with alpha.
+// Build: cl /EHsc /O2 /std:c++17 texturecooker.cpp  or  g++ -std=c++17 -O2 -o texturecooker texturecooker.cpp
+// Usage: texturecooker [--uncompressed] [image or directory...]   (run from the project directory, defaults to
+//        Resources/Textures and its skybox folder, every image gets a .ctex next to it)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Headers/stb_image.h"
+#include "../Headers/cookedtexture.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+bool isImage(const fs::path& path) {
+	std::string extension = path.extension().string();
+	for (char& c : extension) {
+		c = (char)std::tolower((unsigned char)c);
+	}
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+bool cook(const std::string& path, bool isUncompressed) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int width, height, channels;
+	unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (!data) {
+		std::fprintf(stderr, "Failed to load %s: %s\n", path.c_str(), stbi_failure_reason());
+		return false;
+	}
+	// One and two channel images sample as (r, 0, 0) and (r, g, 0) at runtime, expanding them would change that
+	if (channels < 3) {
+		std::fprintf(stderr, "Skipped %s: %d channel images are left to the runtime loader\n", path.c_str(), channels);
+		stbi_image_free(data);
+		return true;
+	}
+	cooked::Image image;
+	image.width = width;
+	image.height = height;
+	image.pixels.assign(data, data + (size_t)width * height * 4);
+	stbi_image_free(data);
+
+	// Alpha channels that are fully opaque do not need BC3
+	bool hasAlpha = false;
+	for (size_t i = 3; i < image.pixels.size() && channels == 4; i += 4) {
+		hasAlpha = hasAlpha || image.pixels[i] < 255;
+	}
+	cooked::Format format = isUncompressed ? cooked::FORMAT_RGBA8 : (hasAlpha ? cooked::FORMAT_BC3 : cooked::FORMAT_BC1);
+	std::string output = cooked::getCookedPath(path);
+	if (!cooked::write(output, image, format, channels)) {
+		std::fprintf(stderr, "Failed to write %s\n", output.c_str());
+		return false;
+	}
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::fprintf(stderr, "%s: %d x %d %s, %.1f KB => %.1f KB (%.0f ms)\n", output.c_str(), width, height, cooked::FORMAT_NAMES[format],
+		width * height * 4 / 1024.0, (double)fs::file_size(output) / 1024.0, elapsed);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	bool isUncompressed = false;
+	std::vector<fs::path> inputs;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--uncompressed") {
+			isUncompressed = true;
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty()) {
+		inputs.push_back("Resources/Textures");
+	}
+
+	std::vector<std::string> images;
+	for (const fs::path& input : inputs) {
+		std::error_code error;
+		if (fs::is_directory(input, error)) {
+			for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input, error)) {
+				if (entry.is_regular_file() && isImage(entry.path())) {
+					images.push_back(entry.path().string());
+				}
+			}
+		} else if (fs::is_regular_file(input, error)) {
+			images.push_back(input.string());
+		} else {
+			std::fprintf(stderr, "No such file or directory: %s\n", input.string().c_str());
+			return 1;
+		}
+	}
+
+	int failed = 0;
+	for (const std::string& image : images) {
+		failed += cook(image, isUncompressed) ? 0 : 1;
+	}
+	std::fprintf(stderr, "Cooked %d of %d textures\n", (int)images.size() - failed, (int)images.size());
+	return failed > 0 ? 1 : 0;
+}